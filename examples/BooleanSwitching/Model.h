@@ -11,7 +11,7 @@
 
 #include "boost/shared_ptr.hpp"
 
-#include "database/structures/Atlas.h"
+#include "database/structures/StateGrid.h"
 
 #include "database/structures/RectGeo.h"
 #include "database/structures/ParameterSpace.h"
@@ -66,15 +66,23 @@ private:
   bool validateMorseGraph ( MorseGraph * mg_in ) const;
  
   std::vector < std::string > constructAnnotationsMorseSet (
-                                  const boost::shared_ptr<Grid> & phasespace,
-                                  const CellContainer & subset ) const;
+                                  const StateGrid & morseset ) const;
 
   bool hasAllStatesOn ( const Wall & wall ) const;
   bool hasAllStatesOff ( const Wall & wall ) const;
   
-  // Correspondence between the chart id and the wall
-  // restriction : we cannot subdivide the charts
-  boost::unordered_map<size_t, Wall> chartIdToWall_;     
+  // Correspondence between the state of the phase space and the wall
+  std::vector<Wall> stateToWall_;
+
+  // What the annotations need to know of a wall, computed once per wall
+  struct WallAnnotation {
+    bool fixed_point;
+    bool all_states_off;
+    bool all_states_on;
+    // degenerate directions of a wall which is not a fixed point
+    std::vector<int> variables;
+  };
+  std::vector<WallAnnotation> stateToAnnotation_;
     
 public:
   friend class boost::serialization::access;
@@ -105,11 +113,27 @@ Model::initialize ( int argc, char * argv [] ) {
       Wall wall ( cface, domain );
       if ( walls_ . count ( wall ) == 0 ) {
         // needed to be able to check conditions on morse sets
-        chartIdToWall_ [ num_walls ] = wall;
+        stateToWall_ . push_back ( wall );
         walls_ [ wall ] = num_walls ++;
       }
     }
   }   
+  // Precompute the wall information the annotations use
+  stateToAnnotation_ . resize ( num_walls );
+  for ( size_t id = 0; id < num_walls; ++ id ) {
+    const Wall & wall = stateToWall_ [ id ];
+    WallAnnotation & info = stateToAnnotation_ [ id ];
+    info . fixed_point = wall . isFixedPoint ();
+    info . all_states_off = hasAllStatesOff ( wall );
+    info . all_states_on = hasAllStatesOn ( wall );
+    if ( info . fixed_point ) continue;
+    const RectGeo & box = wall . rect ();
+    for ( unsigned int i = 0; i < box . dimension (); ++ i ) {
+      if ( std::abs(box.upper_bounds[i]-box.lower_bounds[i]) < 1e-12 ) {
+        info . variables . push_back ( i );
+      }
+    }
+  }
   std::cout << "Model::initialize. Initialization complete.\n";
 }
 
@@ -120,22 +144,16 @@ Model::parameterSpace ( void ) const {
 
 inline boost::shared_ptr < Grid > 
 Model::phaseSpace ( void ) const {
-  boost::shared_ptr < Atlas > space ( new Atlas );
-  typedef std::pair<Wall, size_t> WallIndexPair;
-  for ( WallIndexPair const& wall_index_pair : walls_ ) {
-    const Wall & wall = wall_index_pair . first;
-    int64_t wall_id = wall_index_pair . second;
-    RectGeo rect = wall . reducedRect (); 
-    space -> add_chart ( wall_id, rect );
-  }
-  space -> finalize ();
+  // One state per wall, numbered by wall id
+  boost::shared_ptr < StateGrid > space ( new StateGrid );
+  space -> initialize ( walls_ . size () );
   return boost::dynamic_pointer_cast<Grid> ( space );
 }
 
 inline boost::shared_ptr < const Map > 
 Model::map ( boost::shared_ptr<Parameter> p) const { 
-  boost::shared_ptr < ModelMap > atlasmap ( new ModelMap );
-  // Loop through domains and add wall maps
+  // Loop through domains and collect the wall to wall edges
+  std::vector < ModelMap::Edge > edges;
 #ifdef BS_DEBUG_MODELMAP
   std::ofstream outfile ("map.gv");
   outfile << "digraph G {\n";
@@ -156,9 +174,7 @@ Model::map ( boost::shared_ptr<Parameter> p) const {
       Wall wall2 ( cface_pair . second, domain );
       int64_t id1 = walls_ . find ( wall1 ) -> second;
       int64_t id2 = walls_ . find ( wall2 ) -> second;
-      BooleanChartMap map ( wall1 . reducedRect (), 
-                            wall2 . reducedRect () );
-      atlasmap -> addMap ( id1, id2, map );
+      edges . push_back ( ModelMap::Edge ( id1, id2 ) );
 #ifdef BS_DEBUG_MODELMAP
       mapped_out . insert ( id1 );
       mapped_in . insert ( id2 );
@@ -175,7 +191,7 @@ Model::map ( boost::shared_ptr<Parameter> p) const {
     }
   }
 #endif
-  return atlasmap;
+  return boost::shared_ptr < const Map > ( new ModelMap ( walls_ . size (), edges ) );
 }
 
 inline void 
@@ -191,7 +207,6 @@ Model::annotate( MorseGraph * mg_in ) const {
 
 inline bool Model::validateMorseGraph ( MorseGraph * mg_in ) const {
   MorseGraph & mg = *mg_in;
-  boost::shared_ptr < Grid > atlas = phaseSpace ( );
   // To validate a Morse Graph we need :
   // condition1 && !condition2 && condition3
   bool c1, c2, c3;
@@ -204,10 +219,10 @@ inline bool Model::validateMorseGraph ( MorseGraph * mg_in ) const {
       std::cout << "Abort! This vertex does not have an associated grid!\n";
       abort ();
     }
-    CellContainer my_subset = atlas -> subset ( * my_subgrid );
-    // construct the annotation of the morse set
+    // construct the annotation of the morse set (its grid elements are 
+    // states, i.e. wall ids, so no phase space is needed)
     std::vector < std::string > vertexAnnotation =
-    constructAnnotationsMorseSet ( atlas, my_subset );
+    constructAnnotationsMorseSet ( dynamic_cast<const StateGrid &> ( * my_subgrid ) );
     // Check the annotations to know which conditions are satisfied
     for ( unsigned int i=0; i<vertexAnnotation.size(); ++i ) {
       // annotate the vertex of the morsegraph
@@ -227,8 +242,7 @@ inline bool Model::validateMorseGraph ( MorseGraph * mg_in ) const {
 
 inline
 std::vector < std::string > Model::constructAnnotationsMorseSet (
-                                    const boost::shared_ptr<Grid> & phasespace,
-                                    const CellContainer & subset ) const {
+                                    const StateGrid & morseset ) const {
   std::vector < std::string > annotation;
   bool condition0, condition1, condition2, condition3, condition4;
   condition0 = false;
@@ -237,31 +251,24 @@ std::vector < std::string > Model::constructAnnotationsMorseSet (
   condition3 = false;
   condition4 = false;
   // to keep track of the variables making a transition
-  std::set < int > wallVariables;
-  // Loop through the grid elements of the morse set
-  BOOST_FOREACH ( Grid::GridElement ge, subset ) {
-    if ( not boost::dynamic_pointer_cast < AtlasGeo > ( phasespace -> geometry ( ge ) ) ) {
-      std::cout << "Unexpected null response from geometry\n";
-    }
-    AtlasGeo geo = * boost::dynamic_pointer_cast < AtlasGeo > ( phasespace -> geometry ( ge ) );
-    size_t id = geo . id ( );      
-    Wall wall = chartIdToWall_ . find ( id ) -> second;
-    if ( wall . isFixedPoint() ) {
-      if ( hasAllStatesOff ( wall ) ) { condition1 = true; }
-      if ( hasAllStatesOn ( wall ) ) { condition2 = true; }
+  std::vector < bool > wallVariables ( phase_space_dimension_, false );
+  int64_t numWallVariables = 0;
+  // Loop through the states (walls) of the morse set
+  for ( Grid::GridElement ge = 0; ge < morseset . size (); ++ ge ) {
+    const WallAnnotation & info = stateToAnnotation_ [ morseset . state ( ge ) ];
+    if ( info . fixed_point ) {
+      if ( info . all_states_off ) { condition1 = true; }
+      if ( info . all_states_on ) { condition2 = true; }
       if ( !condition1 && !condition2 ) { condition0 = true; }
     } else {
       condition4 = true;
-      RectGeo box = wall . rect();
-      // check which dimension is degenerated
-      bool checkstatus;
-      checkstatus = false;
-      for ( unsigned int i=0; i<box.dimension(); ++i ) {
-        if ( std::abs(box.upper_bounds[i]-box.lower_bounds[i]) < 1e-12 ) {
-          wallVariables . insert ( i );
+      for ( int i : info . variables ) {
+        if ( not wallVariables [ i ] ) {
+          wallVariables [ i ] = true;
+          ++ numWallVariables;
         }
       }
-      if ( wallVariables . size() == wall.rect().dimension() ) {
+      if ( numWallVariables == phase_space_dimension_ ) {
         condition3 = true;
       }
     }
@@ -274,12 +281,12 @@ std::vector < std::string > Model::constructAnnotationsMorseSet (
 //    std::cout << "NOT A FULL CYCLE : " << wallVariables.size() << "\n";
     std::string str;
     str = "";
-    std::set < int >::iterator it;
-    for ( it=wallVariables.begin(); it!=wallVariables.end(); ++it ) {
+    for ( int64_t i = 0; i < phase_space_dimension_; ++ i ) {
+      if ( not wallVariables [ i ] ) continue;
       std::stringstream ss;
-      ss << *it;
+      ss << i;
       str += ss.str() + " ";
-//      std::cout << "MYSTRING = " << *it <<"\n";
+//      std::cout << "MYSTRING = " << i <<"\n";
     }
 //    std::cout << "STRING =" << str << "\n";
     std::string conditionstring(CONDITION4STRING);
@@ -297,13 +304,9 @@ std::vector < std::string > Model::constructAnnotationsMorseSet (
 #ifdef BS_DEBUG_MODELMAP
     std::ofstream ofile;
     ofile . open ( "morseset.txt" );
-    BOOST_FOREACH ( Grid::GridElement ge, subset ) {
-      if ( not boost::dynamic_pointer_cast < AtlasGeo > ( phasespace -> geometry ( ge ) ) ) {
-        std::cout << "Unexpected null response from geometry\n";
-      }
-      AtlasGeo geo = * boost::dynamic_pointer_cast < AtlasGeo > ( phasespace -> geometry ( ge ) );
-      size_t id = geo . id ( );
-      Wall wall = chartIdToWall_ . find ( id ) -> second;
+    for ( Grid::GridElement ge = 0; ge < morseset . size (); ++ ge ) {
+      size_t id = morseset . state ( ge );
+      const Wall & wall = stateToWall_ [ id ];
       ofile << id << " " << wall.rect() << "\n";
     }
     ofile . close ();
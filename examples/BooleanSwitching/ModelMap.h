@@ -3,24 +3,11 @@
 #ifndef BOOLEANSWITCHINGMODELMAP_H
 #define BOOLEANSWITCHINGMODELMAP_H
 
-#include "database/maps/AtlasMap.h"
-#include "database/structures/RectGeo.h"
+#include "database/maps/StateMap.h"
 
-class BooleanChartMap {
-public:
-  BooleanChartMap ( void ) { }  
-  BooleanChartMap ( const RectGeo & chart1, 
-                    const RectGeo & chart2 ) 
-  : chart1_(chart1),chart2_(chart2) {}
-
-  RectGeo operator () ( const RectGeo & geo ) const {
-    return chart2_;
-  }
-
-private:
-  RectGeo chart1_, chart2_;
-};
-
-typedef AtlasMap<BooleanChartMap> ModelMap;
+/// ModelMap
+///   The map of a switching network sends walls to walls; it is given
+///   directly by the adjacency lists of the walls (see Model::map)
+typedef StateMap ModelMap;
 
 #endif
@@ -21,6 +21,15 @@
 #include "Parameter/BooleanSwitchingParameter.h"
 #include "Parameter/Polytope.h"
 
+/// BS_FACTOR_GRAPH_CACHE
+///   Directory where initialize keeps the factor graphs it constructs,
+///   one file per (n, m, logic, constraints), so that later runs and
+///   other processes (e.g. MPI ranks) load them instead of recomputing.
+///   Empty (the default) disables the cache.
+#ifndef BS_FACTOR_GRAPH_CACHE
+#define BS_FACTOR_GRAPH_CACHE ""
+#endif
+
 /// class BooleanSwitchingParameterSpace
 class BooleanSwitchingParameterSpace : public AbstractParameterSpace {
 public:
@@ -39,6 +48,14 @@ public:
   /// adjacencies
   ///    Return a vector of adjacent vertices.
   virtual std::vector<ParameterIndex> adjacencies ( ParameterIndex v ) const;
+
+  /// adjacencyBlock
+  ///    Adjacencies of begin, ..., end - 1 (see ParameterSpace::adjacencyBlock).
+  ///    The monotonic function indices are decoded once, for begin, and then
+  ///    stepped like an odometer.
+  virtual void adjacencyBlock ( ParameterIndex begin, ParameterIndex end,
+                                std::vector<uint64_t> * offsets,
+                                std::vector<ParameterIndex> * targets ) const;
   
   /// size
   ///    Return the number of vertices
@@ -138,7 +155,21 @@ BooleanSwitchingParameterSpace::initialize ( int argc, char * argv [] ) {
     }
     int64_t m = node . out_order . size ();
     for ( int64_t x : logic ) std::cout << x << " "; std::cout << "\n";
-    factors_ [ d ] . construct ( MonotonicMap ( n, m, logic, node . constraints ) );
+    MonotonicMap start ( n, m, logic, node . constraints );
+    std::string cache_directory ( BS_FACTOR_GRAPH_CACHE );
+    if ( cache_directory . empty () ) {
+      factors_ [ d ] . construct ( start );
+    } else {
+      std::stringstream filename;
+      filename << cache_directory << "/factorgraph_" << std::hex 
+               << boost::hash<std::string> () ( start . cacheKey () ) << ".txt";
+      if ( factors_ [ d ] . load ( filename . str (), start ) ) {
+        std::cout << "BooleanSwitchingParameterSpace::initialize. Loaded factors_[" << d << "] from " << filename . str () << "\n";
+      } else {
+        factors_ [ d ] . construct ( start );
+        factors_ [ d ] . save ( filename . str (), start );
+      }
+    }
     pinned_ [ d ] = node . choice;
     std::cout << "\n BooleanSwitchingParameterSpace::initialize. Constructing factors_[" << d << "] with n = " << n << " and m = " << m << "\n";
     std::cout << "This should correspond to " << network_ . name ( node . index ) << "\n";
@@ -150,27 +181,76 @@ BooleanSwitchingParameterSpace::initialize ( int argc, char * argv [] ) {
 inline std::vector<BooleanSwitchingParameterSpace::ParameterIndex> 
 BooleanSwitchingParameterSpace::adjacencies ( ParameterIndex v ) const {
   std::vector<ParameterIndex> result;
-  boost::shared_ptr<BooleanSwitchingParameter> p = 
-      boost::dynamic_pointer_cast<BooleanSwitchingParameter> ( parameter ( v ) );
-  if ( not p ) {
-    std::stringstream ss;
-    ss << "BooleanSwitchingParameterSpace::adjacencies. ";
-    ss << "Invalid ParameterIndex v = " << v << "\n";
-    throw std::domain_error ( ss . str () );
-  }
-  // Loop through coordinates and change monotonic functions by one
+  // Loop through coordinates and change monotonic functions by one,
+  // reading the digits of v (in the mixed radix of the factor graph sizes)
+  // as we go
+  ParameterIndex rest = v;
   uint64_t multiplier = 1;
   for ( int64_t d = 0; d < dimension_; ++ d ) {
     if ( pinned_[d] != -1 ) continue;
-    int64_t digit = p -> monotonic_function_ [ d ];
+    uint64_t factor_size = factors_ [ d ] . size ();
+    int64_t digit = rest % factor_size;
+    rest /= factor_size;
     std::vector<int64_t> const& neighbors = factors_ [ d ] . adjacencies ( digit );
     for ( int64_t neighbor : neighbors ) {
         result . push_back ( v + multiplier * ( neighbor - digit ) );
     }
-    multiplier *= factors_ [ d ] . size ();
+    multiplier *= factor_size;
+  }
+  if ( rest != 0 ) {
+    std::stringstream ss;
+    ss << "BooleanSwitchingParameterSpace::adjacencies. ";
+    ss << "Invalid ParameterIndex v = " << v << "\n";
+    throw std::domain_error ( ss . str () );
   }
   return result;
 }
+
+inline void
+BooleanSwitchingParameterSpace::adjacencyBlock ( ParameterIndex begin, ParameterIndex end,
+                                                 std::vector<uint64_t> * offsets,
+                                                 std::vector<ParameterIndex> * targets ) const {
+  offsets -> assign ( 1, 0 );
+  targets -> clear ();
+  if ( begin >= end ) return;
+  if ( end > size () ) {
+    std::stringstream ss;
+    ss << "BooleanSwitchingParameterSpace::adjacencyBlock. ";
+    ss << "Invalid ParameterIndex end = " << end << "\n";
+    throw std::domain_error ( ss . str () );
+  }
+  // The unpinned coordinates, with the digits of begin and their place values
+  std::vector<const FactorGraph *> factor;
+  std::vector<int64_t> digit;
+  std::vector<uint64_t> multiplier;
+  ParameterIndex rest = begin;
+  uint64_t place = 1;
+  for ( int64_t d = 0; d < dimension_; ++ d ) {
+    if ( pinned_[d] != -1 ) continue;
+    uint64_t factor_size = factors_ [ d ] . size ();
+    factor . push_back ( & factors_ [ d ] );
+    digit . push_back ( rest % factor_size );
+    multiplier . push_back ( place );
+    rest /= factor_size;
+    place *= factor_size;
+  }
+  size_t K = factor . size ();
+  offsets -> reserve ( end - begin + 1 );
+  for ( ParameterIndex v = begin; v < end; ++ v ) {
+    for ( size_t k = 0; k < K; ++ k ) {
+      std::vector<int64_t> const& neighbors = factor [ k ] -> adjacencies ( digit [ k ] );
+      for ( int64_t neighbor : neighbors ) {
+        targets -> push_back ( v + multiplier [ k ] * ( neighbor - digit [ k ] ) );
+      }
+    }
+    offsets -> push_back ( targets -> size () );
+    // Step to v + 1
+    for ( size_t k = 0; k < K; ++ k ) {
+      if ( ++ digit [ k ] < (int64_t) factor [ k ] -> size () ) break;
+      digit [ k ] = 0;
+    }
+  }
+}
     
 inline uint64_t 
 BooleanSwitchingParameterSpace::size ( void ) const {
@@ -6,14 +6,29 @@
 #define BOOLEANSWITCHINGFACTORGRAPH_H
 
 #include <vector>
+#include <stack>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "boost/unordered_map.hpp"
+#include "boost/unordered_set.hpp"
 #include "boost/foreach.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/serialization/vector.hpp"
+#include "boost/archive/text_oarchive.hpp"
+#include "boost/archive/text_iarchive.hpp"
 
 #include "Parameter/MonotonicMap.h"
 
 /// class ConnectedSmartGraph where vertices are smart in the sense that they
-///  (a) supply neighbors via a method "neighbors"
+///  (a) supply neighbors via a method "neighbors", or equivalently
+///      candidate neighbors via "perturbations", of which the neighbors 
+///      are those passing "realizable" (and, if "packable", are identified
+///      by the word "packed")
 ///  (b) the graph is connected
 template < class T >
 class ConnectedSmartGraph {
@@ -29,34 +44,85 @@ public:
     return vertices . size ();
   }
 
+  /// construct
+  ///   Find the vertices by depth-first search from start, numbering them
+  ///   in the order found, and their adjacency lists, in one pass.
+  ///   Candidates already found are not tested again, nor are candidates
+  ///   already rejected. Vertices are looked up by their packed encoding
+  ///   when they have one (see MonotonicMap::packed).
   void construct ( const T & start ) {
-    vertices . push_back ( start );
-    preorder [ start ] = 0;
-
-    std::stack<T> dfs_stack;
-    dfs_stack . push ( start );
-
-    //size_t count = 0;
-    while ( not dfs_stack . empty () ) {
-      //std::cout << ++ count << "   and stack size is " << dfs_stack . size () << "\n";
-      T vertex = dfs_stack . top ();
-      dfs_stack . pop ();
-      std::vector<boost::shared_ptr<T> > neighbors = vertex . neighbors ();
-      //std::cout << "Found " << neighbors . size () << " neighbors.\n";
-      BOOST_FOREACH ( boost::shared_ptr<T> ptr, neighbors ) {
-        if ( preorder . count ( *ptr ) ) continue;
-        preorder [ * ptr ] = vertices . size ();
-        vertices . push_back ( * ptr );
-        dfs_stack . push ( * ptr );
-      }
+    if ( start . packable () ) {
+      construct_<uint64_t> ( start, [] ( const T & x ) { return x . packed (); } );
+    } else {
+      construct_<T> ( start, [] ( const T & x ) { return x; } );
     }
-
-    compute_adjacencies ();
+    preorder . clear ();
+    for ( int64_t v = 0; v < vertices . size (); ++ v ) preorder [ vertices [ v ] ] = v;
     
     //std::cout << "FactorGraph. Number of vertices = " << vertices . size () << "\n";
     //std::cout << " Starting vertex was " << start << "\n";
   }
 
+  /// load
+  ///   Load the graph constructed from start from a file written by save.
+  ///   Return false (leaving the graph unchanged) if the file cannot be
+  ///   read or was written for a start vertex with another cacheKey.
+  bool load ( const std::string & filename, const T & start ) {
+    std::ifstream infile ( filename . c_str () );
+    if ( not infile . good () ) return false;
+    std::string key;
+    std::vector<T> loaded_vertices;
+    std::vector<std::vector< int64_t > > loaded_adjacencies;
+    try {
+      boost::archive::text_iarchive ia ( infile );
+      ia >> key;
+      if ( key != start . cacheKey () ) return false;
+      ia >> loaded_vertices;
+      ia >> loaded_adjacencies;
+    } catch ( ... ) {
+      return false;
+    }
+    if ( loaded_vertices . empty () || not ( loaded_vertices [ 0 ] == start ) ||
+         loaded_adjacencies . size () != loaded_vertices . size () ) return false;
+    vertices . swap ( loaded_vertices );
+    adjacencies_ . swap ( loaded_adjacencies );
+    preorder . clear ();
+    for ( int64_t v = 0; v < vertices . size (); ++ v ) preorder [ vertices [ v ] ] = v;
+    return true;
+  }
+
+  /// save
+  ///   Write the graph constructed from start to a file, for load. The
+  ///   file is written under a unique temporary name in the same
+  ///   directory (mkstemp) and then renamed, so that processes sharing
+  ///   the file -- on this host or another -- never read a partial one.
+  void save ( const std::string & filename, const T & start ) const {
+    std::ostringstream contents;
+    {
+      boost::archive::text_oarchive oa ( contents );
+      std::string key = start . cacheKey ();
+      oa << key;
+      oa << vertices;
+      oa << adjacencies_;
+    }
+    std::string bytes = contents . str ();
+    std::vector<char> temporary ( filename . begin (), filename . end () );
+    const char * suffix = ".XXXXXX";
+    temporary . insert ( temporary . end (), suffix, suffix + 8 );
+    int fd = mkstemp ( &temporary [ 0 ] );
+    if ( fd < 0 ) return;
+    bool ok = fchmod ( fd, 0644 ) == 0;
+    for ( size_t written = 0; ok && written < bytes . size (); ) {
+      ssize_t count = ::write ( fd, bytes . data () + written, bytes . size () - written );
+      ok = count > 0;
+      if ( ok ) written += count;
+    }
+    ok = ( ::close ( fd ) == 0 ) && ok;
+    if ( not ok || std::rename ( &temporary [ 0 ], filename . c_str () ) != 0 ) {
+      std::remove ( &temporary [ 0 ] );
+    }
+  }
+
   void compute_adjacencies ( void ) {
     adjacencies_ . resize ( vertices . size () );
     for ( int64_t v = 0; v < vertices . size (); ++ v ) {
@@ -88,6 +154,49 @@ public:
     outfile << "}\n\n";
   }
 
+private:
+  // construct, looking vertices up by key ( vertex )
+  template < class Key, class KeyFunction >
+  void construct_ ( const T & start, const KeyFunction & key ) {
+    vertices . clear ();
+    adjacencies_ . clear ();
+    boost::unordered_map<Key, int64_t> index;
+    boost::unordered_set<Key> rejected;
+    vertices . push_back ( start );
+    index [ key ( start ) ] = 0;
+    adjacencies_ . resize ( 1 );
+
+    std::stack<int64_t> dfs_stack;
+    dfs_stack . push ( 0 );
+
+    while ( not dfs_stack . empty () ) {
+      int64_t v = dfs_stack . top ();
+      dfs_stack . pop ();
+      std::vector<int64_t> neighbors;
+      T vertex = vertices [ v ];
+      vertex . perturbations ( [&] ( const T & candidate ) {
+        Key candidate_key = key ( candidate );
+        typename boost::unordered_map<Key, int64_t>::const_iterator it = 
+          index . find ( candidate_key );
+        if ( it != index . end () ) {
+          neighbors . push_back ( it -> second );
+          return;
+        }
+        if ( rejected . count ( candidate_key ) ) return;
+        if ( not candidate . realizable () ) {
+          rejected . insert ( candidate_key );
+          return;
+        }
+        int64_t u = vertices . size ();
+        index [ candidate_key ] = u;
+        vertices . push_back ( candidate );
+        dfs_stack . push ( u );
+        neighbors . push_back ( u );
+      } );
+      adjacencies_ . resize ( vertices . size () );
+      adjacencies_ [ v ] . swap ( neighbors );
+    }
+  }
 };
 
 // Specialization of ConnectedSmartGraph to MonotonicMap smart vertices
@@ -6,9 +6,15 @@
 #define MONOTONICMAP_H
 
 #include <iostream>
+#include <sstream>
 #include <vector>
+#include <string>
 #include "boost/foreach.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/functional/hash.hpp"
+#include "boost/serialization/serialization.hpp"
+#include "boost/serialization/vector.hpp"
+#include "boost/serialization/utility.hpp"
 
 /// class MonotonicMap
 /// a "smart vertex" class representing the dynamics of a node of
@@ -91,9 +97,88 @@ public:
     return true;
   }
 
+  /// monotonicAt
+  ///   Check monotonicity at input i alone: data_[i] is no less than the
+  ///   value at i with one bit cleared and no more than the value at i with
+  ///   one bit set. A map which is monotonic except perhaps at i is
+  ///   monotonic if and only if this holds.
+  bool monotonicAt ( int64_t i ) const {
+    for ( int64_t pos = 0; pos < n; ++ pos ) {
+      int64_t bit = 1 << pos;
+      if ( i & bit ) {
+        if ( data_[i] < data_[i ^ bit] ) return false;
+      } else {
+        if ( data_[i | bit] < data_[i] ) return false;
+      }
+    }
+    return true;
+  }
+
+  /// packable
+  ///   Return true if data_ fits in one word at packedBits () bits per value
+  bool packable ( void ) const {
+    return packedBits () * (1 << n) <= 64;
+  }
+
+  /// packed
+  ///   Packed encoding of data_ as a word (requires packable ()):
+  ///   data_[x] occupies bits packedBits () * x onwards
+  uint64_t packed ( void ) const {
+    int64_t bits = packedBits ();
+    int64_t N = (1 << n);
+    uint64_t code = 0;
+    for ( int64_t x = 0; x < N; ++ x ) code |= (uint64_t) data_[x] << ( bits * x );
+    return code;
+  }
+
+  /// packedBits
+  ///   Number of bits needed for a value 0, 1, ..., m
+  int64_t packedBits ( void ) const {
+    int64_t bits = 0;
+    while ( ( (int64_t) 1 << bits ) <= m ) ++ bits;
+    return bits;
+  }
+
+  /// thresholdMasks
+  ///   Packed encoding of data_ used by the bit-parallel tests (requires 
+  ///   n <= 6): bit x of (*masks)[t] is set when data_[x] >= t, for t = 1..m.
+  ///   (*masks)[0] has bits 0 to 2^n-1 set.
+  void thresholdMasks ( std::vector<uint64_t> * masks ) const {
+    int64_t N = (1 << n);
+    masks -> assign ( m + 1, 0 );
+    (*masks)[0] = ( N == 64 ) ? ~ (uint64_t) 0 : ( ( (uint64_t) 1 << N ) - 1 );
+    for ( int64_t x = 0; x < N; ++ x ) {
+      for ( int64_t t = 1; t <= data_[x]; ++ t ) (*masks)[t] |= (uint64_t) 1 << x;
+    }
+  }
+
   bool realizable ( void ) const {
-    // Step 1. Check constraints. (current algorithm takes 2^{2n}*|constraints| time) 
-    {
+    // Maps on at most 64 inputs are tested a word at a time
+    std::vector<uint64_t> masks;
+    if ( n <= 6 ) thresholdMasks ( &masks );
+    // Step 1. Check constraints. 
+    if ( n <= 6 ) {
+      // For each constraint, a ranges over the inputs with a & mask == x
+      // and its partner b = (a & ~mask) | y is a shifted by y - x, so
+      // "data_[a] > data_[b]" is a shift and a mask per threshold
+      int64_t N = (1 << n);
+      for ( std::pair<int64_t, std::pair<int64_t, int64_t>> const& constraint : constraints_ ) {
+        int64_t const& mask = constraint . first;
+        int64_t const& x = constraint . second . first;
+        int64_t const& y = constraint . second . second;
+        if ( (x & ~mask) || (y & ~mask) || x >= N || y >= N ) continue;
+        uint64_t sources = 0;
+        for ( int64_t a = 0; a < N; ++ a ) {
+          if ( (a & mask) == x ) sources |= (uint64_t) 1 << a;
+        }
+        for ( int64_t t = 1; t <= m; ++ t ) {
+          uint64_t above = masks[t] & sources;
+          above = ( y >= x ) ? ( above << (y - x) ) : ( above >> (x - y) );
+          if ( above & masks[0] & ~masks[t] ) return false;
+        }
+      }
+    } else {
+      // (takes 2^{2n}*|constraints| time) 
       int64_t N = (1 << n);
       for ( int64_t a = 0; a < N; ++ a ) {
         for ( int64_t b = 0; b < N; ++ b ) {
@@ -114,7 +199,36 @@ public:
       max_terms_in_factor = std::max ( max_terms_in_factor, logic_[i] );
     }
 
-    if ( (logic_ . size () == 1) || (max_terms_in_factor == 1) ) {
+    if ( ( (logic_ . size () == 1) || (max_terms_in_factor == 1) ) && n <= 6 ) {
+      // Case (n) or (1,1,...,1), bit-parallel. For inputs a, b within the
+      // bits I of i, the values data_[a|c] over c outside I form the word
+      // ( masks[t] >> a ) restricted to the subsets of ~i (as a|c == a+c),
+      // so each comparison of a with b over all c is a few word operations.
+      int64_t N = (1 << n);
+      for ( int64_t i = 0; i < N; ++ i ) {
+        int64_t complement = (N - 1) & ~i;
+        uint64_t outside = 0;
+        for ( int64_t c = complement; ; c = (c - 1) & complement ) {
+          outside |= (uint64_t) 1 << c;
+          if ( c == 0 ) break;
+        }
+        for ( int64_t a = i; a != 0; a = (a - 1) & i ) {
+          for ( int64_t b = (a - 1) & i; ; b = (b - 1) & i ) {
+            uint64_t less = 0;
+            uint64_t greater = 0;
+            for ( int64_t t = 1; t <= m; ++ t ) {
+              uint64_t A = ( masks[t] >> a ) & outside;
+              uint64_t B = ( masks[t] >> b ) & outside;
+              less |= B & ~A;
+              greater |= A & ~B;
+            }
+            if ( less && greater ) return false;
+            if ( b == 0 ) break;
+          }
+        }
+      }
+      return true;
+    } else if ( (logic_ . size () == 1) || (max_terms_in_factor == 1) ) {
       // Case (n) (all sum case) or Case (1,1,1,1...,1) (n-times, all product case)
       int64_t N = (1 << n);
       for ( int64_t i = 0; i < N; ++ i ) {
@@ -235,31 +349,38 @@ public:
     return false;
   }
 
-  // return adjacent monotonic maps
-  std::vector<boost::shared_ptr<MonotonicMap> > neighbors ( void ) const {
-    //std::cout << "Calling neighbors.\n";
-    std::vector<boost::shared_ptr<MonotonicMap> > results;
-
-    // Obtain neighbors via changing the monotone function
-    std::vector<int64_t> copy = data_;
+  /// perturbations
+  ///   Call f ( map ) for each monotonic map obtained from this (monotonic)
+  ///   map by changing one value of data_ by one, in the order data_[0]-1,
+  ///   data_[0]+1, data_[1]-1, ... . map is a scratch copy, changed in 
+  ///   place between calls, and is not checked for realizability.
+  template < class Function >
+  void perturbations ( const Function & f ) const {
+    MonotonicMap copy ( *this );
     int64_t N = (1 << n);
     for ( int64_t i = 0; i < N; ++ i ) {
-      if ( copy[i] > 0 ) {
-        -- copy[i];
-        boost::shared_ptr<MonotonicMap> new_map ( new MonotonicMap ( n, m, logic_, constraints_, copy ) );
-        if ( new_map -> monotonic () && new_map -> realizable () ) 
-          results . push_back ( new_map );
-        ++ copy[i];
+      if ( copy.data_[i] > 0 ) {
+        -- copy.data_[i];
+        if ( copy . monotonicAt ( i ) ) f ( copy );
+        ++ copy.data_[i];
       }
-      if ( copy[i] < m ) {
-        ++ copy[i];
-        boost::shared_ptr<MonotonicMap> new_map ( new MonotonicMap ( n, m, logic_, constraints_, copy ) );
-        if ( new_map -> monotonic () && new_map -> realizable () ) 
-          results . push_back ( new_map );
-        -- copy[i];
+      if ( copy.data_[i] < m ) {
+        ++ copy.data_[i];
+        if ( copy . monotonicAt ( i ) ) f ( copy );
+        -- copy.data_[i];
       }
     }
+  }
 
+  // return adjacent monotonic maps
+  std::vector<boost::shared_ptr<MonotonicMap> > neighbors ( void ) const {
+    //std::cout << "Calling neighbors.\n";
+    std::vector<boost::shared_ptr<MonotonicMap> > results;
+    // Obtain neighbors via changing the monotone function
+    perturbations ( [&] ( const MonotonicMap & new_map ) {
+      if ( new_map . realizable () ) 
+        results . push_back ( boost::shared_ptr<MonotonicMap> ( new MonotonicMap ( new_map ) ) );
+    } );
     return results;
   }
 
@@ -322,6 +443,31 @@ public:
     return ss . str ();
   }
 
+  /// cacheKey
+  ///   String determining the factor graph of the map: n, m, logic_ and
+  ///   constraints_ (see ConnectedSmartGraph::load)
+  std::string cacheKey ( void ) const {
+    std::stringstream ss;
+    ss << n << " " << m << " :";
+    for ( int64_t k : logic_ ) ss << " " << k;
+    ss << " :";
+    for ( std::pair<int64_t,std::pair<int64_t,int64_t>> const& constraint : constraints_ ) {
+      ss << " " << constraint . first << "," << constraint . second . first 
+         << "," << constraint . second . second;
+    }
+    return ss . str ();
+  }
+
+  friend class boost::serialization::access;
+  template<class Archive>
+  void serialize(Archive & ar, const unsigned int version) {
+    ar & n;
+    ar & m;
+    ar & logic_;
+    ar & constraints_;
+    ar & data_;
+  }
+
   friend std::size_t hash_value ( const MonotonicMap & p ) {
     std::size_t seed = 0;
     int64_t N = (1 << p.n);
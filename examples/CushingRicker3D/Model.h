@@ -3,6 +3,8 @@
 
 #include "ModelMap.h"
 #include "database/maps/Map.h"
+#include "database/maps/BatchMap.h"
+#include "database/maps/SimdBatchMap.h"
 #include "database/structures/EuclideanParameterSpace.h"
 #include "database/structures/TreeGrid.h"
 #include "database/structures/PointerGrid.h"
@@ -17,6 +19,11 @@
 #define PHASE_GRID PointerGrid
 #define PARAMETER_GRID UniformGrid
 
+/// USE_SIMD_INTERVAL
+///   If defined, and no other interval type is selected, map evaluates
+///   batches of boxes with SimdBatchMap instead of BatchMap. Its images
+///   are wider, so the output can change (see SimdBatchMap).
+
 class Model {
  public:
   /// initialize
@@ -99,7 +106,12 @@ Model::map ( boost::shared_ptr<Parameter> p ) const {
     throw std::logic_error ( "No parameter for map specified. " 
                              "Check Model.h and command line parameters.\n");
   }
-  return boost::shared_ptr < Map > ( new ModelMap ( p ) );
+#if defined(USE_SIMD_INTERVAL) && not defined(USE_BOOST_INTERVAL) && \
+    not defined(USE_CAPD) && not defined(USE_RIGOROUS_INTERVAL)
+  return boost::shared_ptr < Map > ( new SimdBatchMap<ModelMap> ( p ) );
+#else
+  return boost::shared_ptr < Map > ( new BatchMap<ModelMap> ( p ) );
+#endif
 }
 
 inline boost::shared_ptr < const Map > 
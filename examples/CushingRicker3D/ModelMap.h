@@ -25,9 +25,13 @@ using namespace capd;
 
 #ifndef USE_BOOST_INTERVAL
 #ifndef USE_CAPD
+#ifdef USE_RIGOROUS_INTERVAL
+#include "database/numerics/rigorous_interval.h"
+#else
 #include "database/numerics/simple_interval.h"
 #endif
 #endif
+#endif
 
 
 struct ModelMap : public Map {
@@ -36,8 +40,12 @@ typedef capd::intervals::Interval<double> interval;
 #endif  
 #ifndef USE_BOOST_INTERVAL
 #ifndef USE_CAPD
+#ifdef USE_RIGOROUS_INTERVAL
+  typedef rigorous_interval<double> interval;
+#else
   typedef simple_interval<double> interval;
 #endif
+#endif
 #endif  
   std::vector < interval > parameter;
 
@@ -75,23 +83,7 @@ typedef capd::intervals::Interval<double> interval;
       //x [ i ] = interval (std::max(0.0, rectangle . lower_bounds [ i ]), 
       //                    std::max(0.0, rectangle . upper_bounds [ i ]));
     }
-    /********************************************************************* 
-      Define the map in terms of the phase space variables and parameters. 
-    *********************************************************************/
-    
-    // parameters : b1, b2, c12, c13, c31, c33, rho
-    // y1 = b1 y2 exp( - (c12*y2+c13*y3) )
-    // y2 = rho y1
-    // y3 = b2 y3 exp( - (c31*y1+c33*y3) )
-
-    y [ 0 ] = parameter[0] * x[1] * exp( -1.0* ( parameter[2]*x[1]+parameter[3]*x[2] ) );
-
-    y [ 1 ] = parameter[6] * x[0];
-
-    y [ 2 ] = parameter[1] * x[2] * exp( -1.0* ( parameter[4]*x[0]+parameter[5]*x[2] ) );
-    
-    /*********************************************************************  
-    *********************************************************************/
+    compute ( x . data (), y . data () );
 
 #ifdef USE_BOOST_INTERVAL
     for ( unsigned int i=0; i<rectangle.dimension(); ++i ) {
@@ -116,6 +108,28 @@ typedef capd::intervals::Interval<double> interval;
 #endif  
     return return_value;
   } 
+
+  // Map formula, for any interval type (see SimdBatchMap)
+  template < class I >
+  void compute ( const I * x, I * y ) const {
+    /********************************************************************* 
+      Define the map in terms of the phase space variables and parameters. 
+    *********************************************************************/
+    
+    // parameters : b1, b2, c12, c13, c31, c33, rho
+    // y1 = b1 y2 exp( - (c12*y2+c13*y3) )
+    // y2 = rho y1
+    // y3 = b2 y3 exp( - (c31*y1+c33*y3) )
+
+    y [ 0 ] = parameter[0] * x[1] * exp( -1.0* ( parameter[2]*x[1]+parameter[3]*x[2] ) );
+
+    y [ 1 ] = parameter[6] * x[0];
+
+    y [ 2 ] = parameter[1] * x[2] * exp( -1.0* ( parameter[4]*x[0]+parameter[5]*x[2] ) );
+    
+    /*********************************************************************  
+    *********************************************************************/
+  }
 };
 
 #endif
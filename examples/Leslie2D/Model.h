@@ -2,10 +2,13 @@
 #define CMDB_MODEL_H
 
 #include "ModelMap.h"
+#include "database/maps/BatchMap.h"
+#include "database/maps/SimdBatchMap.h"
 #include "database/maps/Map.h"
 #include "database/structures/EuclideanParameterSpace.h"
 #include "database/structures/TreeGrid.h"
 #include "database/structures/PointerGrid.h"
+#include "database/structures/CompactGrid.h"
 #include "database/structures/SuccinctGrid.h"
 #include "database/structures/UniformGrid.h"
 #include "database/structures/MorseGraph.h"
@@ -14,9 +17,14 @@
 #include <cstdlib>
 #include <exception>
 
-#define PHASE_GRID PointerGrid
+#define PHASE_GRID PointerGrid // or CompactGrid, for large phase space grids
 #define PARAMETER_GRID UniformGrid
 
+/// USE_SIMD_INTERVAL
+///   If defined (without USE_RIGOROUS_INTERVAL), map returns a
+///   SimdBatchMap rather than a BatchMap. Faster with AVX, but the Morse
+///   graphs may differ from the default ones (see SimdBatchMap).
+
 class Model {
  public:
   /// initialize
@@ -100,7 +108,11 @@ Model::map ( boost::shared_ptr<Parameter> p ) const {
     throw std::logic_error ( "No parameter for map specified. " 
                              "Check Model.h and command line parameters.\n");
   }
-  return boost::shared_ptr < Map > ( new ModelMap ( p ) );
+#if defined(USE_SIMD_INTERVAL) && not defined(USE_RIGOROUS_INTERVAL)
+  return boost::shared_ptr < Map > ( new SimdBatchMap<ModelMap> ( p ) );
+#else
+  return boost::shared_ptr < Map > ( new BatchMap<ModelMap> ( p ) );
+#endif
 }
 
 inline boost::shared_ptr < const Map > 
@@ -6,13 +6,21 @@
 #include "database/maps/Map.h"
 #include "database/structures/EuclideanParameterSpace.h"
 #include "database/structures/RectGeo.h"
+#ifdef USE_RIGOROUS_INTERVAL
+#include "database/numerics/rigorous_interval.h"
+#else
 #include "database/numerics/simple_interval.h"
+#endif
 #include <boost/shared_ptr.hpp>
 #include <vector>
 
 class ModelMap : public Map {
 public:
+#ifdef USE_RIGOROUS_INTERVAL
+  typedef rigorous_interval<double> interval;
+#else
   typedef simple_interval<double> interval;
+#endif
 
 // User interface: method to be provided by user
   // Parameter variables
@@ -32,13 +40,21 @@ public:
     interval x1 = getRectangleComponent ( rectangle, 1 );
 
     // Evaluate map
-    interval y0 = (p0 * x0 + p1 * x1 ) * exp ( -0.1 * (x0 + x1) );     
-    interval y1 = 0.7 * x0;
+    interval x [ 2 ] = { x0, x1 };
+    interval y [ 2 ];
+    compute ( x, y );
     
     // Return result
-    return makeRectangle ( y0, y1 );
+    return makeRectangle ( y [ 0 ], y [ 1 ] );
   } 
 
+  // Map formula, for any interval type (see SimdBatchMap)
+  template < class I >
+  void compute ( const I * x, I * y ) const {
+    y [ 0 ] = (p0 * x [ 0 ] + p1 * x [ 1 ] ) * exp ( -0.1 * (x [ 0 ] + x [ 1 ]) );     
+    y [ 1 ] = 0.7 * x [ 0 ];
+  }
+
 // Program interface (methods used by program)
 
   ModelMap ( boost::shared_ptr<Parameter> parameter ) {
@@ -52,6 +68,7 @@ public:
     return boost::shared_ptr<Geo> ( new RectGeo ( 
         operator () ( * boost::dynamic_pointer_cast<RectGeo> ( geo ) ) ) );
   }
+
 private:
   interval getRectangleComponent ( const RectGeo & rectangle, int d ) const {
     return interval (rectangle . lower_bounds [ d ], rectangle . upper_bounds [ d ]); 
@@ -3,6 +3,7 @@
 
 #include "ModelMap.h"
 #include "database/maps/Map.h"
+#include "database/maps/BatchMap.h"
 #include "database/structures/EuclideanParameterSpace.h"
 #include "database/structures/TreeGrid.h"
 #include "database/structures/PointerGrid.h"
@@ -100,7 +101,7 @@ Model::map ( boost::shared_ptr<Parameter> p ) const {
     throw std::logic_error ( "No parameter for map specified. " 
                              "Check Model.h and command line parameters.\n");
   }
-  return boost::shared_ptr < Map > ( new ModelMap ( p ) );
+  return boost::shared_ptr < Map > ( new BatchMap<ModelMap> ( p ) );
 }
 
 inline boost::shared_ptr < const Map > 
@@ -3,6 +3,7 @@
 
 #include "ModelMap.h"
 #include "database/maps/Map.h"
+#include "database/maps/BatchMap.h"
 #include "database/structures/EuclideanParameterSpace.h"
 #include "database/structures/TreeGrid.h"
 #include "database/structures/PointerGrid.h"
@@ -100,7 +101,7 @@ Model::map ( boost::shared_ptr<Parameter> p ) const {
     throw std::logic_error ( "No parameter for map specified. " 
                              "Check Model.h and command line parameters.\n");
   }
-  boost::shared_ptr < ModelMap > result ( new ModelMap ( p ) );
+  boost::shared_ptr < ModelMap > result ( new BatchMap<ModelMap> ( p ) );
   if ( not result -> good () ) result . reset ();
   return result;
 }
@@ -6,6 +6,7 @@
 #include "database/structures/SuccinctGrid.h"
 #include "database/structures/UniformGrid.h"
 #include "database/structures/EdgeGrid.h"
+#include "database/structures/StateGrid.h"
 #include "database/structures/ParameterSpace.h"
 #include "database/structures/EuclideanParameterSpace.h"
 #include "database/structures/AbstractParameterSpace.h"
@@ -13,6 +14,7 @@ BOOST_CLASS_EXPORT_IMPLEMENT(PointerGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(SuccinctGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(UniformGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(EdgeGrid);
+BOOST_CLASS_EXPORT_IMPLEMENT(StateGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(EuclideanParameter);
 BOOST_CLASS_EXPORT_IMPLEMENT(EuclideanParameterSpace);
 BOOST_CLASS_EXPORT_IMPLEMENT(AbstractParameterSpace);
@@ -28,6 +30,7 @@ BOOST_CLASS_EXPORT_IMPLEMENT(AbstractParameterSpace);
 #include "Parameter/FactorGraph.h"
 #include "database/structures/ParameterSpace.h"
 #include "database/structures/Database.h"
+#include "database/structures/MappedDatabase.h"
 
 #include <boost/algorithm/string.hpp>
 
@@ -37,35 +40,32 @@ BOOST_CLASS_EXPORT_IMPLEMENT(AbstractParameterSpace);
 //path/database.mdb path path/networks/mynetwork.txt mgcc_index
 
 int main ( int argc, char * argv [] ) {
-  Database database;
-  database . load ( argv [ 1 ] );
+  MappedDatabase database ( columnarDatabaseFile ( argv [ 1 ] ) . c_str () );
 
+  boost::shared_ptr<ParameterSpace> stored_space = database . parameterSpace ();
   const AbstractParameterSpace & space = 
-    dynamic_cast<const AbstractParameterSpace&> (database . parameter_space ());
+    dynamic_cast<const AbstractParameterSpace&> (* stored_space);
 
   boost::unordered_set < uint64_t > parameters;
   boost::unordered_set < uint64_t > mgr_indices;
   
   
-  const std::vector < MGCC_Record > & mgcc_records =
-  database . MGCC_Records ();
-  
-  std::cout << "Number of records : " << mgcc_records.size() << "\n";
+  std::cout << "Number of records : " << database . numMGCCs () << "\n";
   
   // the index of interest comes from the last argument
   uint64_t mgcc;
   mgcc = atoi(argv[argc-1]);
   
   // we take the first parameter index from that particular record
-  const MGCCP_Record & mgccp_record =
-  database . MGCCP_Records () [ mgcc_records[mgcc].mgccp_indices[0] ];
+  const MGCCP_Record mgccp_record =
+  database . MGCCP ( database . MGCC ( mgcc ) . mgccp_indices[0] );
   uint64_t morsegraph_index = mgccp_record . morsegraph_index;
   mgr_indices . insert ( morsegraph_index );
-  const MorseGraphRecord & morsegraph_record =
-  database . morsegraphData () [ morsegraph_index ];
+  const MorseGraphRecord morsegraph_record =
+  database . morsegraph ( morsegraph_index );
   
   uint64_t dag_index = morsegraph_record . dag_index;
-  const DAG_Data & dag_data = database . dagData () [ dag_index ];
+  const DAG_Data dag_data = database . dag ( dag_index );
   
   std::cout << "Number of vertices : " << dag_data . num_vertices << "\n";
   
@@ -8,6 +8,7 @@
 #include "database/structures/SuccinctGrid.h"
 #include "database/structures/UniformGrid.h"
 #include "database/structures/EdgeGrid.h"
+#include "database/structures/StateGrid.h"
 #include "database/structures/ParameterSpace.h"
 #include "database/structures/EuclideanParameterSpace.h"
 #include "database/structures/AbstractParameterSpace.h"
@@ -15,6 +16,7 @@ BOOST_CLASS_EXPORT_IMPLEMENT(PointerGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(SuccinctGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(UniformGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(EdgeGrid);
+BOOST_CLASS_EXPORT_IMPLEMENT(StateGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(EuclideanParameter);
 BOOST_CLASS_EXPORT_IMPLEMENT(EuclideanParameterSpace);
 BOOST_CLASS_EXPORT_IMPLEMENT(AbstractParameterSpace);
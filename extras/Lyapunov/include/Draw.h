@@ -22,10 +22,10 @@ void draw2Dimage ( const std::vector<double> & data,
 		bounds.lower_bounds[d] = outer_bounds.upper_bounds[d];
 		bounds.upper_bounds[d] = outer_bounds.lower_bounds[d];
 	}
-	for ( int i = 0; i < N; ++ i ) {
+	for ( LeafGeometryIterator it ( *grid ); not it . done (); it . next () ) {
+		int i = it . element ();
 		if ( data [ i ] != 0.0 ) {
-			RectGeo r = * boost::dynamic_pointer_cast<RectGeo> 
-    		(grid -> geometry ( Grid::iterator(i) ));
+			const RectGeo & r = it . box ();
     	for ( int d= 0 ;  d < r . dimension (); ++ d ) {
     		bounds . lower_bounds [ d ] = std::min(bounds.lower_bounds[d],r.lower_bounds[d]);
     		bounds . upper_bounds [ d ] = std::max(bounds.upper_bounds[d],r.upper_bounds[d]);
@@ -49,10 +49,10 @@ void draw2Dimage ( const std::vector<double> & data,
   	if ( data [ i ] > max_data ) max_data = data [ i ];
   }
   if ( max_data == 0.0 ) max_data = 1.0;
-  for ( int i = 0; i < N; ++ i ) {
+  for ( LeafGeometryIterator it ( *grid ); not it . done (); it . next () ) {
+    int i = it . element ();
   	if ( data [ i ] == 0.0 ) continue;
-    RectGeo r = * boost::dynamic_pointer_cast<RectGeo> 
-    	(grid -> geometry ( Grid::iterator(i) ));
+    const RectGeo & r = it . box ();
     int color = (int)((data [ i ]/max_data) * 255.0);
     pic . draw_square ( color, color, color, 
     	r . lower_bounds [ 0 ],
@@ -81,17 +81,15 @@ void draw2DAttractorRepeller ( const std::vector<bool> & mis,
 															 const std::vector<bool> & attractor,
  												       const std::vector<bool> & repeller,
 									 boost::shared_ptr<const TreeGrid> grid ) {
-	int N = grid -> size ();
 	RectGeo bounds = grid -> bounds ();
 	RectGeo outer_bounds = grid -> bounds ();
 	for ( int d = 0; d < bounds . dimension (); ++ d ) {
 		bounds.lower_bounds[d] = outer_bounds.upper_bounds[d];
 		bounds.upper_bounds[d] = outer_bounds.lower_bounds[d];
 	}
-	for ( int i = 0; i < N; ++ i ) {
+	for ( LeafGeometryIterator it ( *grid ); not it . done (); it . next () ) {
 		//if ( repeller [ i ] || mis [ i ] || attractor [ i ] ) {
-			RectGeo r = * boost::dynamic_pointer_cast<RectGeo> 
-    		(grid -> geometry ( Grid::iterator(i) ));
+			const RectGeo & r = it . box ();
     	for ( int d= 0 ;  d < r . dimension (); ++ d ) {
     		bounds . lower_bounds [ d ] = std::min(bounds.lower_bounds[d],r.lower_bounds[d]);
     		bounds . upper_bounds [ d ] = std::max(bounds.upper_bounds[d],r.upper_bounds[d]);
@@ -111,9 +109,9 @@ void draw2DAttractorRepeller ( const std::vector<bool> & mis,
 		bounds . lower_bounds [ 1 ],
 		bounds . upper_bounds [ 1 ]);
   
-  for ( int i = 0; i < N; ++ i ) {
-    RectGeo r = * boost::dynamic_pointer_cast<RectGeo> 
-    	(grid -> geometry ( Grid::iterator(i) ));
+  for ( LeafGeometryIterator it ( *grid ); not it . done (); it . next () ) {
+    int i = it . element ();
+    const RectGeo & r = it . box ();
     int color = 0;
     int red = 0;
     int green = 0;
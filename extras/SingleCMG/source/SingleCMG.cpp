@@ -46,6 +46,8 @@
 BOOST_CLASS_EXPORT_IMPLEMENT(SuccinctGrid);
 #include "database/structures/PointerGrid.h"
 BOOST_CLASS_EXPORT_IMPLEMENT(PointerGrid);
+#include "database/structures/CompactGrid.h"
+BOOST_CLASS_EXPORT_IMPLEMENT(CompactGrid);
 
 
 /*************************/
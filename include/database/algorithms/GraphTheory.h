@@ -7,9 +7,65 @@
 #include "database/structures/Grid.h"
 #include "database/maps/Map.h"
 #include <vector>
+#include <deque>
 #include <queue>
 #include <boost/shared_ptr.hpp>
 
+/// CMDB_ADJACENCY_STORE_MEMORY
+///   Number of bytes of adjacency lists computeMorseSetsAndReachability may 
+///   keep in memory between the SCC and reachability passes, counting the
+///   index of 12 bytes per grid element. 
+///   Define CMDB_ADJACENCY_STORE_SPILL to spill lists beyond this to disk,
+///   or NO_ADJACENCY_STORE to always recompute them.
+#ifndef CMDB_ADJACENCY_STORE_MEMORY
+#define CMDB_ADJACENCY_STORE_MEMORY (((uint64_t)1) << 30)
+#endif
+
+/// CMDB_GRAPH_THREADS
+///   Number of threads computeMorseSetsAndReachability uses to construct
+///   adjacency lists (see MapGraph::computeAdjacencies) before the SCC pass.
+///   0 means one per hardware thread. The default of 1 computes lists on 
+///   demand, which is appropriate when running one MPI process per core.
+#ifndef CMDB_GRAPH_THREADS
+#define CMDB_GRAPH_THREADS 1
+#endif
+
+/// CMDB_SCC_THREADS
+///   Number of threads computeStrongComponents uses (on graphs of more than
+///   10000 vertices); 0 means one per hardware thread. The default of 1 runs
+///   the sequential algorithm, which holds no adjacency lists. With more
+///   threads computeStrongComponentsParallel is used, which evaluates the
+///   map in parallel and holds the whole graph in memory (about 4 bytes
+///   per edge and 20 per vertex for graphs of fewer than 2^32 vertices).
+///   The Map must be safe to evaluate concurrently.
+#ifndef CMDB_SCC_THREADS
+#define CMDB_SCC_THREADS 1
+#endif
+
+/// CMDB_REACHABILITY_WORDS
+///   Width, in 64-bit words (1, 2, 4 or 8), of the bitsets computeReachability
+///   propagates; one pass over the condensation handles 64 times this many
+///   Morse sets. The default of 8 (512 bits) fills two AVX2 or one AVX-512
+///   register per operation.
+#ifndef CMDB_REACHABILITY_WORDS
+#define CMDB_REACHABILITY_WORDS 8
+#endif
+
+/// CMDB_REACHABILITY_MEMORY
+///   Bytes of bitsets computeReachability may use; narrower bitsets (and
+///   more passes) are used for condensations too large for the width above.
+#ifndef CMDB_REACHABILITY_MEMORY
+#define CMDB_REACHABILITY_MEMORY (((uint64_t)1) << 30)
+#endif
+
+/// CMDB_EXTERNAL_SCC_STACKS
+///   Define to keep the stacks of computeStrongComponents (DFS, LOWLINK, 
+///   and S) and the topological sort passed from it to computeReachability 
+///   in temporary files (see ExternalStack.h), so that only the memory
+///   MEMORYBOOKKEEPING counts as internal need be held in RAM. The files
+///   are written and read sequentially in blocks of 
+///   CMDB_EXTERNAL_STACK_BLOCK bytes.
+
 /// computeMorseSetsAndReachability
 void computeMorseSetsAndReachability (std::vector< boost::shared_ptr<Grid> > * output,
                                       std::vector<std::vector<unsigned int> > * reach,
@@ -19,18 +75,37 @@ void computeMorseSetsAndReachability (std::vector< boost::shared_ptr<Grid> > * o
 /// computeStrongComponents
 ///    Modified version of Tarjan's algorithm devised by Shaun Harker
 ///    Only calls for adjacency lists once each, yet only requires O(V) space.
-template < class Graph >
+///    topological_sort may be any sequence with push_back (a std::deque, 
+///    or an ExternalStack).
+template < class Graph, class VertexSequence = std::deque<typename Graph::Vertex> >
 void computeStrongComponents (std::vector<std::deque<typename Graph::Vertex> > * output,
                               const Graph & G,
-         /* optional output */std::deque<typename Graph::Vertex> * topological_sort = 0,
+         /* optional output */VertexSequence * topological_sort = 0,
+         /* optional output */std::deque<typename Graph::Vertex> * SCC_root = 0);
+
+/// computeStrongComponentsParallel
+///    computeStrongComponents on num_threads threads: the adjacency lists
+///    are computed in parallel into memory, vertices that cannot lie on a
+///    cycle are trimmed in parallel (in topological order), and the
+///    remaining core is searched with Tarjan's algorithm. Same output
+///    conventions as computeStrongComponents, though SCPCs may be listed
+///    in a different order.
+template < class Graph, class VertexSequence = std::deque<typename Graph::Vertex> >
+void computeStrongComponentsParallel (std::vector<std::deque<typename Graph::Vertex> > * output,
+                                      const Graph & G,
+                                      int num_threads,
+         /* optional output */VertexSequence * topological_sort = 0,
          /* optional output */std::deque<typename Graph::Vertex> * SCC_root = 0);
 
 /// computeReachability
-template < class Graph >
+///    Reachability between Morse sets, computed over the condensation of
+///    the graph (see condenseForReachability in GraphTheory.hpp).
+///    topological_sort is read backwards, by operator [].
+template < class Graph, class VertexSequence >
 void computeReachability ( std::vector < std::vector < unsigned int > > * output, 
                            std::vector<std::deque<typename Graph::size_type> > & morse_sets, 
                            const Graph & G, 
-                           const std::deque<typename Graph::size_type> & topological_sort );
+                           const VertexSequence & topological_sort );
 
 #include "database/algorithms/GraphTheory.hpp"
 
@@ -7,10 +7,15 @@
 #include <queue>
 #include <algorithm>
 #include <memory>
+#include <limits>
+#include <atomic>
+#include <exception>
 #include "boost/unordered_set.hpp"
 #include "boost/unordered_map.hpp"
 #include "boost/foreach.hpp"
 #include "database/structures/MapGraph.h"
+#include "database/structures/ExternalStack.h"
+#include "database/algorithms/parallelFor.h"
 
 #define DEBUGPRINT if(0)
 
@@ -22,15 +27,49 @@ uint64_t graph_memory = 0;
 uint64_t max_graph_memory = 0;
 #endif
 
+/// strongComponentsThreads
+///   Number of threads computeStrongComponents uses on G 
+///   (see CMDB_SCC_THREADS in GraphTheory.h)
+template < class Graph >
+int strongComponentsThreads ( const Graph & G ) {
+  int threads = CMDB_SCC_THREADS;
+  if ( threads == 0 ) threads = boost::thread::hardware_concurrency ();
+  if ( G . num_vertices () <= 10000 ) threads = 1;
+  return threads;
+}
+
 inline void 
 computeMorseSetsAndReachability (std::vector< boost::shared_ptr<Grid> > * output,
                                  std::vector<std::vector<unsigned int> > * reach,
                                  boost::shared_ptr<const Grid> G,
                                  boost::shared_ptr<const Map> f ) {
   MapGraph mapgraph ( G, f );
+#ifndef NO_ADJACENCY_STORE
+  // Record adjacency lists during the SCC pass so reachability need not
+  // re-evaluate the map. (See CMDB_ADJACENCY_STORE_MEMORY in GraphTheory.h)
+#ifdef CMDB_ADJACENCY_STORE_SPILL
+  mapgraph . storeAdjacencies ( CMDB_ADJACENCY_STORE_MEMORY, true );
+#else
+  mapgraph . storeAdjacencies ( CMDB_ADJACENCY_STORE_MEMORY, false );
+#endif
+  // Optionally construct the adjacency lists up front in parallel
+  // (or, for maps with batch evaluation, in batches)
+  int graph_threads = CMDB_GRAPH_THREADS;
+  if ( graph_threads == 0 ) graph_threads = boost::thread::hardware_concurrency ();
+  // (unless the SCC pass computes them in parallel itself)
+  if ( ( graph_threads > 1 || f -> hasBatchEvaluation () ) && 
+       mapgraph . num_vertices () > 10000 &&
+       strongComponentsThreads ( mapgraph ) <= 1 ) {
+    mapgraph . computeAdjacencies ( graph_threads );
+  }
+#endif
   // Produce Strong Components and Reachability
   std::vector < std::deque < Grid::GridElement > > components;
+#ifdef CMDB_EXTERNAL_SCC_STACKS
+  ExternalStack < Grid::size_type > topological_sort;
+#else
   std::deque < Grid::size_type > topological_sort;
+#endif
   computeStrongComponents ( &components, mapgraph, &topological_sort );
 #ifdef CMG_VERBOSE
   if ( components . size () > 1 ) {
@@ -40,6 +79,13 @@ computeMorseSetsAndReachability (std::vector< boost::shared_ptr<Grid> > * output
 #endif
 #ifndef NO_REACHABILITY
   computeReachability ( reach, components, mapgraph, topological_sort );
+#ifdef CMG_VERBOSE
+  if ( mapgraph . evaluationsSaved () > 0 ) {
+    std::cout << "Adjacency store: " << mapgraph . evaluations () 
+              << " map evaluations, " << mapgraph . evaluationsSaved () 
+              << " saved.\n";
+  }
+#endif
 #endif
   // Create output grids
   output -> clear ();
@@ -56,12 +102,17 @@ computeMorseSetsAndReachability (std::vector< boost::shared_ptr<Grid> > * output
 /// comments: the interface results in some inefficiency. It would be nice to change
 ///           it. In particular the way SCC_root requires it to be written in random
 ///           order which is not ideal.
-template < class Graph >
+template < class Graph, class VertexSequence >
 void computeStrongComponents (std::vector<std::deque<typename Graph::Vertex> > * output,
                               const Graph & G,
-         /* optional output */std::deque<typename Graph::Vertex> * topological_sort,
+         /* optional output */VertexSequence * topological_sort,
          /* optional output */std::deque<typename Graph::Vertex> * SCC_root ) {
   typedef typename Graph::Vertex Vertex;
+  int scc_threads = strongComponentsThreads ( G );
+  if ( scc_threads > 1 ) {
+    computeStrongComponentsParallel ( output, G, scc_threads, topological_sort, SCC_root );
+    return;
+  }
 #ifdef CMG_VERBOSE
   int64_t progress = 0;
   int64_t progresspercent = 0;
@@ -76,8 +127,13 @@ void computeStrongComponents (std::vector<std::deque<typename Graph::Vertex> > *
   std::vector<bool> duplicates ( N, false );
   std::vector<bool> self_connected (N, false);
   std::vector<int64_t> preorder ( N, 0 );
+#ifdef CMDB_EXTERNAL_SCC_STACKS
+  ExternalStack<int64_t> LOWLINK, DFS, cleanDFS;
+  ExternalStack<Vertex> S;
+#else
   std::deque<int64_t> LOWLINK, DFS, cleanDFS;
   std::deque<Vertex> S;
+#endif
   if ( SCC_root != NULL ) {
     SCC_root -> resize ( N );
   }
@@ -132,6 +188,8 @@ void computeStrongComponents (std::vector<std::deque<typename Graph::Vertex> > *
               } else {
                 DFS . push_back ( w + 1 );
                 if ( (int64_t) DFS . size () > 2L*N ) { 
+                  // Keep the topmost entry of each vertex. (Only stack
+                  // operations, so this works for external stacks too.)
                   duplicates . assign ( N, false );
                   while ( not DFS . empty () ) {
                     int64_t x = DFS . back ();
@@ -139,9 +197,12 @@ void computeStrongComponents (std::vector<std::deque<typename Graph::Vertex> > *
                     int64_t y = std::abs(x) - 1;
                     if ( duplicates [ y ] ) continue;
                     duplicates [ y ] = true;
-                    cleanDFS . push_front ( x );
+                    cleanDFS . push_back ( x );
+                  }
+                  while ( not cleanDFS . empty () ) {
+                    DFS . push_back ( cleanDFS . back () );
+                    cleanDFS . pop_back ();
                   }
-                  std::swap ( DFS, cleanDFS );
                 }
               }
             }
@@ -193,120 +254,467 @@ void computeStrongComponents (std::vector<std::deque<typename Graph::Vertex> > *
 #endif
 }
 
-/// computeReachability 
+/// concurrentAdjacencies, adjacencyBlock, recordAdjacencies
+///   How computeStrongComponentsParallel reads a graph. A generic graph is
+///   read through G . adjacencies by one thread. A MapGraph computes blocks
+///   of adjacency lists on several threads, and the lists are recorded in
+///   its adjacency store (if enabled) for the reachability pass.
 template < class Graph >
-void computeReachability ( std::vector < std::vector < unsigned int > > * output,
-                           std::vector<std::deque<typename Graph::size_type> > & morse_sets,
-                           const Graph & G, 
-                           const std::deque<typename Graph::size_type> & topological_sort ) {
-  typedef typename Graph::size_type size_type;
+bool concurrentAdjacencies ( const Graph & G ) {
+  return false;
+}
+
+inline bool
+concurrentAdjacencies ( const MapGraph & G ) {
+  return true;
+}
+
+template < class Graph >
+void adjacencyBlock ( const Graph & G,
+                      typename Graph::Vertex begin, typename Graph::Vertex end,
+                      std::vector < uint64_t > * offsets,
+                      std::vector < typename Graph::Vertex > * targets ) {
+  offsets -> assign ( 1, 0 );
+  targets -> clear ();
+  for ( typename Graph::Vertex v = begin; v < end; ++ v ) {
+    std::vector < typename Graph::Vertex > W = G . adjacencies ( v );
+    targets -> insert ( targets -> end (), W . begin (), W . end () );
+    offsets -> push_back ( targets -> size () );
+  }
+}
+
+inline void
+adjacencyBlock ( const MapGraph & G, MapGraph::Vertex begin, MapGraph::Vertex end,
+                 std::vector < uint64_t > * offsets,
+                 std::vector < MapGraph::Vertex > * targets ) {
+  G . adjacencyBlock ( begin, end, offsets, targets );
+}
+
+template < class Graph, class InputIterator >
+void recordAdjacencies ( const Graph & G, typename Graph::Vertex v,
+                         InputIterator first, InputIterator last ) {
+}
+
+template < class InputIterator >
+void recordAdjacencies ( const MapGraph & G, MapGraph::Vertex v,
+                         InputIterator first, InputIterator last ) {
+  G . recordAdjacencies ( v, first, last );
+}
+
+/// computeStrongComponentsOverCore
+///   computeStrongComponentsParallel, with vertex indices of type Index
+template < class Index, class Graph, class VertexSequence >
+void computeStrongComponentsOverCore (std::vector<std::deque<typename Graph::Vertex> > * output,
+                                      const Graph & G,
+                                      int num_threads,
+                                      VertexSequence * topological_sort,
+                                      std::deque<typename Graph::Vertex> * SCC_root ) {
+  typedef typename Graph::Vertex Vertex;
+  const uint64_t N = G . num_vertices ();
+  // Read the graph into CSR arrays, counting in-degrees. Blocks of
+  // vertices are computed in parallel a round at a time, and each round
+  // is appended in vertex order (as in MapGraph::computeAdjacencies).
+  std::vector < uint64_t > begin ( N + 1, 0 );
+  std::vector < Index > targets;
+  std::vector < Index > in_degree ( N, 0 );
+  std::vector < bool > self_connected ( N, false );
+  {
+    int threads = concurrentAdjacencies ( G ) ? num_threads : 1;
+    const uint64_t block_size = 1024;
+    const uint64_t blocks_per_round = 16 * (uint64_t) threads;
+    std::vector < std::vector < uint64_t > > offsets ( blocks_per_round );
+    std::vector < std::vector < Vertex > > lists ( blocks_per_round );
+    for ( uint64_t round_begin = 0; round_begin < N;
+          round_begin += block_size * blocks_per_round ) {
+      uint64_t num_blocks = std::min ( blocks_per_round,
+        ( N - round_begin + block_size - 1 ) / block_size );
+      parallelFor ( threads, num_blocks, [&] ( uint64_t b ) {
+        Vertex first = round_begin + b * block_size;
+        Vertex last = std::min ( first + block_size, N );
+        adjacencyBlock ( G, first, last, &offsets [ b ], &lists [ b ] );
+      } );
+      for ( uint64_t b = 0; b < num_blocks; ++ b ) {
+        Vertex first = round_begin + b * block_size;
+        const std::vector<uint64_t> & off = offsets [ b ];
+        const std::vector<Vertex> & list = lists [ b ];
+        for ( uint64_t i = 0; i + 1 < off . size (); ++ i ) {
+          Vertex v = first + i;
+          for ( uint64_t e = off [ i ]; e < off [ i + 1 ]; ++ e ) {
+            Vertex w = list [ e ];
+            if ( w == v ) self_connected [ v ] = true;
+            ++ in_degree [ w ];
+            targets . push_back ( (Index) w );
+          }
+          begin [ v + 1 ] = targets . size ();
+          recordAdjacencies ( G, v, list . begin () + off [ i ], list . begin () + off [ i + 1 ] );
+        }
+      }
+    }
+    targets . shrink_to_fit ();
+  }
+#ifdef MEMORYBOOKKEEPING
+  graph_memory = sizeof ( uint64_t ) * begin . size () + sizeof ( Index ) * targets . size ();
+  max_graph_memory = std::max ( max_graph_memory, graph_memory );
+#endif
+
+  // Trim, in parallel, the vertices which are reachable from no cycle
+  // (Kahn's algorithm: a vertex is removed once all its predecessors
+  // are). They are trivial strong components, listed in "trimmed" in
+  // topological order. Since every predecessor of a trimmed vertex is
+  // trimmed, the rest of the graph (the core) has no edges to them.
+  std::vector < Index > trimmed;
+  for ( uint64_t v = 0; v < N; ++ v ) {
+    if ( in_degree [ v ] == 0 ) trimmed . push_back ( (Index) v );
+  }
+  const uint64_t chunk = 4096;
+  uint64_t layer_begin = 0;
+  while ( layer_begin < trimmed . size () ) {
+    uint64_t layer_end = trimmed . size ();
+    uint64_t chunks = ( layer_end - layer_begin + chunk - 1 ) / chunk;
+    std::vector < std::vector < Index > > next ( chunks );
+    parallelFor ( num_threads, chunks, [&] ( uint64_t c ) {
+      uint64_t first = layer_begin + c * chunk;
+      uint64_t last = std::min ( first + chunk, layer_end );
+      for ( uint64_t i = first; i < last; ++ i ) {
+        Index u = trimmed [ i ];
+        for ( uint64_t e = begin [ u ]; e < begin [ u + 1 ]; ++ e ) {
+          Index w = targets [ e ];
+          if ( __atomic_sub_fetch ( &in_degree [ w ], 1, __ATOMIC_RELAXED ) == 0 ) {
+            next [ c ] . push_back ( w );
+          }
+        }
+      }
+    } );
+    BOOST_FOREACH ( const std::vector<Index> & vertices, next ) {
+      trimmed . insert ( trimmed . end (), vertices . begin (), vertices . end () );
+    }
+    layer_begin = layer_end;
+  }
+
+  // Tarjan's algorithm on the core (the vertices with positive in-degree
+  // left). The components complete in reverse topological order.
+  const Index UNVISITED = std::numeric_limits<Index>::max ();
+  std::vector < Index > preorder ( N, UNVISITED );
+  std::vector < Index > lowlink ( N, 0 );
+  std::vector < bool > committed ( N, false );
+  std::vector < std::pair < Index, uint64_t > > DFS; // vertex, next edge
+  std::vector < Index > S;
+  Index n = 0;
+  for ( uint64_t root = 0; root < N; ++ root ) {
+    if ( in_degree [ root ] == 0 || preorder [ root ] != UNVISITED ) continue;
+    preorder [ root ] = lowlink [ root ] = n ++;
+    S . push_back ( (Index) root );
+    DFS . push_back ( std::make_pair ( (Index) root, begin [ root ] ) );
+    while ( not DFS . empty () ) {
+      Index u = DFS . back () . first;
+      uint64_t & e = DFS . back () . second;
+      if ( e < begin [ u + 1 ] ) {
+        Index w = targets [ e ++ ];
+        if ( preorder [ w ] == UNVISITED ) {
+          preorder [ w ] = lowlink [ w ] = n ++;
+          S . push_back ( w );
+          DFS . push_back ( std::make_pair ( w, begin [ w ] ) );
+        } else if ( not committed [ w ] ) {
+          lowlink [ u ] = std::min ( lowlink [ u ], preorder [ w ] );
+        }
+        continue;
+      }
+      // POSTORDER
+      DFS . pop_back ();
+      if ( not DFS . empty () ) {
+        Index parent = DFS . back () . first;
+        lowlink [ parent ] = std::min ( lowlink [ parent ], lowlink [ u ] );
+      }
+      if ( lowlink [ u ] != preorder [ u ] ) continue;
+      output -> push_back ( std::deque<Vertex> () );
+      std::deque<Vertex> & SCC = output -> back ();
+      Index w;
+      do {
+        w = S . back ();
+        S . pop_back ();
+        SCC . push_back ( (Vertex) w );
+        committed [ w ] = true;
+        if ( topological_sort != NULL ) topological_sort -> push_back ( w );
+        if ( SCC_root != NULL ) (*SCC_root) [ w ] = (Vertex) u;
+      } while ( w != u );
+      // Only SCPCs:
+      if ( SCC . size () == 1 && not self_connected [ u ] ) output -> pop_back ();
+    }
+  }
+#ifdef MEMORYBOOKKEEPING
+  max_scc_memory_internal = std::max ( max_scc_memory_internal, (uint64_t)
+    ( sizeof ( uint64_t ) * begin . size () + sizeof ( Index ) * ( 4 * N + targets . size () ) ) );
+#endif
 #ifdef CMG_VERBOSE
-  std::cout << "Computing Reachability Information.\n";
-  std::cout . flush ();
-  size_type progress = 0;
-  size_type progresspercent = 0;
+  std::cout << "computeStrongComponents. V = " << N << " E = " << targets . size ()
+            << "  E/V = " << (double) targets . size () / (double) N
+            << " (" << num_threads << " threads, " << trimmed . size () << " trimmed)\n";
 #endif
-  /* Count the Morse Sets */
-  uint64_t effort = 0;
-  size_type number_of_morse_sets = morse_sets . size ();  
-  if ( number_of_morse_sets == 0 ) return; // trivial case
-  output -> resize ( number_of_morse_sets );
-  // Paint the Morse Sets
-  // For each morse set, go through its vertices and 
-  // color them according to which morse set they are in.
-  // Vertices not in a morse set are colored "number_of_morse_sets"
+  // The trimmed vertices precede the core topologically
+  for ( int64_t i = (int64_t) trimmed . size () - 1; i >= 0; -- i ) {
+    Index v = trimmed [ i ];
+    if ( topological_sort != NULL ) topological_sort -> push_back ( v );
+    if ( SCC_root != NULL ) (*SCC_root) [ v ] = (Vertex) v;
+  }
+}
+
+/// computeStrongComponentsParallel
+template < class Graph, class VertexSequence >
+void computeStrongComponentsParallel (std::vector<std::deque<typename Graph::Vertex> > * output,
+                                      const Graph & G,
+                                      int num_threads,
+         /* optional output */VertexSequence * topological_sort,
+         /* optional output */std::deque<typename Graph::Vertex> * SCC_root ) {
+  if ( SCC_root != NULL ) {
+    SCC_root -> resize ( G . num_vertices () );
+  }
+  if ( G . num_vertices () < (uint64_t) std::numeric_limits<uint32_t>::max () ) {
+    computeStrongComponentsOverCore<uint32_t> ( output, G, num_threads, topological_sort, SCC_root );
+  } else {
+    computeStrongComponentsOverCore<uint64_t> ( output, G, num_threads, topological_sort, SCC_root );
+  }
+}
+
+/// condenseForReachability
+///   Condensation of G used by computeReachability. Every Morse set becomes
+///   one node and every transient vertex (one in no Morse set) its own
+///   node, numbered in topological order. Since the Morse sets are all
+///   the strong components with cycles, this is the condensation of G.
+///   One sweep of the adjacency lists in topological order keeps only the
+///   nodes reachable from a Morse set (others are not asked for their
+///   adjacency lists at all); a backward sweep over the result then drops
+///   the nodes from which no Morse set is reachable. Neither kind can
+///   carry reachability between Morse sets.
+///   Output: the kept nodes renumbered 0, 1, ... in topological order,
+///   with the targets of node v in (*targets) [ (*begin) [ v ] ] to
+///   (*targets) [ (*begin) [ v + 1 ] - 1 ] (CSR layout), and the node of
+///   Morse set s in (*set_node) [ s ].
+template < class Index, class Graph, class VertexSequence >
+void condenseForReachability ( std::vector < uint64_t > * begin,
+                               std::vector < Index > * targets,
+                               std::vector < Index > * set_node,
+                               const std::vector<std::deque<typename Graph::size_type> > & morse_sets,
+                               const Graph & G,
+                               const VertexSequence & topological_sort ) {
+  typedef typename Graph::size_type size_type;
+  const size_type number_of_morse_sets = morse_sets . size ();
+  const int64_t T = topological_sort . size ();
+  // Paint the Morse Sets. Vertices not in a morse set are colored
+  // "number_of_morse_sets"
   std::vector < size_type > morse_paint ( G . num_vertices (), number_of_morse_sets );
   for ( size_type count = 0; count < number_of_morse_sets; ++ count ) {
     BOOST_FOREACH ( size_type v, morse_sets [ count ] ) {
-      ++ effort; 
       morse_paint [ v ] = count;
-    } 
-  } 
+    }
+  }
+  // Number the nodes. Going through topological_sort backwards visits
+  // sources first, and the vertices of each Morse set consecutively.
+  std::vector < Index > node_of ( G . num_vertices () );
+  set_node -> assign ( number_of_morse_sets, 0 );
+  Index nodes = 0;
+  for ( int64_t vi = T - 1; vi >= 0; -- vi ) {
+    size_type v = topological_sort [ vi ];
+    size_type paint = morse_paint [ v ];
+    if ( paint == number_of_morse_sets ) {
+      node_of [ v ] = nodes ++;
+      continue;
+    }
+    if ( vi == T - 1 || morse_paint [ topological_sort [ vi + 1 ] ] != paint ) {
+      (*set_node) [ paint ] = nodes ++;
+    }
+    node_of [ v ] = (*set_node) [ paint ];
+  }
+  std::vector < bool > is_morse ( nodes, false );
+  BOOST_FOREACH ( Index node, *set_node ) is_morse [ node ] = true;
 
-  // Break the Morse Sets up into Computational Groups of 64 and proceed 
-  size_type groups = ( (number_of_morse_sets - 1) / 64 ) + 1;
-  
-#ifdef CMG_VERBOSE
-  size_type total_work_to_do = topological_sort . size () * groups;
-#endif
-  // We use a vector called morse_code. It's function is to maintain
-  // information about which morse sets can reach a given vertex.
-  // By processing in topological order, it is possible to give morse_code
-  // the correct values in a single pass.
-  std::vector < uint64_t > morse_code;
-  // We use a vector called condensed_code in order to store the final information
-  // about which morse sets can reach a given morse set. It can be inferred from morse_code
-  // during the same sweep in which we construct morse_code.
-  std::vector < uint64_t > condensed_code;
-  // Loop through groups.
-  for ( size_type group_number = 0; group_number < groups; ++ group_number ) {
-    ++ effort;
-    size_type group_size = std::min((size_type) 64, 
-          (size_type) number_of_morse_sets - ((size_type)64) * group_number);
-    size_type offset = 64L * group_number;
-    morse_code . clear ();
-    morse_code . resize ( G . num_vertices (), 0 );
-    condensed_code . clear ();
-    condensed_code . resize ( number_of_morse_sets + 1, 0 );
+  // Forward sweep: rows for the nodes reachable from a Morse set
+  std::vector < bool > reached ( nodes, false );
+  std::vector < Index > row_node;
+  begin -> clear ();
+  targets -> clear ();
+  for ( int64_t vi = T - 1; vi >= 0; -- vi ) {
+    size_type v = topological_sort [ vi ];
+    Index node = node_of [ v ];
+    if ( not is_morse [ node ] && not reached [ node ] ) continue;
+    if ( row_node . empty () || row_node . back () != node ) {
+      if ( not row_node . empty () ) {
+        // Remove the duplicate edges of the finished row
+        typename std::vector<Index>::iterator first = targets -> begin () + begin -> back ();
+        std::sort ( first, targets -> end () );
+        targets -> erase ( std::unique ( first, targets -> end () ), targets -> end () );
+      }
+      row_node . push_back ( node );
+      begin -> push_back ( targets -> size () );
+    }
+    std::vector < size_type > children = G . adjacencies ( v );
+    BOOST_FOREACH ( size_type w, children ) {
+      Index target = node_of [ w ];
+      if ( target == node ) continue;
+      reached [ target ] = true;
+      targets -> push_back ( target );
+    }
+  }
+  if ( not row_node . empty () ) {
+    typename std::vector<Index>::iterator first = targets -> begin () + begin -> back ();
+    std::sort ( first, targets -> end () );
+    targets -> erase ( std::unique ( first, targets -> end () ), targets -> end () );
+  }
+  begin -> push_back ( targets -> size () );
+  std::vector < Index > () . swap ( node_of );
+  std::vector < size_type > () . swap ( morse_paint );
 
-    // Paint the codes.
-    // We do an initial sweep painting the sources onto their sets. 
-    for ( size_type count = 0; count < group_size; ++ count ) {
-      size_type set_number = offset + count;
-      uint64_t code = ((uint64_t)1) << count;
-      ++ effort;    
-      BOOST_FOREACH ( size_type v, morse_sets [ set_number ] ) {
-        ++ effort;
-        morse_code [ v ] = code;
-      } 
-    } 
+  // Backward sweep: keep the nodes from which a Morse set is reachable
+  // (recorded in "reached", which is no longer needed)
+  std::vector < bool > & useful = reached;
+  const int64_t rows = row_node . size ();
+  for ( int64_t r = rows - 1; r >= 0; -- r ) {
+    Index node = row_node [ r ];
+    bool reaches = is_morse [ node ];
+    for ( uint64_t e = (*begin) [ r ]; not reaches && e < (*begin) [ r + 1 ]; ++ e ) {
+      reaches = useful [ (*targets) [ e ] ];
+    }
+    useful [ node ] = reaches;
+  }
 
-    // Loop through topological sort.
-    // Our goal is to produce "condensed_code", which we can read the info off from.
-    // The intermediate information is stored in "morse_code"
-    for ( int64_t vi = topological_sort . size () - 1; vi >= 0; -- vi ) {
-#ifdef CMG_VERBOSE
-      ++ progress;
-      if ( (100*progress)/total_work_to_do > progresspercent) {
-        progresspercent = (100*progress)/total_work_to_do;
-        std::cout << "\r" << progresspercent << "%    ";
-        std::cout . flush ();
-      }
-#endif
-      size_type v = topological_sort [ vi ];
-      std::vector < size_type > children = G . adjacencies ( v ); // previously const &
-      if ( morse_paint [ v ] != number_of_morse_sets ) {
-        morse_code [ v ] |= condensed_code [ morse_paint [ v ] ];
-      }
-      BOOST_FOREACH ( size_type w, children ) {
-        ++ effort;
-        morse_code [ w ] |= morse_code [ v ];
-        condensed_code [ morse_paint [ w ] ] |= morse_code [ v ];
+  // Renumber the kept nodes and compact the rows in place
+  std::vector < Index > compact_of ( nodes );
+  Index kept = 0;
+  uint64_t edges = 0;
+  for ( int64_t r = 0; r < rows; ++ r ) {
+    Index node = row_node [ r ];
+    uint64_t row_begin = (*begin) [ r ];
+    uint64_t row_end = (*begin) [ r + 1 ];
+    if ( not useful [ node ] ) continue;
+    compact_of [ node ] = kept;
+    (*begin) [ kept ++ ] = edges;
+    for ( uint64_t e = row_begin; e < row_end; ++ e ) {
+      Index target = (*targets) [ e ];
+      // targets follow their sources, so are renumbered below
+      if ( useful [ target ] ) (*targets) [ edges ++ ] = target;
+    }
+  }
+  begin -> resize ( kept + 1 );
+  (*begin) [ kept ] = edges;
+  targets -> resize ( edges );
+  for ( uint64_t e = 0; e < edges; ++ e ) {
+    (*targets) [ e ] = compact_of [ (*targets) [ e ] ];
+  }
+  BOOST_FOREACH ( Index & node, *set_node ) node = compact_of [ node ];
+  begin -> shrink_to_fit ();
+  targets -> shrink_to_fit ();
+}
 
+/// propagateReachability
+///   One pass of computeReachability: append to (*output) [ s ], for the
+///   Morse sets first <= s < last, the Morse sets reachable from s.
+///   Each node of the condensation carries a bitset of Words 64-bit words
+///   (bit s - first: Morse set s reaches the node), ORed into its targets
+///   in topological order. The fixed length loops over Words compile to
+///   256-bit or 512-bit vector operations where the target has them.
+template < class Index, int Words >
+void propagateReachability ( std::vector < std::vector < unsigned int > > * output,
+                             const std::vector < uint64_t > & begin,
+                             const std::vector < Index > & targets,
+                             const std::vector < Index > & set_node,
+                             uint64_t first, uint64_t last ) {
+  const uint64_t nodes = begin . size () - 1;
+  std::vector < uint64_t > code ( nodes * Words, 0 );
+  for ( uint64_t s = first; s < last; ++ s ) {
+    uint64_t bit = s - first;
+    code [ (uint64_t) set_node [ s ] * Words + bit / 64 ] |= ((uint64_t)1) << ( bit % 64 );
+  }
+  for ( uint64_t v = 0; v < nodes; ++ v ) {
+    uint64_t source [ Words ];
+    uint64_t any = 0;
+    for ( int k = 0; k < Words; ++ k ) {
+      source [ k ] = code [ v * Words + k ];
+      any |= source [ k ];
+    }
+    if ( any == 0 ) continue;
+    for ( uint64_t e = begin [ v ]; e < begin [ v + 1 ]; ++ e ) {
+      uint64_t * target = & code [ (uint64_t) targets [ e ] * Words ];
+      for ( int k = 0; k < Words; ++ k ) target [ k ] |= source [ k ];
+    }
+  }
+  // Read off the reachability information, by target in increasing order
+  for ( uint64_t t = 0; t < set_node . size (); ++ t ) {
+    const uint64_t * reached_by = & code [ (uint64_t) set_node [ t ] * Words ];
+    for ( int k = 0; k < Words; ++ k ) {
+      uint64_t word = reached_by [ k ];
+      while ( word ) {
+        uint64_t s = first + 64 * k + __builtin_ctzll ( word );
+        (*output) [ s ] . push_back ( t );
+        word &= word - 1;
       }
-    } 
+    }
+  }
+}
+
+/// computeReachabilityOverCondensation
+///   computeReachability, with node indices of type Index
+template < class Index, class Graph, class VertexSequence >
+void computeReachabilityOverCondensation ( std::vector < std::vector < unsigned int > > * output,
+                                           const std::vector<std::deque<typename Graph::size_type> > & morse_sets,
+                                           const Graph & G,
+                                           const VertexSequence & topological_sort ) {
+  std::vector < uint64_t > begin;
+  std::vector < Index > targets;
+  std::vector < Index > set_node;
+  condenseForReachability ( &begin, &targets, &set_node, morse_sets, G, topological_sort );
+  const uint64_t nodes = begin . size () - 1;
+  const uint64_t number_of_morse_sets = morse_sets . size ();
+  // Widest bitsets needed (at most CMDB_REACHABILITY_WORDS words) which
+  // fit in CMDB_REACHABILITY_MEMORY
+  uint64_t needed = ( number_of_morse_sets + 63 ) / 64;
+  int words = 1;
+  while ( words < CMDB_REACHABILITY_WORDS && (uint64_t) words < needed ) words *= 2;
+  while ( words > 1 && nodes * words * sizeof ( uint64_t ) > CMDB_REACHABILITY_MEMORY ) words /= 2;
+#ifdef MEMORYBOOKKEEPING
+  max_reach_memory = std::max ( max_reach_memory, (uint64_t)
+    ( sizeof ( uint64_t ) * ( begin . size () + nodes * words ) +
+      sizeof ( Index ) * ( targets . size () + set_node . size () ) ) );
+#endif
 #ifdef CMG_VERBOSE
-    ++ progress;
+  std::cout << "Reachability: condensation has " << nodes << " nodes and "
+            << targets . size () << " edges; " << 64 * words << "-bit codes.\n";
 #endif
+  const uint64_t bits = 64 * words;
+  for ( uint64_t first = 0; first < number_of_morse_sets; first += bits ) {
+    uint64_t last = std::min ( number_of_morse_sets, first + bits );
+    switch ( words ) {
+      case 1: propagateReachability<Index,1> ( output, begin, targets, set_node, first, last ); break;
+      case 2: propagateReachability<Index,2> ( output, begin, targets, set_node, first, last ); break;
+      case 4: propagateReachability<Index,4> ( output, begin, targets, set_node, first, last ); break;
+      default: propagateReachability<Index,8> ( output, begin, targets, set_node, first, last ); break;
+    }
+  }
+}
 
-    // Note: Now condensed_code is indexed by targets, 
-    //       and contains the sources reaching it.    
-    // Loop through Morse Sets to learn reachability information
-    for ( size_type count = 0; count < number_of_morse_sets; ++ count ) {
-      // Read condensed code to determine which of the group reached this morse set
-      ++ effort;
-      uint64_t bit = 1;
-      for ( int i = 0; i < 64; ++ i ) {
-        ++ effort;     
-        if ( condensed_code [ count ] & bit ) {
-          ++ effort;
-          (*output)[offset + i] . push_back ( count );
-        } // if
-        bit <<= 1;
-      } // for bit index
-    } // for morse set
-  } // for groups
+/// computeReachability
+///   (*output) [ s ] lists, in increasing order, the Morse sets reachable
+///   from Morse set s (including s).
+///   The adjacency lists are swept once, to build the condensation of
+///   the graph restricted to what lies between Morse sets (see
+///   condenseForReachability); reachability is then propagated over the
+///   condensation, 64 * CMDB_REACHABILITY_WORDS Morse sets per pass.
+template < class Graph, class VertexSequence >
+void computeReachability ( std::vector < std::vector < unsigned int > > * output,
+                           std::vector<std::deque<typename Graph::size_type> > & morse_sets,
+                           const Graph & G, 
+                           const VertexSequence & topological_sort ) {
+#ifdef CMG_VERBOSE
+  std::cout << "Computing Reachability Information.\n";
+  std::cout . flush ();
+#endif
+  uint64_t number_of_morse_sets = morse_sets . size ();
+  if ( number_of_morse_sets == 0 ) return; // trivial case
+  output -> resize ( number_of_morse_sets );
+  if ( G . num_vertices () < (uint64_t) std::numeric_limits<uint32_t>::max () ) {
+    computeReachabilityOverCondensation<uint32_t> ( output, morse_sets, G, topological_sort );
+  } else {
+    computeReachabilityOverCondensation<uint64_t> ( output, morse_sets, G, topological_sort );
+  }
 #ifdef CMG_VERBOSE
-  std::cout << "\r100%  Reachability Analysis Complete.\n ";
+  std::cout << "Reachability Analysis Complete.\n";
 #endif
 }
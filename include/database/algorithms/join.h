@@ -5,6 +5,7 @@
 #include <exception>
 #include "database/structures/TreeGrid.h"
 #include "database/structures/Atlas.h"
+#include "database/structures/StateGrid.h"
 
 template < class GridType, class InputIterator>
 void join ( boost::shared_ptr<GridType> output, 
@@ -29,6 +30,10 @@ struct joinImpl {
 			   boost::dynamic_pointer_cast<Atlas> ( output ) ) {
 			return joinImpl<Atlas,InputIterator>::act ( ptr, start, stop );
 		}
+		if ( boost::shared_ptr<StateGrid> ptr = 
+			   boost::dynamic_pointer_cast<StateGrid> ( output ) ) {
+			return joinImpl<StateGrid,InputIterator>::act ( ptr, start, stop );
+		}
 		throw std::logic_error ( "Error: joinImpl specialization not "
 			                       " written for this Grid class.\n" );
 	} 
@@ -100,4 +105,30 @@ struct joinImpl < Atlas, InputIterator > {
 		output -> finalize ();
 	} 
 };
+
+template < class InputIterator >
+struct joinImpl < StateGrid, InputIterator > { 
+	static void act ( boost::shared_ptr<StateGrid> output, 
+	    						  InputIterator start, 
+	    						  InputIterator stop ) { 
+		// Union of the states of the StateGrids
+		std::vector < uint64_t > states;
+		uint64_t num_states = 0;
+		for ( InputIterator it = start; it != stop; ++ it ) {
+			boost::shared_ptr<StateGrid> it_ptr = 
+				boost::dynamic_pointer_cast<StateGrid> ( *it );
+			if ( not it_ptr ) {
+				throw std::logic_error ( "StateGrid::join error: not looping through a container "
+			                       		 " of boost::shared_ptr<StateGrid>.\n" );
+			}
+			num_states = it_ptr -> numStates ();
+			for ( Grid::GridElement ge = 0; ge < it_ptr -> size (); ++ ge ) {
+				states . push_back ( it_ptr -> state ( ge ) );
+			}
+		}
+		std::sort ( states . begin (), states . end () );
+		states . erase ( std::unique ( states . begin (), states . end () ), states . end () );
+		output -> assign ( num_states, states );
+	} 
+};
 #endif
@@ -0,0 +1,45 @@
+// parallelFor.h
+
+#ifndef CMDB_PARALLELFOR_H
+#define CMDB_PARALLELFOR_H
+
+#include <stdint.h>
+#include <atomic>
+#include <exception>
+#include "boost/thread.hpp"
+
+/// parallelFor
+///   Call work ( i ) for i = 0, 1, ..., count - 1 on num_threads threads,
+///   handing out the indices in increasing order. The first exception
+///   thrown by work is rethrown once all threads have stopped.
+template < class Work >
+void parallelFor ( int num_threads, uint64_t count, const Work & work ) {
+  if ( num_threads <= 1 || count <= 1 ) {
+    for ( uint64_t i = 0; i < count; ++ i ) work ( i );
+    return;
+  }
+  std::atomic<uint64_t> next ( 0 );
+  std::exception_ptr error;
+  boost::mutex error_mutex;
+  boost::thread_group workers;
+  for ( int t = 0; t < num_threads; ++ t ) {
+    workers . create_thread ( [&] () {
+      while ( 1 ) {
+        uint64_t i = next ++;
+        if ( i >= count ) return;
+        try {
+          work ( i );
+        } catch ( ... ) {
+          boost::mutex::scoped_lock lock ( error_mutex );
+          if ( not error ) error = std::current_exception ();
+          next = count;
+          return;
+        }
+      }
+    } );
+  }
+  workers . join_all ();
+  if ( error ) std::rethrow_exception ( error );
+}
+
+#endif
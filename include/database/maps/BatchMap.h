@@ -0,0 +1,34 @@
+#ifndef CMDB_BATCHMAP_H
+#define CMDB_BATCHMAP_H
+
+#include "database/maps/Map.h"
+#include "database/structures/RectGeo.h"
+#include "database/structures/BoxBatch.h"
+
+/// BatchMap
+///   Adapter giving a model map with a member
+///     RectGeo operator () ( const RectGeo & ) const
+///   a batch evaluation which calls it directly, skipping the shared_ptr
+///   allocation and dynamic_cast of Map::operator () for every box.
+///   Usage in Model.h:  new BatchMap<ModelMap> ( p )
+template < class ModelMapType >
+class BatchMap : public ModelMapType {
+public:
+  using ModelMapType::ModelMapType;
+  using ModelMapType::operator ();
+
+  virtual void evaluate ( const BoxBatch & input, BoxBatch * output ) const {
+    RectGeo box ( input . dimension () );
+    for ( uint64_t i = 0; i < input . size (); ++ i ) {
+      input . get ( i, &box );
+      RectGeo image = ModelMapType::operator () ( box );
+      if ( i == 0 ) output -> resize ( image . dimension (), input . size () );
+      output -> set ( i, image );
+    }
+    if ( input . size () == 0 ) output -> resize ( input . dimension (), 0 );
+  }
+
+  virtual bool hasBatchEvaluation ( void ) const { return true; }
+};
+
+#endif
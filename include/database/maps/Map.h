@@ -1,14 +1,73 @@
 #ifndef CMDB_MAP_H
 #define CMDB_MAP_H
 
+#include <stdint.h>
+#include <vector>
+#include <exception>
+#include <stdexcept>
 #include "boost/shared_ptr.hpp"
 #include "database/structures/Geo.h"
+#include "database/structures/RectGeo.h"
+#include "database/structures/BoxBatch.h"
+#include "database/structures/Grid.h"
 
 class Map {
 public:
   virtual ~Map ( void ) {}
   virtual boost::shared_ptr<Geo> operator () ( boost::shared_ptr<Geo> geo ) const = 0;
+
+  /// evaluate
+  ///   Batch evaluation: box i of *output is set to the image of box i of
+  ///   input. *output is resized as needed (keeping its storage).
+  ///   The default evaluates one box at a time with operator (), which
+  ///   must then return a RectGeo.
+  virtual void evaluate ( const BoxBatch & input, BoxBatch * output ) const;
+
+  /// hasBatchEvaluation
+  ///   Return true if the map is meant to be evaluated with evaluate.
+  ///   Maps whose images are not boxes (e.g. UnionGeo) return false.
+  virtual bool hasBatchEvaluation ( void ) const { return false; }
+
+  /// adjacencies
+  ///   Combinatorial evaluation, for maps that give the images of grid
+  ///   elements directly rather than of their geometry: for each element
+  ///   v from begin to end-1 of grid, append the elements its image meets
+  ///   to *targets, then push targets -> size () onto *offsets.
+  ///   Must be safe to call concurrently. The default throws.
+  virtual void adjacencies ( const Grid & grid,
+                             Grid::GridElement begin, Grid::GridElement end,
+                             std::vector<uint64_t> * offsets,
+                             std::vector<Grid::GridElement> * targets ) const;
+
+  /// hasAdjacencies
+  ///   Return true if the map is meant to be evaluated with adjacencies
+  ///   (e.g. StateMap, whose states have no geometry)
+  virtual bool hasAdjacencies ( void ) const { return false; }
 private:
 };
 
+inline void 
+Map::evaluate ( const BoxBatch & input, BoxBatch * output ) const {
+  boost::shared_ptr<RectGeo> box ( new RectGeo ( input . dimension () ) );
+  for ( uint64_t i = 0; i < input . size (); ++ i ) {
+    input . get ( i, box . get () );
+    boost::shared_ptr<RectGeo> image = 
+      boost::dynamic_pointer_cast<RectGeo> ( operator () ( box ) );
+    if ( not image ) {
+      throw std::logic_error ( "Map::evaluate. Image is not a RectGeo.\n" );
+    }
+    if ( i == 0 ) output -> resize ( image -> dimension (), input . size () );
+    output -> set ( i, *image );
+  }
+  if ( input . size () == 0 ) output -> resize ( input . dimension (), 0 );
+}
+
+inline void
+Map::adjacencies ( const Grid & grid,
+                   Grid::GridElement begin, Grid::GridElement end,
+                   std::vector<uint64_t> * offsets,
+                   std::vector<Grid::GridElement> * targets ) const {
+  throw std::logic_error ( "Map::adjacencies. Map has no combinatorial evaluation.\n" );
+}
+
 #endif
@@ -0,0 +1,58 @@
+#ifndef CMDB_SIMDBATCHMAP_H
+#define CMDB_SIMDBATCHMAP_H
+
+#include <algorithm>
+#include <vector>
+
+#include "database/maps/Map.h"
+#include "database/structures/BoxBatch.h"
+#include "database/numerics/simd_interval.h"
+
+/// SimdBatchMap
+///   Adapter giving a model map with a member template
+///     template < class I > void compute ( const I * x, I * y ) const
+///   (x and y having the dimension of phase space) a batch evaluation
+///   which instantiates compute with simd_interval<double,CMDB_SIMD_LANES>,
+///   evaluating CMDB_SIMD_LANES boxes per call. The model's own
+///   operator () should call compute with its scalar interval type, so
+///   both paths share the map formula.
+///   The images are not those of operator (): simd_interval widens every
+///   operation outward, so they are slightly wider. MapGraph uses batch
+///   images only for the adjacency lists computeAdjacencies stores, and
+///   operator () for the rest (e.g. once the store's budget is exhausted),
+///   so one Morse graph can mix edges from both. Models therefore select
+///   this adapter explicitly (USE_SIMD_INTERVAL in Leslie2D and
+///   CushingRicker3D) and default to BatchMap.
+///   Usage in Model.h:  new SimdBatchMap<ModelMap> ( p )
+template < class ModelMapType >
+class SimdBatchMap : public ModelMapType {
+public:
+  using ModelMapType::ModelMapType;
+  using ModelMapType::operator ();
+
+  virtual void evaluate ( const BoxBatch & input, BoxBatch * output ) const {
+    typedef simd_interval < double, CMDB_SIMD_LANES > Lanes;
+    const int dimension = input . dimension ();
+    const uint64_t size = input . size ();
+    output -> resize ( dimension, size );
+    // Scratch kept per thread, so evaluation does not allocate
+    static thread_local std::vector < Lanes > x;
+    static thread_local std::vector < Lanes > y;
+    x . resize ( dimension );
+    y . resize ( dimension );
+    for ( uint64_t i = 0; i < size; i += CMDB_SIMD_LANES ) {
+      int n = (int) std::min ( (uint64_t) CMDB_SIMD_LANES, size - i );
+      for ( int d = 0; d < dimension; ++ d ) {
+        x [ d ] . load ( input . lower ( d ) + i, input . upper ( d ) + i, n );
+      }
+      ModelMapType::compute ( x . data (), y . data () );
+      for ( int d = 0; d < dimension; ++ d ) {
+        y [ d ] . store ( output -> lower ( d ) + i, output -> upper ( d ) + i, n );
+      }
+    }
+  }
+
+  virtual bool hasBatchEvaluation ( void ) const { return true; }
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef CMDB_STATEMAP_H
+#define CMDB_STATEMAP_H
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include "boost/shared_ptr.hpp"
+#include "database/structures/Geo.h"
+#include "database/structures/Grid.h"
+#include "database/structures/StateGrid.h"
+#include "database/maps/Map.h"
+
+/// class StateMap
+///   Map on the states of a StateGrid, given by their adjacency lists in
+///   compressed sparse row form: the images of state s are
+///   targets [ offsets [ s ] ], ..., targets [ offsets [ s + 1 ] - 1 ],
+///   increasing and without repeats. adjacencies reads these lists,
+///   translating states to the grid elements of a StateGrid (or subgrid),
+///   so the map is never evaluated on a Geo.
+class StateMap : public Map {
+public:
+  typedef std::pair < uint64_t, uint64_t > Edge;
+
+  /// StateMap
+  ///   Construct the map with no states
+  StateMap ( void ) : offsets_ ( 1, 0 ) {}
+
+  /// StateMap
+  ///   Construct the map of num_states states sending edge . first to
+  ///   edge . second for each edge of edges (in any order, repeats allowed)
+  StateMap ( uint64_t num_states, const std::vector < Edge > & edges );
+
+  /// numStates
+  uint64_t numStates ( void ) const { return offsets_ . size () - 1; }
+
+  /// begin, end
+  ///   The images of state
+  const uint64_t * begin ( uint64_t state ) const {
+    return targets_ . data () + offsets_ [ state ];
+  }
+  const uint64_t * end ( uint64_t state ) const {
+    return targets_ . data () + offsets_ [ state + 1 ];
+  }
+
+  /// adjacencies
+  ///   Images of grid elements begin to end-1 (see Map::adjacencies).
+  ///   grid must be a StateGrid on the same states; images outside it
+  ///   are dropped.
+  virtual void adjacencies ( const Grid & grid,
+                             Grid::GridElement begin, Grid::GridElement end,
+                             std::vector<uint64_t> * offsets,
+                             std::vector<Grid::GridElement> * targets ) const;
+
+  virtual bool hasAdjacencies ( void ) const { return true; }
+
+  /// operator ()
+  ///   Not available: states have no geometry
+  virtual boost::shared_ptr<Geo> operator () ( boost::shared_ptr<Geo> geo ) const {
+    throw std::logic_error ( "StateMap::operator (). States have no geometry.\n" );
+  }
+
+private:
+  std::vector < uint64_t > offsets_;
+  std::vector < uint64_t > targets_;
+};
+
+inline
+StateMap::StateMap ( uint64_t num_states, const std::vector < Edge > & edges ) {
+  // Counting sort of the edges by source
+  offsets_ . assign ( num_states + 1, 0 );
+  for ( Edge const& edge : edges ) {
+    if ( edge . first >= num_states || edge . second >= num_states ) {
+      throw std::logic_error ( "StateMap::StateMap. Edge state out of range.\n" );
+    }
+    ++ offsets_ [ edge . first + 1 ];
+  }
+  for ( uint64_t s = 0; s < num_states; ++ s ) offsets_ [ s + 1 ] += offsets_ [ s ];
+  targets_ . resize ( edges . size () );
+  std::vector < uint64_t > position ( offsets_ . begin (), offsets_ . end () - 1 );
+  for ( Edge const& edge : edges ) targets_ [ position [ edge . first ] ++ ] = edge . second;
+  // Sort each row and drop repeats, compacting in place
+  uint64_t write = 0;
+  for ( uint64_t s = 0; s < num_states; ++ s ) {
+    std::vector<uint64_t>::iterator row_begin = targets_ . begin () + offsets_ [ s ];
+    std::vector<uint64_t>::iterator row_end = targets_ . begin () + offsets_ [ s + 1 ];
+    std::sort ( row_begin, row_end );
+    row_end = std::unique ( row_begin, row_end );
+    offsets_ [ s ] = write;
+    write = std::copy ( row_begin, row_end, targets_ . begin () + write ) - targets_ . begin ();
+  }
+  offsets_ [ num_states ] = write;
+  targets_ . resize ( write );
+}
+
+inline void
+StateMap::adjacencies ( const Grid & grid,
+                        Grid::GridElement begin, Grid::GridElement end,
+                        std::vector<uint64_t> * offsets,
+                        std::vector<Grid::GridElement> * targets ) const {
+  const StateGrid * state_grid = dynamic_cast<const StateGrid *> ( & grid );
+  if ( state_grid == NULL || state_grid -> numStates () != numStates () ) {
+    throw std::logic_error ( "StateMap::adjacencies. A StateMap requires a StateGrid of the same states\n" );
+  }
+  const Grid::GridElement N = grid . size ();
+  for ( Grid::GridElement v = begin; v < end; ++ v ) {
+    uint64_t state = state_grid -> state ( v );
+    for ( const uint64_t * it = this -> begin ( state ); it != this -> end ( state ); ++ it ) {
+      Grid::GridElement target = state_grid -> element ( *it );
+      if ( target != N ) targets -> push_back ( target );
+    }
+    offsets -> push_back ( targets -> size () );
+  }
+}
+
+#endif
@@ -0,0 +1,358 @@
+/* VECTORIZED INTERVAL CLASS */
+
+// N lanes of simple_interval, evaluated together. Every result is widened
+// outward by at least one ulp, so each lane encloses the bounds
+// simple_interval would give (see simd_interval::outward).
+
+#ifndef CMDB_SIMDINTERVAL_H
+#define CMDB_SIMDINTERVAL_H
+
+#include <stdint.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "database/numerics/simple_interval.h"
+
+/// CMDB_SIMD_LANES
+///   Number of boxes evaluated together by simd_interval based batch
+///   maps (see SimdBatchMap). The default fills one vector register with
+///   doubles on the target: 4 with AVX/AVX2 (-mavx2, -march=native),
+///   2 otherwise (SSE2). 8 fills AVX-512 registers, but measured no faster
+///   than 4 on our maps.
+#ifndef CMDB_SIMD_LANES
+#ifdef __AVX__
+#define CMDB_SIMD_LANES 4
+#else
+#define CMDB_SIMD_LANES 2
+#endif
+#endif
+
+/// simd_interval_exp
+///   exp of the bounds of N intervals at once. apply returns false if it
+///   does not handle the input, in which case simd_interval calls std::exp
+///   lane by lane. Only doubles are handled (see below).
+template < class Real, int N, bool packed = std::is_same < Real, double >::value >
+struct simd_interval_exp {
+  typedef Real vector_type
+    __attribute__ (( vector_size ( N * sizeof ( Real ) ), aligned ( sizeof ( Real ) ) ));
+  static bool apply ( const vector_type & lower, const vector_type & upper,
+                      vector_type * result_lower, vector_type * result_upper ) {
+    return false;
+  }
+};
+
+/// simd_interval_exp<double,N>
+///   Packed exp: x = n log(2) + r with |r| <= log(2)/2, e^r by its Taylor
+///   polynomial of degree 13, and 2^n assembled in the exponent bits.
+///   Error bound, with u = 2^-53 and round to nearest, for x in [-708,709]
+///   (so -1021 <= n <= 1023 and e^x is a normal double):
+///   - n * ln2_hi is exact (ln2_hi has 32 significant bits) and so is
+///     x - n * ln2_hi (Sterbenz); rounding n * ln2_lo, the final
+///     subtraction and the error of ln2_hi + ln2_lo as log(2) (< 2^-85)
+///     change r by less than 0.4u, hence e^r by a relative 0.4u.
+///   - The Taylor remainder is below |r|^14/14! e^|r|, a relative 0.08u.
+///   - Horner's scheme: a rounding at the step for r^i is damped by
+///     |r|^i, and the steps hold values below 1.5, so the roundings and
+///     the rounded coefficients 1/i! add less than 4u relative to e^r.
+///   - Multiplying by 2^n rounds once more: u.
+///   The result is thus within 6u of e^x (1.7u is the largest error seen
+///   over [-708,709]). Rather than rounding each operation outward, the
+///   lower and upper results are widened once, by a relative 2^-49 (16u,
+///   and the widening product rounds by u), so they enclose e^x, and
+///   std::exp of a library accurate to 1 ulp. Inputs outside [-708,709]
+///   and NaN are left to std::exp.
+template < class Real, int N >
+struct simd_interval_exp<Real, N, true> {
+  typedef Real vector_type
+    __attribute__ (( vector_size ( N * sizeof ( Real ) ), aligned ( sizeof ( Real ) ) ));
+  // Lanes of int64_t (the type of a comparison of vectors of doubles)
+  typedef decltype ( vector_type () < vector_type () ) integer_type;
+
+  static bool apply ( const vector_type & lower, const vector_type & upper,
+                      vector_type * result_lower, vector_type * result_upper ) {
+    if ( not inRange ( lower ) || not inRange ( upper ) ) return false;
+    const double widen = 1.7763568394002505e-15; // 2^-49
+    * result_lower = exp ( lower ) * ( 1.0 - widen );
+    * result_upper = exp ( upper ) * ( 1.0 + widen );
+    return true;
+  }
+
+  static bool inRange ( const vector_type & x ) {
+    integer_type in = ( x >= -708.0 ) & ( x <= 709.0 );
+    for ( int k = 0; k < N; ++ k ) if ( not in [ k ] ) return false;
+    return true;
+  }
+
+  static vector_type exp ( const vector_type & x ) {
+    // Adding 1.5 * 2^52 rounds to an integer held in the low mantissa bits
+    const double shifter = 6755399441055744.0;
+    const double log2e = 1.4426950408889634;
+    // log(2) split so that n * ln2_hi is exact
+    const double ln2_hi = 6.93147180369123816490e-01;
+    const double ln2_lo = 1.90821492927058770002e-10;
+    vector_type t = x * log2e + shifter;
+    vector_type n = t - shifter;
+    integer_type k = (integer_type) t - (integer_type) ( vector_type () + shifter );
+    vector_type r = ( x - n * ln2_hi ) - n * ln2_lo;
+    // 1/13!, 1/12!, ..., 1/1!, 1/0!
+    static const double c [ 14 ] = {
+      1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0,
+      1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0,
+      1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0 };
+    vector_type p = vector_type () + c [ 0 ];
+    for ( int i = 1; i < 14; ++ i ) p = p * r + c [ i ];
+    // 2^n, for -1022 <= n <= 1023
+    integer_type scale = ( k + (int64_t) 1023 ) << 52;
+    return p * (vector_type) scale;
+  }
+};
+
+/// simd_interval
+///   Structure-of-arrays interval: lane k is the interval
+///   [ lower_[k], upper_[k] ]. The bounds are GCC/Clang vector types,
+///   so +, -, * and the min/max selections of the endpoints compile to
+///   packed instructions (the selections replace the comparisons and
+///   swaps of simple_interval).
+///   Rounding: rather than switching the rounding mode, each result is
+///   widened outward once per operation, for all lanes together, by one
+///   packed multiply and subtract per bound (see outward). With round to
+///   nearest this encloses the exact result of +, -, * and / and of library
+///   functions accurate to 1 ulp (std::exp, std::pow, std::tanh). log, cos,
+///   sin, tan and cot widen the lane bounds of simple_interval, which is
+///   itself not rigorous. Not valid under -ffast-math or with flush to zero.
+///   The operators and functions of simple_interval are provided with the
+///   same names, and scalars and simple_intervals convert to simd_intervals
+///   (by broadcasting). Map code written as a template over the interval
+///   type, e.g.
+///     template < class I > void compute ( const I * x, I * y ) const {
+///       y [ 0 ] = ( p0 * x [ 0 ] + p1 * x [ 1 ] ) * exp ( -0.1 * x [ 1 ] );
+///     }
+///   compiles for both simple_interval<double> and simd_interval<double,N>.
+///   Existing maps have to be rewritten in this form (see Leslie2D and
+///   CushingRicker3D). Maps whose evaluation branches on the endpoints or
+///   does not return a box (Newton's atan2 quadrants, the CAPD integration
+///   of VanderPol, the root finding and UnionGeo of IAS_Model) cannot be,
+///   and keep their scalar evaluation.
+///   exp of doubles is packed (see simd_interval_exp); pow, tanh and exp of
+///   other types call the scalar library function per lane; functions
+///   with data dependent branches (log, cos, sin, tan, cot) are evaluated
+///   lane by lane with simple_interval.
+template < class Real, int N >
+struct simd_interval {
+  // aligned ( sizeof ( Real ) ): may live in std::vector and be loaded
+  // from unaligned arrays
+  typedef Real vector_type
+    __attribute__ (( vector_size ( N * sizeof ( Real ) ), aligned ( sizeof ( Real ) ) ));
+
+  vector_type lower_;
+  vector_type upper_;
+
+  simd_interval ( void ) {}
+  simd_interval ( Real value ) {
+    lower_ = upper_ = vector_type () + value;
+  }
+  simd_interval ( Real lower, Real upper ) {
+    lower_ = vector_type () + lower;
+    upper_ = vector_type () + upper;
+  }
+  simd_interval ( const simple_interval<Real> & value ) {
+    lower_ = vector_type () + value . lower_;
+    upper_ = vector_type () + value . upper_;
+  }
+
+  static int lanes ( void ) { return N; }
+  Real lower ( int k ) const { return lower_ [ k ]; }
+  Real upper ( int k ) const { return upper_ [ k ]; }
+
+  /// lane
+  ///   Return lane k as a simple_interval
+  simple_interval<Real> lane ( int k ) const {
+    return simple_interval<Real> ( lower_ [ k ], upper_ [ k ] );
+  }
+
+  /// set
+  ///   Set lane k
+  void set ( int k, const simple_interval<Real> & value ) {
+    lower_ [ k ] = value . lower_;
+    upper_ [ k ] = value . upper_;
+  }
+
+  /// load
+  ///   Read n <= N intervals from arrays of bounds. Lanes n to N-1
+  ///   repeat the last interval.
+  void load ( const Real * lower, const Real * upper, int n ) {
+    if ( n == N ) {
+      std::memcpy ( &lower_, lower, sizeof ( vector_type ) );
+      std::memcpy ( &upper_, upper, sizeof ( vector_type ) );
+      return;
+    }
+    for ( int k = 0; k < N; ++ k ) {
+      lower_ [ k ] = lower [ k < n ? k : n - 1 ];
+      upper_ [ k ] = upper [ k < n ? k : n - 1 ];
+    }
+  }
+
+  /// store
+  ///   Write lanes 0 to n-1 to arrays of bounds
+  void store ( Real * lower, Real * upper, int n ) const {
+    if ( n == N ) {
+      std::memcpy ( lower, &lower_, sizeof ( vector_type ) );
+      std::memcpy ( upper, &upper_, sizeof ( vector_type ) );
+      return;
+    }
+    for ( int k = 0; k < n; ++ k ) {
+      lower [ k ] = lower_ [ k ];
+      upper [ k ] = upper_ [ k ];
+    }
+  }
+
+  // Lane-wise std::min and std::max. Arguments by reference: passing wide
+  // vectors by value changes the ABI when the target lacks registers for them.
+  static inline vector_type vmin ( const vector_type & a, const vector_type & b ) {
+    return b < a ? b : a;
+  }
+  static inline vector_type vmax ( const vector_type & a, const vector_type & b ) {
+    return a < b ? b : a;
+  }
+
+  /// outward
+  ///   Widen the bounds by a relative 2 epsilon plus the smallest subnormal,
+  ///   at least one ulp, all lanes at once. The min/max keep infinite
+  ///   bounds (where the widening gives NaN) as they are.
+  static inline void outward ( vector_type * lower, vector_type * upper ) {
+    const Real relative = 2 * std::numeric_limits<Real>::epsilon ();
+    const Real absolute = std::numeric_limits<Real>::denorm_min ();
+    vector_type zero = vector_type ();
+    vector_type lower_magnitude = * lower < zero ? - * lower : * lower;
+    vector_type upper_magnitude = * upper < zero ? - * upper : * upper;
+    * lower = vmin ( * lower, * lower - ( lower_magnitude * relative + absolute ) );
+    * upper = vmax ( * upper, * upper + ( upper_magnitude * relative + absolute ) );
+  }
+  void outward ( void ) { outward ( &lower_, &upper_ ); }
+
+  // The functions below are found by argument dependent lookup. Being
+  // non-template friends, they accept Real and simple_interval<Real>
+  // arguments through the converting constructors above.
+
+  friend simd_interval operator + ( const simd_interval & lhs, const simd_interval & rhs ) {
+    simd_interval result;
+    result . lower_ = lhs . lower_ + rhs . lower_;
+    result . upper_ = lhs . upper_ + rhs . upper_;
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval operator - ( const simd_interval & lhs, const simd_interval & rhs ) {
+    simd_interval result;
+    vector_type a = lhs . lower_ - rhs . upper_;
+    vector_type b = lhs . upper_ - rhs . lower_;
+    result . lower_ = vmin ( a, b );
+    result . upper_ = vmax ( a, b );
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval operator * ( const simd_interval & lhs, const simd_interval & rhs ) {
+    simd_interval result;
+    vector_type a = lhs . lower_ * rhs . lower_;
+    vector_type b = lhs . lower_ * rhs . upper_;
+    vector_type c = lhs . upper_ * rhs . lower_;
+    vector_type d = lhs . upper_ * rhs . upper_;
+    result . lower_ = vmin ( vmin ( a, b ), vmin ( c, d ) );
+    result . upper_ = vmax ( vmax ( a, b ), vmax ( c, d ) );
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval operator / ( const simd_interval & lhs, const simd_interval & rhs ) {
+    return lhs * pow ( rhs, (Real) -1 );
+  }
+
+  friend simd_interval pow ( const simd_interval & base, const Real exponent ) {
+    simd_interval result;
+    if ( exponent == 0 ) return simd_interval ( (Real) 1 );
+    for ( int k = 0; k < N; ++ k ) {
+      Real a = std::pow ( base . lower_ [ k ], exponent );
+      Real b = std::pow ( base . upper_ [ k ], exponent );
+      result . lower_ [ k ] = exponent > 0 ? a : b;
+      result . upper_ [ k ] = exponent > 0 ? b : a;
+    }
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval exp ( const simd_interval & exponent ) {
+    simd_interval result;
+    if ( simd_interval_exp<Real, N>::apply ( exponent . lower_, exponent . upper_,
+                                             &result . lower_, &result . upper_ ) ) {
+      return result;
+    }
+    for ( int k = 0; k < N; ++ k ) {
+      result . lower_ [ k ] = std::exp ( exponent . lower_ [ k ] );
+      result . upper_ [ k ] = std::exp ( exponent . upper_ [ k ] );
+    }
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval tanh ( const simd_interval & term ) {
+    simd_interval result;
+    for ( int k = 0; k < N; ++ k ) {
+      result . lower_ [ k ] = std::tanh ( term . lower_ [ k ] );
+      result . upper_ [ k ] = std::tanh ( term . upper_ [ k ] );
+    }
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval square ( const simd_interval & term ) {
+    simd_interval result;
+    vector_type zero = vector_type ();
+    vector_type a = term . lower_ * term . lower_;
+    vector_type b = term . upper_ * term . upper_;
+    vector_type lower = vmin ( a, b );
+    result . lower_ = ( term . lower_ < zero ) & ( term . upper_ > zero ) ? zero : lower;
+    result . upper_ = vmax ( a, b );
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval log ( const simd_interval & term ) {
+    simd_interval result;
+    for ( int k = 0; k < N; ++ k ) result . set ( k, log ( term . lane ( k ) ) );
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval cos ( const simd_interval & term ) {
+    simd_interval result;
+    for ( int k = 0; k < N; ++ k ) result . set ( k, cos ( term . lane ( k ) ) );
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval sin ( const simd_interval & term ) {
+    simd_interval result;
+    for ( int k = 0; k < N; ++ k ) result . set ( k, sin ( term . lane ( k ) ) );
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval tan ( const simd_interval & term ) {
+    simd_interval result;
+    for ( int k = 0; k < N; ++ k ) result . set ( k, tan ( term . lane ( k ) ) );
+    result . outward ();
+    return result;
+  }
+
+  friend simd_interval cot ( const simd_interval & term ) {
+    simd_interval result;
+    for ( int k = 0; k < N; ++ k ) result . set ( k, cot ( term . lane ( k ) ) );
+    result . outward ();
+    return result;
+  }
+};
+
+#endif
@@ -3,7 +3,9 @@
 
 #include "delegator/delegator.h"
 #include "database/structures/Database.h"
+#include "database/structures/MappedDatabase.h"
 #include "database/program/Configuration.h"
+#include "database/program/CoordinatorTimer.h"
 #include "boost/date_time/posix_time/posix_time.hpp"
 #include <boost/chrono/chrono_io.hpp>
 
@@ -29,7 +31,11 @@ public:
 private:
 
   Configuration config;
-  Database database;
+  // database.mdb, mapped read-only; results_ holds the Conley indices
+  // received, in order, and is applied to a loaded copy at each checkpoint
+  MappedDatabase database;
+  std::string database_file_;
+  std::vector < std::pair < uint64_t, CI_Data > > results_;
   Model model;
   boost::shared_ptr<ParameterSpace> parameter_space_;
   size_t num_jobs_sent_;
@@ -38,9 +44,8 @@ private:
   std::vector<uint64_t> attempts_;
   std::vector<bool> finished_;
   size_t num_finished_;
-  boost::posix_time::ptime time_of_last_checkpoint_;
   boost::posix_time::ptime time_of_last_progress_report_;
-  bool checkpoint_timer_running_;
+  CoordinatorTimer timer_;
 
 };
 
@@ -0,0 +1,118 @@
+#ifndef CMDB_COORDINATORTIMER_H
+#define CMDB_COORDINATORTIMER_H
+
+#include <stdint.h>
+
+#include "boost/shared_ptr.hpp"
+#include "boost/function.hpp"
+#include "boost/thread.hpp"
+#include "boost/date_time/posix_time/posix_time.hpp"
+
+/// CMDB_CHECKPOINT_INTERVAL
+///   Seconds (of wall-clock time) between coordinator checkpoints
+#ifndef CMDB_CHECKPOINT_INTERVAL
+#define CMDB_CHECKPOINT_INTERVAL 3600
+#endif
+
+/// class CoordinatorTimer
+///   Periodic wall-clock timer running on its own thread of the
+///   coordinator process. Each time the interval elapses the timer
+///   invokes its callback (on the timer thread, so the callback must be
+///   thread-safe, e.g. by handing work to a DatabaseMerger) and raises a
+///   flag the coordinator can poll with due () from prepare/accept.
+///   This replaces the "checkpoint timer job" which occupied a worker
+///   rank sleeping in order to wake the coordinator.
+class CoordinatorTimer {
+public:
+  typedef boost::function<void(void)> Callback;
+
+  CoordinatorTimer ( void );
+  ~CoordinatorTimer ( void );
+
+  /// start
+  ///   Start ticking every "seconds" seconds. callback may be empty.
+  void start ( uint64_t seconds, Callback callback = Callback () );
+
+  /// stop
+  ///   Stop the timer thread
+  void stop ( void );
+
+  /// due
+  ///   Return true (once) if the interval has elapsed since the
+  ///   last call that returned true
+  bool due ( void );
+
+private:
+  void run_ ( void );
+  uint64_t seconds_;
+  Callback callback_;
+  boost::shared_ptr<boost::thread> thread_;
+  boost::mutex mutex_;
+  boost::condition_variable wake_;
+  bool stopping_;
+  bool due_;
+};
+
+inline
+CoordinatorTimer::CoordinatorTimer ( void ) :
+seconds_ ( 0 ),
+stopping_ ( false ),
+due_ ( false ) {}
+
+inline
+CoordinatorTimer::~CoordinatorTimer ( void ) {
+  stop ();
+}
+
+inline void
+CoordinatorTimer::start ( uint64_t seconds, Callback callback ) {
+  stop ();
+  seconds_ = seconds;
+  callback_ = callback;
+  stopping_ = false;
+  due_ = false;
+  thread_ . reset ( new boost::thread ( &CoordinatorTimer::run_, this ) );
+}
+
+inline void
+CoordinatorTimer::stop ( void ) {
+  if ( not thread_ ) return;
+  {
+    boost::mutex::scoped_lock lock ( mutex_ );
+    stopping_ = true;
+    wake_ . notify_one ();
+  }
+  thread_ -> join ();
+  thread_ . reset ();
+}
+
+inline bool
+CoordinatorTimer::due ( void ) {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  bool result = due_;
+  due_ = false;
+  return result;
+}
+
+inline void
+CoordinatorTimer::run_ ( void ) {
+  boost::posix_time::ptime next =
+    boost::posix_time::microsec_clock::universal_time () +
+    boost::posix_time::seconds ( (long) seconds_ );
+  while ( 1 ) {
+    {
+      boost::mutex::scoped_lock lock ( mutex_ );
+      while ( not stopping_ &&
+              boost::posix_time::microsec_clock::universal_time () < next ) {
+        wake_ . timed_wait ( lock, next );
+      }
+      if ( stopping_ ) return;
+      due_ = true;
+    }
+    if ( callback_ ) callback_ ();
+    next = boost::posix_time::microsec_clock::universal_time () +
+           boost::posix_time::seconds ( (long) seconds_ );
+  }
+}
+
+#endif
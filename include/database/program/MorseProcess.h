@@ -5,11 +5,37 @@
 #include "boost/unordered_set.hpp"
 #include "delegator/delegator.h"
 #include "database/structures/Database.h"
+#include "database/structures/DatabaseMerger.h"
+#include "database/program/CoordinatorTimer.h"
+#include "boost/date_time/posix_time/posix_time.hpp"
 #include "database/program/Configuration.h"
 #include "database/structures/PointerGrid.h"
 #include "chomp/CubicalComplex.h"
 
 #include "Model.h"
+
+/// CMDB_DATABASE_LOG
+///   If defined, job results are appended to database.log as they are
+///   merged, and checkpoints flush the log instead of rewriting
+///   database.raw. (initialize writes the database it starts from --
+///   empty, or resumed from an earlier database.raw and database.log --
+///   to database.raw, so the log holds only results received since;
+///   finalize writes the complete database.)
+
+/// CMDB_NO_RESUME
+///   If defined, an existing database.raw (and database.log) is ignored.
+///   Otherwise MorseProcess resumes from it: patches whose parameter and
+///   clutching records are all present are not recomputed. (Patches
+///   containing a parameter without a map are always recomputed.)
+
+/// CMDB_ADAPTIVE_PATCHES
+///   If defined, and the parameter space is a EuclideanParameterSpace,
+///   initialize replaces its uniform patches by patches of roughly equal
+///   estimated cost (see EuclideanParameterSpace::adaptPatches), probing
+///   one parameter box per CMDB_ADAPTIVE_PATCHES^d boxes (define it as 1
+///   to probe them all). The probe computes the Morse graph of the
+///   parameter down to PHASE_SUBDIV_MIN only, on CMDB_PATCH_THREADS threads.
+
 /* * * * * * * * * * * * * * */
 /* MorseProcess declaration */
 /* * * * * * * * * * * * * * */
@@ -22,20 +48,29 @@ public:
   void accept ( const Message &result );
   void finalize ( void ); 
 
+  /// checkpoint
+  ///   Save database.raw. Called on the merge thread every
+  ///   CMDB_CHECKPOINT_INTERVAL seconds.
   void checkpoint ( void );
   void progressReport ( void );
 
+  /// resume
+  ///   Load database.raw (and replay database.log) if they exist and
+  ///   match the parameter space. Returns true if a checkpoint was loaded.
+  bool resume ( void );
+
 private:
   size_t num_jobs_;
   size_t num_jobs_sent_;
   Configuration config;
   Model model;
   Database database;
+  DatabaseMerger merger_;                       // merges job results in background
   size_t progress_bar_;                         // progress bar
-  clock_t time_of_last_progress_report_;
-  clock_t time_of_last_checkpoint_;
-  bool checkpoint_timer_running_;
+  boost::posix_time::ptime time_of_last_progress_report_;
+  CoordinatorTimer timer_;                      // schedules checkpoints
   boost::shared_ptr<ParameterSpace> parameter_space_;
+  std::vector<bool> patch_complete_;            // patches found in checkpoint
 };
 
 #endif
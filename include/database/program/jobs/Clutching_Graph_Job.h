@@ -23,7 +23,9 @@ void Clutching_Graph_Job ( Message * result,
 #include <vector>
 #include <ctime>
 #include <set>
+#include <atomic>
 
+#include "boost/thread.hpp"
 #include "boost/iterator_adaptors.hpp"
 #include "boost/iterator/counting_iterator.hpp"
 #include "boost/serialization/vector.hpp"
@@ -32,11 +34,46 @@ void Clutching_Graph_Job ( Message * result,
 
 #include "database/program/Configuration.h"
 #include "database/structures/MorseGraph.h"
+#include "database/structures/MorseGraphCache.h"
 #include "database/program/jobs/Compute_Morse_Graph.h"
+#include "database/algorithms/GraphTheory.h"
 #include "database/structures/Database.h"
+#include "database/structures/DatabaseMerger.h"
 #include "database/algorithms/clutching.h"
 #include "database/maps/Map.h"
 
+/// CMDB_MORSE_GRAPH_CACHE_MEMORY
+///   Memory budget (in bytes) of the per-process cache of Morse graphs
+///   which lets a worker reuse the Morse graphs of parameters shared
+///   between patches. 0 (the default) disables the cache.
+///   MorseProcess::prepare hands patches out in order to whichever worker
+///   is free, so a worker's next patch is about one patch per rank further
+///   on and rarely shares a boundary with its last one. The cache only
+///   pays for itself with few ranks -- e.g. one rank per node running
+///   CMDB_PATCH_THREADS threads -- and the budget is taken once per rank.
+#ifndef CMDB_MORSE_GRAPH_CACHE_MEMORY
+#define CMDB_MORSE_GRAPH_CACHE_MEMORY 0
+#endif
+
+/// CMDB_PATCH_THREADS
+///   Number of threads Clutching_Graph_Job uses to compute the Morse graphs
+///   of a patch, and then its clutching graphs; 0 means one per hardware
+///   thread. Each thread obtains its own map and phase space from the
+///   Model, so Model::map, Model::phaseSpace and Model::annotate must be
+///   safe to call concurrently. The default of 1 is appropriate when
+///   running one MPI process per core.
+#ifndef CMDB_PATCH_THREADS
+#define CMDB_PATCH_THREADS 1
+#endif
+
+/// morseGraphCache
+///   Return the Morse graph cache of this process
+inline MorseGraphCache &
+morseGraphCache ( void ) {
+  static MorseGraphCache cache ( CMDB_MORSE_GRAPH_CACHE_MEMORY );
+  return cache;
+}
+
 /** Main function for clutching graph job.
  *
  *  This function is called from worker, and compare graph structure
@@ -65,89 +102,126 @@ Clutching_Graph_Job ( Message * result,
 
   // Prepare data structures
   Database database;
-  boost::unordered_map < uint64_t, MorseGraph> morse_graphs;
+  boost::unordered_map < uint64_t, boost::shared_ptr<MorseGraph> > morse_graphs;
+  MorseGraphCache & cache = morseGraphCache ();
+  int patch_threads = CMDB_PATCH_THREADS;
+  if ( patch_threads == 0 ) patch_threads = boost::thread::hardware_concurrency ();
 
   // Compute Morse Graphs
-  size_t num_parameters = patch -> vertices . size ();
+  const std::vector < uint64_t > & vertices = patch -> vertices;
+  size_t num_parameters = vertices . size ();
   std::cout << "Clutching_Graph_Job. Starting analysis of " << num_parameters << " parameter boxes.\n";
   std::cout << "--------- 1. Compute Morse Graphs --------- " << "\n";
 
-  size_t count = 0;
-  BOOST_FOREACH ( uint64_t vertex, patch -> vertices ) {
+  // The Morse graph of vertices [ i ] goes to vertex_graphs [ i ] (null 
+  // if there is no map for it), so the parameters may run in any order
+  std::vector < boost::shared_ptr<MorseGraph> > vertex_graphs ( num_parameters );
+  std::atomic < size_t > count ( 0 );
+  std::atomic < size_t > cached ( 0 );
+  parallelFor ( patch_threads, num_parameters, [&] ( uint64_t i ) {
+    uint64_t vertex = vertices [ i ];
     // Obtain parameter associated with vertex
-    boost::shared_ptr<Parameter> parameter = patch -> parameter [ vertex ];
+    boost::shared_ptr<Parameter> parameter = patch -> parameter . at ( vertex );
     
     // Debug output
     std::cout << "Clutching_Graph_Job. Processing parameter " << *parameter 
               << ", which is " << ++count << "/" << num_parameters << ".\n "; 
 
-    // Prepare dynamical map
-    boost::shared_ptr<const Map> map = model . map ( parameter );
-    if ( not map ) {
-      std::cout << "Clutching_Graph_Job. No map associated with parameter " <<
-        *parameter << "; continuing.\n";
-      continue;
-    }
-    // Prepare phase space
-    boost::shared_ptr<Grid> phase_space = model . phaseSpace ();    
-    if ( not phase_space ) {
-      throw std::logic_error ( "Clutching_Graph_Job. model.phaseSpace() failed" 
-                               " to return a valid pointer.\n");
-    }
-
-    // Perform Morse Graph computation
-    Compute_Morse_Graph 
-    ( & morse_graphs [ vertex ],
-      phase_space, 
-      map, 
-      PHASE_SUBDIV_INIT,
-      PHASE_SUBDIV_MIN, 
-      PHASE_SUBDIV_MAX, 
-      PHASE_SUBDIV_LIMIT );
-
-    std::cout << "Clutching_Graph_Job. Successfully computed " 
-      << "Morse Graph for parameter " << *parameter << ".\n";
-
-    // Check for warnings
-    if ( morse_graphs [ vertex ] . NumVertices () == 0 )  { 
-      std::cerr << "Clutching_Graph_Job. WARNING. Vertex # " << vertex << ", parameter = " 
-      << *parameter << " yielded no morse sets.\n"; 
+    // Use the cached Morse graph if this parameter was computed for an earlier patch
+    boost::shared_ptr<MorseGraph> morse_graph = cache . find ( vertex );
+    if ( morse_graph ) {
+      std::cout << "Clutching_Graph_Job. Using cached " 
+        << "Morse Graph for parameter " << *parameter << ".\n";
+      ++ cached;
+    } else {
+      // Prepare dynamical map
+      boost::shared_ptr<const Map> map = model . map ( parameter );
+      if ( not map ) {
+        std::cout << "Clutching_Graph_Job. No map associated with parameter " <<
+          *parameter << "; continuing.\n";
+        return;
+      }
+      // Prepare phase space
+      boost::shared_ptr<Grid> phase_space = model . phaseSpace ();    
+      if ( not phase_space ) {
+        throw std::logic_error ( "Clutching_Graph_Job. model.phaseSpace() failed" 
+                                 " to return a valid pointer.\n");
+      }
+
+      // Perform Morse Graph computation
+      morse_graph . reset ( new MorseGraph );
+      Compute_Morse_Graph 
+      ( morse_graph . get (),
+        phase_space, 
+        map, 
+        PHASE_SUBDIV_INIT,
+        PHASE_SUBDIV_MIN, 
+        PHASE_SUBDIV_MAX, 
+        PHASE_SUBDIV_LIMIT );
+
+      std::cout << "Clutching_Graph_Job. Successfully computed " 
+        << "Morse Graph for parameter " << *parameter << ".\n";
+
+      // Check for warnings
+      if ( morse_graph -> NumVertices () == 0 )  { 
+        std::cerr << "Clutching_Graph_Job. WARNING. Vertex # " << vertex << ", parameter = " 
+        << *parameter << " yielded no morse sets.\n"; 
+      }
+
+      // Annotate the morse graph
+      std::cout << "Clutching_Graph_Job. Annotating " 
+        << "Morse Graph for parameter " << *parameter << ".\n";
+      model . annotate ( morse_graph . get () );
+
+      cache . insert ( vertex, morse_graph );
     }
+    // Build the labelled trees now, as Clutching reads them concurrently
+    morse_graph -> labelledTrees ();
+    vertex_graphs [ i ] = morse_graph;
+  } );
 
-    // Annotate the morse graph
-    std::cout << "Clutching_Graph_Job. Annotating " 
-      << "Morse Graph for parameter " << *parameter << ".\n";
-    model . annotate ( & morse_graphs [ vertex ] );
+  for ( size_t i = 0; i < num_parameters; ++ i ) {
+    if ( not vertex_graphs [ i ] ) continue;
+    uint64_t vertex = vertices [ i ];
+    morse_graphs [ vertex ] = vertex_graphs [ i ];
 
     // Insert Morse graph into database
     std::cout << "Clutching_Graph_Job. Inserting " 
-      << "Morse Graph for parameter " << *parameter << " into local database.\n";
-    database . insert ( vertex, morse_graphs [ vertex ] );
+      << "Morse Graph for parameter " << * patch -> parameter . at ( vertex ) 
+      << " into local database.\n";
+    database . insert ( vertex, * vertex_graphs [ i ] );
   }
+  std::cout << "Clutching_Graph_Job. " << cached << "/" << num_parameters 
+            << " Morse Graphs taken from cache (" << cache . size () 
+            << " cached, " << cache . memory () << " bytes).\n";
   
   // Compute Clutching Graphs
   std::cout << "--------- 2. Compute Clutching Graphs --------- " << "\n";
   typedef std::pair < uint64_t, uint64_t > Adjacency;
+  std::vector < Adjacency > adjacencies;
   BOOST_FOREACH ( const Adjacency & A, patch -> edges ) {
-    uint64_t u = A . first;
-    uint64_t v = A . second;
     // If adjacency between uncomputed Morse sets, continue.
-    if ( morse_graphs . count ( u ) == 0  ||
-         morse_graphs . count ( v ) == 0 ) {
+    if ( morse_graphs . count ( A . first ) == 0  ||
+         morse_graphs . count ( A . second ) == 0 ) {
       continue;
     }
+    adjacencies . push_back ( A );
+  }
+  std::vector < BG_Data > clutching_graphs ( adjacencies . size () );
+  parallelFor ( patch_threads, adjacencies . size (), [&] ( uint64_t i ) {
     // Compute clutching graph
-    BG_Data clutching_graph;
-    Clutching ( & clutching_graph,
-                morse_graphs [ u ],
-                morse_graphs [ v ]);
-
+    Clutching ( & clutching_graphs [ i ],
+                * morse_graphs . find ( adjacencies [ i ] . first ) -> second,
+                * morse_graphs . find ( adjacencies [ i ] . second ) -> second );
+  } );
+  for ( size_t i = 0; i < adjacencies . size (); ++ i ) {
     // Insert clutching graph into database
-    database . insert ( u, v, clutching_graph );
+    database . insert ( adjacencies [ i ] . first, adjacencies [ i ] . second, 
+                        clutching_graphs [ i ] );
   }
   
   // Return Result
   std::cout << "CLUTCHING JOB with " << num_parameters << " parameters COMPLETE.\n";
-  *result << database;
+  *result << DatabaseMerger::serialize ( database );
 }
 #endif
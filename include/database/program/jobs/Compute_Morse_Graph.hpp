@@ -13,8 +13,10 @@ using namespace cimg_library;
 #include <stack>
 #include <vector>
 #include <exception>
+#include <atomic>
 #include "boost/foreach.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/thread.hpp"
 
 #include "database/algorithms/GraphTheory.h"
 #include "database/algorithms/join.h"
@@ -167,6 +169,161 @@ public:
   }
 };
 
+/// CMDB_DECOMPOSITION_THREADS
+///   Number of threads ConstructMorseDecomposition uses to decompose
+///   independent nodes of the Morse decomposition hierarchy concurrently.
+///   0 means one per hardware thread. The default of 1 is serial, which is
+///   appropriate when running one MPI process per core. (Ignored, i.e. serial,
+///   when MEMORYBOOKKEEPING is defined.)
+#ifndef CMDB_DECOMPOSITION_THREADS
+#define CMDB_DECOMPOSITION_THREADS 1
+#endif
+
+// ProcessMorseDecompositionNode
+//   Decompose a single node of the hierarchy and, if it is not past the Max
+//   depth, spawn and subdivide its children. Returns the children to process.
+//   Touches no data outside work_node, so distinct nodes may be processed
+//   concurrently (provided the map f may be evaluated concurrently).
+inline std::vector < MorseDecomposition * > 
+ProcessMorseDecompositionNode (MorseDecomposition * work_node,
+                               boost::shared_ptr<const Map> f,
+                               const unsigned int Min,
+                               const unsigned int Max,
+                               const unsigned int Limit ) {
+  std::vector < MorseDecomposition * > result;
+  //std::cout << "Depth " << work_node -> depth () << ", node " << work_node 
+  //          << ", size = " << work_node -> size () << "\n";
+
+  // Do not decompose if past Min depth and over the Limit size.
+  if ( ( work_node -> depth () > Min ) 
+       && ( work_node -> size () > Limit ) ) {
+    //std::cout << "Halting search due to Limit.\n";
+    return result;
+  }
+
+  work_node -> decompose ( f );
+
+  // Check for spuriousness
+  if ( work_node -> decomposition ()  . empty () ) {
+    //std::cout << "Empty decomposition for " << work_node << ", marking as spurious.\n";
+    work_node -> spurious () = true;
+  }
+
+  // Hierarchical Step
+  if ( (work_node -> depth () < Max) ) {
+    result = work_node -> spawn ();
+    BOOST_FOREACH ( MorseDecomposition * child, result ) {
+      child -> grid () -> subdivide ();
+    }
+  } 
+  //else {
+    //std::cout << "Halting search due to Max.\n";
+  //}
+  return result;
+}
+
+// ConstructMorseDecompositionParallel
+//   Work-stealing version of ConstructMorseDecomposition.
+//   Each thread owns a priority queue (largest node first) of nodes to
+//   process and pushes the children it spawns onto it; an idle thread steals
+//   the largest node of another thread's queue, and a thread which finds
+//   every queue empty sleeps until a node is queued or the work is done.
+//   Since the hierarchy is 
+//   determined by the parent/child relation (children are stored in the
+//   order of their parent's decomposition) and not by the order in which
+//   nodes are processed, the resulting MorseGraph is the same as the serial one.
+inline void
+ConstructMorseDecompositionParallel (MorseDecomposition * root,
+                                     boost::shared_ptr<const Map> f,
+                                     const unsigned int Min,
+                                     const unsigned int Max,
+                                     const unsigned int Limit,
+                                     int num_threads ) {
+  typedef std::priority_queue < MorseDecomposition *, 
+                                std::vector<MorseDecomposition *>, 
+                                MorseDecompCompare > WorkQueue;
+  std::vector < WorkQueue > queues ( num_threads );
+  std::vector < boost::shared_ptr<boost::mutex> > queue_mutexes;
+  for ( int t = 0; t < num_threads; ++ t ) {
+    queue_mutexes . push_back ( boost::shared_ptr<boost::mutex> ( new boost::mutex ) );
+  }
+  // Number of nodes which have been pushed but not yet processed
+  std::atomic<int64_t> pending ( 1 );
+  std::atomic<size_t> nodes_processed ( 0 );
+  std::atomic<bool> failed ( false );
+  std::exception_ptr error;
+  boost::mutex error_mutex;
+  // Idle threads wait on wake. queued counts the nodes in the queues; it is
+  // raised, pending reaches zero and failed is set under wake_mutex, each
+  // followed by a notification.
+  std::atomic<int64_t> queued ( 1 );
+  boost::mutex wake_mutex;
+  boost::condition_variable wake;
+  queues [ 0 ] . push ( root );
+
+  boost::thread_group workers;
+  for ( int t = 0; t < num_threads; ++ t ) {
+    workers . create_thread ( [&, t] () {
+      while ( pending > 0 && not failed ) {
+        MorseDecomposition * work_node = NULL;
+        // Take the largest node of our own queue, or else steal one
+        for ( int k = 0; k < num_threads && work_node == NULL; ++ k ) {
+          int victim = ( t + k ) % num_threads;
+          boost::mutex::scoped_lock lock ( * queue_mutexes [ victim ] );
+          if ( not queues [ victim ] . empty () ) {
+            work_node = queues [ victim ] . top ();
+            queues [ victim ] . pop ();
+            -- queued;
+          }
+        }
+        if ( work_node == NULL ) {
+          boost::mutex::scoped_lock lock ( wake_mutex );
+          while ( queued <= 0 && pending > 0 && not failed ) wake . wait ( lock );
+          continue;
+        }
+        size_t count = ++ nodes_processed;
+        if ( count % 1000 == 0 ) { 
+          std::cout << count 
+            << " nodes have been encountered on Morse Decomposition Hierarchy.\n";
+        }
+        std::vector < MorseDecomposition * > children;
+        try {
+          children = ProcessMorseDecompositionNode ( work_node, f, Min, Max, Limit );
+        } catch ( ... ) {
+          {
+            boost::mutex::scoped_lock lock ( error_mutex );
+            if ( not error ) error = std::current_exception ();
+          }
+          boost::mutex::scoped_lock lock ( wake_mutex );
+          failed = true;
+          wake . notify_all ();
+          return;
+        }
+        // Count the children before they can be stolen, and before retiring
+        // this node, so pending never reaches zero while work remains.
+        pending += children . size ();
+        {
+          boost::mutex::scoped_lock lock ( * queue_mutexes [ t ] );
+          BOOST_FOREACH ( MorseDecomposition * child, children ) {
+            queues [ t ] . push ( child );
+          }
+        }
+        if ( not children . empty () ) {
+          boost::mutex::scoped_lock lock ( wake_mutex );
+          queued += children . size ();
+          wake . notify_all ();
+        }
+        if ( -- pending == 0 ) {
+          boost::mutex::scoped_lock lock ( wake_mutex );
+          wake . notify_all ();
+        }
+      }
+    } );
+  }
+  workers . join_all ();
+  if ( error ) std::rethrow_exception ( error );
+}
+
 // The MorseDecomposition Tree
 //  The level of subdivision of the root is whatever the initial level is, which we call 0.
 //  The level of subdivision of an internal node in the tree is equal to its depth
@@ -182,6 +339,14 @@ ConstructMorseDecomposition (MorseDecomposition * root,
                              const unsigned int Min,
                              const unsigned int Max,
                              const unsigned int Limit ) {
+#ifndef MEMORYBOOKKEEPING
+  int num_threads = CMDB_DECOMPOSITION_THREADS;
+  if ( num_threads == 0 ) num_threads = boost::thread::hardware_concurrency ();
+  if ( num_threads > 1 ) {
+    ConstructMorseDecompositionParallel ( root, f, Min, Max, Limit, num_threads );
+    return;
+  }
+#endif
   size_t nodes_processed = 0;
   // We use a priority queue in order to do the more difficult computations first.
   std::priority_queue < MorseDecomposition *, 
@@ -196,35 +361,11 @@ ConstructMorseDecomposition (MorseDecomposition * root,
     }
     MorseDecomposition * work_node = pq . top ();
     pq . pop ();
-    //std::cout << "Depth " << work_node -> depth () << ", node " << work_node 
-    //          << ", size = " << work_node -> size () << "\n";
-
-    // Do not decompose if past Min depth and over the Limit size.
-    if ( ( work_node -> depth () > Min ) 
-         && ( work_node -> size () > Limit ) ) {
-      //std::cout << "Halting search due to Limit.\n";
-      continue;
-    }
-
-    work_node -> decompose ( f );
-
-    // Check for spuriousness
-    if ( work_node -> decomposition ()  . empty () ) {
-      //std::cout << "Empty decomposition for " << work_node << ", marking as spurious.\n";
-      work_node -> spurious () = true;
+    std::vector < MorseDecomposition * > children = 
+      ProcessMorseDecompositionNode ( work_node, f, Min, Max, Limit );
+    BOOST_FOREACH ( MorseDecomposition * child, children ) {
+      pq . push ( child );
     }
-
-    // Hierarchical Step
-    if ( (work_node -> depth () < Max) ) {
-      std::vector < MorseDecomposition * > children = work_node -> spawn ();
-      BOOST_FOREACH ( MorseDecomposition * child, children ) {
-        child -> grid () -> subdivide ();
-        pq . push ( child );
-      }
-    } 
-    //else {
-      //std::cout << "Halting search due to Max.\n";
-    //}
   }
 }
 
@@ -401,6 +542,9 @@ Compute_Morse_Graph (MorseGraph * MG,
   std::cout << "Max Memory For Single Grid (must be internal)= " << max_grid_internal_memory << "\n";
   std::cout << "Max SCC Random Access memory use (must be internal)= " << max_scc_memory_internal << "\n";
   std::cout << "Max SCC stack memory use (can be external memory) = " << max_scc_memory_external << "\n";
+#ifdef CMDB_EXTERNAL_SCC_STACKS
+  std::cout << "  (SCC stacks and topological sort were kept on disk: CMDB_EXTERNAL_SCC_STACKS)\n";
+#endif
   std::cout << " ---- SUMMARY ---- \n";
   std::cout << "Internal Memory Requirement = " << max_grid_internal_memory + max_scc_memory_internal << "\n";
   std::cout << "External Memory Requirement = " << max_grid_external_memory + max_scc_memory_external << "\n";
@@ -4,13 +4,23 @@
 #include <iostream>
 #include <exception>
 #include <vector>
+#include <algorithm>
 #include <random>
 #include "database/structures/ParameterSpace.h"
+#include "database/algorithms/parallelFor.h"
 
 #include "boost/shared_ptr.hpp"
 #include "boost/serialization/serialization.hpp"
 #include <boost/serialization/vector.hpp>
 #include "boost/serialization/export.hpp"
+#include "boost/thread.hpp"
+
+/// CMDB_PARAMETER_THREADS
+///   Number of threads computeAdjacencyLists uses to enumerate the
+///   parameter graph (0 means one per hardware thread)
+#ifndef CMDB_PARAMETER_THREADS
+#define CMDB_PARAMETER_THREADS 1
+#endif
 
 class AbstractParameterSpace : public ParameterSpace {
 public:
@@ -44,7 +54,8 @@ public:
 	///    This routine will call adjacency and populate the adjacency lists
 	///    It is expected this will be used for serialization of derived classes
 	///    where it is not expected the derived class will be recognized by the
-	///    loading program.
+	///    loading program. The vertices are handed to adjacencyBlock in blocks,
+	///    CMDB_PARAMETER_THREADS blocks at a time.
 	void computeAdjacencyLists ( void );
 
 private:
@@ -108,10 +119,23 @@ AbstractParameterSpace::computeAdjacencyLists ( void ) {
   abort ();
   // end debugf
   */
-  adjacency_lists_ . resize ( size () );
-	BOOST_FOREACH ( ParameterIndex v, *this ) {
-		adjacency_lists_ [ v ] = adjacencies ( v );
-	}
+  adjacency_lists_ . resize ( size_ );
+  int threads = CMDB_PARAMETER_THREADS;
+  if ( threads == 0 ) threads = boost::thread::hardware_concurrency ();
+  const uint64_t block = 4096;
+  uint64_t num_blocks = ( size_ + block - 1 ) / block;
+  // Each block writes only its own adjacency lists
+  parallelFor ( threads, num_blocks, [&] ( uint64_t b ) {
+    ParameterIndex begin = b * block;
+    ParameterIndex end = std::min ( size_, begin + block );
+    std::vector<uint64_t> offsets;
+    std::vector<ParameterIndex> targets;
+    adjacencyBlock ( begin, end, & offsets, & targets );
+    for ( ParameterIndex v = begin; v < end; ++ v ) {
+      adjacency_lists_ [ v ] . assign ( targets . begin () + offsets [ v - begin ],
+                                        targets . begin () + offsets [ v - begin + 1 ] );
+    }
+  } );
 }
 
 	
@@ -0,0 +1,251 @@
+// AdjacencyStore.h
+
+#ifndef CMDB_ADJACENCYSTORE_H
+#define CMDB_ADJACENCYSTORE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <exception>
+#include <stdexcept>
+
+/// class AdjacencyStore
+///   Memory-bounded store of adjacency lists, indexed by vertex.
+///   Lists may be inserted in any order (e.g. the DFS order of
+///   computeStrongComponents) and are appended to a single edge array;
+///   each vertex records an (offset, length) pair into that array.
+///   Once the edge array exceeds the memory budget it is either
+///   spilled to an anonymous temporary file (if spilling is enabled)
+///   or recording stops, in which case later lookups of unrecorded
+///   vertices simply miss and the caller recomputes them.
+///   The store keeps a count of successful lookups ("hits") so the
+///   number of avoided map evaluations can be reported.
+///   The memory budget covers the per-vertex index (12 bytes per vertex)
+///   as well as the in-memory edges. The store is not thread-safe: even
+///   fetch, though const, updates the counters and reads the shared spill
+///   file, so all calls must come from one thread at a time. It owns the
+///   spill file and so cannot be copied.
+class AdjacencyStore {
+public:
+  typedef uint64_t Vertex;
+
+  /// AdjacencyStore
+  ///   Construct an empty (disabled) store
+  AdjacencyStore ( void );
+
+  /// ~AdjacencyStore
+  ///   Close the spill file, if any.
+  ~AdjacencyStore ( void );
+
+  /// initialize
+  ///   Prepare the store for a graph with N vertices.
+  ///   memory_budget is the number of bytes allowed for the index and
+  ///   the in-memory edges.
+  ///   If spill is true, edges beyond the budget go to a temporary file.
+  void initialize ( uint64_t N, uint64_t memory_budget, bool spill );
+
+  /// clear
+  ///   Release all storage and disable the store
+  void clear ( void );
+
+  /// enabled
+  ///   Return true if the store has been initialized
+  bool enabled ( void ) const;
+
+  /// contains
+  ///   Return true if the adjacency list of v has been recorded
+  bool contains ( Vertex v ) const;
+
+  /// insert
+  ///   Record the adjacency list of v. Returns false if the list
+  ///   could not be recorded (budget exhausted and spilling disabled).
+  bool insert ( Vertex v, const std::vector<Vertex> & adjacencies );
+  template < class InputIterator >
+  bool insert ( Vertex v, InputIterator begin, InputIterator end );
+
+  /// fetch
+  ///   Copy the recorded adjacency list of v into *output.
+  ///   Returns false (and leaves *output untouched) if v is not recorded.
+  bool fetch ( Vertex v, std::vector<Vertex> * output ) const;
+
+  /// hits
+  ///   Return number of successful fetch calls
+  uint64_t hits ( void ) const;
+
+  /// misses
+  ///   Return number of unsuccessful fetch calls
+  uint64_t misses ( void ) const;
+
+  /// spilled
+  ///   Return number of edges that were written to disk
+  uint64_t spilled ( void ) const;
+
+  /// memory
+  ///   Return (approximate) number of bytes used in memory
+  uint64_t memory ( void ) const;
+
+private:
+  AdjacencyStore ( const AdjacencyStore & );
+  AdjacencyStore & operator = ( const AdjacencyStore & );
+  enum { NOT_STORED = 0xFFFFFFFFu };
+  void flush_ ( void );
+  std::vector<uint64_t> offset_;
+  std::vector<uint32_t> length_;
+  // edges [ file_edges_, file_edges_ + edges_.size() ) live in edges_
+  // edges [ 0, file_edges_ ) live in spill_file_
+  std::vector<Vertex> edges_;
+  uint64_t file_edges_;
+  std::FILE * spill_file_;
+  // bytes allowed for in-memory edges (the budget less the index)
+  uint64_t memory_budget_;
+  bool spill_;
+  bool full_;
+  mutable uint64_t hits_;
+  mutable uint64_t misses_;
+};
+
+inline
+AdjacencyStore::AdjacencyStore ( void ) :
+file_edges_ ( 0 ),
+spill_file_ ( NULL ),
+memory_budget_ ( 0 ),
+spill_ ( false ),
+full_ ( false ),
+hits_ ( 0 ),
+misses_ ( 0 ) {}
+
+inline
+AdjacencyStore::~AdjacencyStore ( void ) {
+  clear ();
+}
+
+inline void
+AdjacencyStore::initialize ( uint64_t N, uint64_t memory_budget, bool spill ) {
+  clear ();
+  offset_ . resize ( N, 0 );
+  length_ . resize ( N, (uint32_t) NOT_STORED );
+  uint64_t index_bytes = ( sizeof(uint64_t) + sizeof(uint32_t) ) * N;
+  memory_budget_ = memory_budget > index_bytes ? memory_budget - index_bytes : 0;
+  spill_ = spill;
+}
+
+inline void
+AdjacencyStore::clear ( void ) {
+  if ( spill_file_ != NULL ) {
+    std::fclose ( spill_file_ );
+    spill_file_ = NULL;
+  }
+  std::vector<uint64_t> () . swap ( offset_ );
+  std::vector<uint32_t> () . swap ( length_ );
+  std::vector<Vertex> () . swap ( edges_ );
+  file_edges_ = 0;
+  memory_budget_ = 0;
+  spill_ = false;
+  full_ = false;
+  hits_ = 0;
+  misses_ = 0;
+}
+
+inline bool
+AdjacencyStore::enabled ( void ) const {
+  return not length_ . empty ();
+}
+
+inline bool
+AdjacencyStore::contains ( Vertex v ) const {
+  return v < length_ . size () && length_ [ v ] != (uint32_t) NOT_STORED;
+}
+
+inline bool
+AdjacencyStore::insert ( Vertex v, const std::vector<Vertex> & adjacencies ) {
+  return insert ( v, adjacencies . begin (), adjacencies . end () );
+}
+
+template < class InputIterator > bool
+AdjacencyStore::insert ( Vertex v, InputIterator begin, InputIterator end ) {
+  if ( v >= length_ . size () ) return false;
+  if ( full_ ) return false;
+  uint64_t length = std::distance ( begin, end );
+  if ( sizeof(Vertex) * ( edges_ . size () + length ) > memory_budget_ ) {
+    if ( not spill_ ) {
+      full_ = true;
+      return false;
+    }
+    if ( spill_file_ == NULL ) {
+      spill_file_ = std::tmpfile ();
+      if ( spill_file_ == NULL ) {
+        // No temporary storage available; stop recording
+        full_ = true;
+        return false;
+      }
+    }
+    flush_ ();
+  }
+  offset_ [ v ] = file_edges_ + edges_ . size ();
+  length_ [ v ] = (uint32_t) length;
+  edges_ . insert ( edges_ . end (), begin, end );
+  return true;
+}
+
+inline bool
+AdjacencyStore::fetch ( Vertex v, std::vector<Vertex> * output ) const {
+  if ( not contains ( v ) ) {
+    ++ misses_;
+    return false;
+  }
+  ++ hits_;
+  uint64_t begin = offset_ [ v ];
+  uint64_t length = length_ [ v ];
+  output -> resize ( length );
+  if ( length == 0 ) return true;
+  if ( begin >= file_edges_ ) {
+    std::copy ( edges_ . begin () + ( begin - file_edges_ ),
+                edges_ . begin () + ( begin - file_edges_ + length ),
+                output -> begin () );
+    return true;
+  }
+  // Spilled list
+  if ( std::fseek ( spill_file_, (long) ( sizeof(Vertex) * begin ), SEEK_SET ) != 0 ||
+       std::fread ( &(*output)[0], sizeof(Vertex), length, spill_file_ ) != length ) {
+    throw std::runtime_error ( "AdjacencyStore::fetch. Unable to read spill file.\n" );
+  }
+  return true;
+}
+
+inline void
+AdjacencyStore::flush_ ( void ) {
+  if ( edges_ . empty () ) return;
+  if ( std::fseek ( spill_file_, 0, SEEK_END ) != 0 ||
+       std::fwrite ( &edges_[0], sizeof(Vertex), edges_ . size (), spill_file_ )
+         != edges_ . size () ) {
+    throw std::runtime_error ( "AdjacencyStore::flush_. Unable to write spill file.\n" );
+  }
+  file_edges_ += edges_ . size ();
+  edges_ . clear ();
+}
+
+inline uint64_t
+AdjacencyStore::hits ( void ) const {
+  return hits_;
+}
+
+inline uint64_t
+AdjacencyStore::misses ( void ) const {
+  return misses_;
+}
+
+inline uint64_t
+AdjacencyStore::spilled ( void ) const {
+  return file_edges_;
+}
+
+inline uint64_t
+AdjacencyStore::memory ( void ) const {
+  return sizeof(uint64_t) * offset_ . size () +
+         sizeof(uint32_t) * length_ . size () +
+         sizeof(Vertex) * edges_ . capacity ();
+}
+
+#endif
@@ -0,0 +1,78 @@
+/* AtomicFile.h */
+
+#ifndef CMDB_ATOMICFILE_H
+#define CMDB_ATOMICFILE_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <exception>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/// class AtomicFile
+///   Replaces a file so that it is never seen partially written. The data
+///   is written to "filename.tmp"; commit flushes it to disk (fsync) and
+///   renames it over filename. A process killed before commit returns
+///   leaves filename as it was. Errors throw std::runtime_error.
+class AtomicFile {
+public:
+  /// AtomicFile
+  ///   Create (or truncate) the temporary file for filename
+  AtomicFile ( const std::string & filename )
+    : filename_ ( filename ), temporary_ ( filename + ".tmp" ) {
+    file_ = std::fopen ( temporary_ . c_str (), "wb" );
+    if ( file_ == NULL ) {
+      throw std::runtime_error ( "AtomicFile. Could not open " + temporary_ + "\n" );
+    }
+  }
+
+  /// ~AtomicFile
+  ///   Discard the temporary file unless commit succeeded
+  ~AtomicFile ( void ) {
+    if ( file_ != NULL ) {
+      std::fclose ( file_ );
+      std::remove ( temporary_ . c_str () );
+    }
+  }
+
+  /// write
+  ///   Append bytes to the temporary file
+  void write ( const char * bytes, uint64_t size ) {
+    if ( size > 0 && std::fwrite ( bytes, 1, size, file_ ) != size ) {
+      throw std::runtime_error ( "AtomicFile. Error writing " + temporary_ + "\n" );
+    }
+  }
+
+  /// commit
+  ///   Flush the temporary file to disk and rename it over filename. The
+  ///   directory is synced too, so that the rename itself survives a crash.
+  void commit ( void ) {
+    bool ok = std::fflush ( file_ ) == 0 && fsync ( fileno ( file_ ) ) == 0;
+    ok = ( std::fclose ( file_ ) == 0 ) && ok;
+    file_ = NULL;
+    if ( not ok || std::rename ( temporary_ . c_str (), filename_ . c_str () ) != 0 ) {
+      std::remove ( temporary_ . c_str () );
+      throw std::runtime_error ( "AtomicFile. Could not replace " + filename_ + "\n" );
+    }
+    std::string::size_type slash = filename_ . rfind ( '/' );
+    std::string directory = ( slash == std::string::npos ) ? "." :
+                            filename_ . substr ( 0, slash + 1 );
+    int fd = ::open ( directory . c_str (), O_RDONLY );
+    if ( fd >= 0 ) {
+      fsync ( fd );
+      ::close ( fd );
+    }
+  }
+
+private:
+  AtomicFile ( const AtomicFile & );
+  AtomicFile & operator = ( const AtomicFile & );
+  std::string filename_;
+  std::string temporary_;
+  std::FILE * file_;
+};
+
+#endif
@@ -0,0 +1,82 @@
+// BoxBatch.h
+
+#ifndef CMDB_BOXBATCH_H
+#define CMDB_BOXBATCH_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "database/numerics/Real.h"
+#include "database/structures/RectGeo.h"
+
+/// class BoxBatch
+///   A batch of boxes in structure-of-arrays layout: lower ( d ) [ i ] and
+///   upper ( d ) [ i ] are the bounds of box i in coordinate d.
+///   Storage is kept when the batch is resized, so a batch which is reused
+///   between calls does not allocate once it has reached its largest size.
+///   Used by the batch interfaces of Map (evaluate) and Grid
+///   (batchGeometry, batchCover).
+class BoxBatch {
+public:
+  BoxBatch ( void ) : dimension_ ( 0 ), size_ ( 0 ), capacity_ ( 0 ) {}
+
+  /// resize
+  ///   Hold "size" boxes of dimension "dimension". Contents are unspecified
+  ///   afterwards.
+  void resize ( int dimension, uint64_t size ) {
+    dimension_ = dimension;
+    size_ = size;
+    if ( size > capacity_ ) capacity_ = size;
+    uint64_t length = (uint64_t) dimension * capacity_;
+    if ( lower_ . size () < length ) {
+      lower_ . resize ( length );
+      upper_ . resize ( length );
+    }
+  }
+
+  /// dimension
+  int dimension ( void ) const { return dimension_; }
+
+  /// size
+  ///   Number of boxes
+  uint64_t size ( void ) const { return size_; }
+
+  /// lower
+  ///   Array of lower bounds of coordinate d, indexed by box
+  Real * lower ( int d ) { return lower_ . data () + d * capacity_; }
+  const Real * lower ( int d ) const { return lower_ . data () + d * capacity_; }
+
+  /// upper
+  ///   Array of upper bounds of coordinate d, indexed by box
+  Real * upper ( int d ) { return upper_ . data () + d * capacity_; }
+  const Real * upper ( int d ) const { return upper_ . data () + d * capacity_; }
+
+  /// get
+  ///   Copy box i into *box (which keeps its storage if already sized)
+  void get ( uint64_t i, RectGeo * box ) const {
+    box -> lower_bounds . resize ( dimension_ );
+    box -> upper_bounds . resize ( dimension_ );
+    for ( int d = 0; d < dimension_; ++ d ) {
+      box -> lower_bounds [ d ] = lower ( d ) [ i ];
+      box -> upper_bounds [ d ] = upper ( d ) [ i ];
+    }
+  }
+
+  /// set
+  ///   Copy "box" into box i
+  void set ( uint64_t i, const RectGeo & box ) {
+    for ( int d = 0; d < dimension_; ++ d ) {
+      lower ( d ) [ i ] = box . lower_bounds [ d ];
+      upper ( d ) [ i ] = box . upper_bounds [ d ];
+    }
+  }
+
+private:
+  int dimension_;
+  uint64_t size_;
+  uint64_t capacity_;
+  std::vector < Real > lower_;
+  std::vector < Real > upper_;
+};
+
+#endif
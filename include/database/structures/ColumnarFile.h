@@ -0,0 +1,261 @@
+/* ColumnarFile.h */
+
+#ifndef CMDB_COLUMNARFILE_H
+#define CMDB_COLUMNARFILE_H
+
+#include <stdint.h>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <exception>
+#include <stdexcept>
+#include <fstream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "database/structures/AtomicFile.h"
+
+/// Columnar file format
+///   A file consists of a header, a section table, and the sections.
+///     header:        8 byte magic "CMDBCOL1", uint64_t number of sections
+///     section table: for each section, uint64_t id, offset, and size in bytes
+///     sections:      raw arrays, each starting at an 8-byte aligned offset
+///   All integers are stored in native (little-endian) byte order.
+///   Since every section is a flat array the file can be memory-mapped and
+///   used in place; see ColumnarFile.
+
+#define CMDB_COLUMNAR_MAGIC "CMDBCOL1"
+
+/// class ColumnarWriter
+///   Collects sections in memory and writes them out as a columnar file
+class ColumnarWriter {
+public:
+  /// add
+  ///   Add a section holding the array "data"
+  template < class T >
+  void add ( uint64_t id, const std::vector<T> & data ) {
+    add ( id, data . empty () ? NULL : (const char *) &data[0], sizeof(T) * data . size () );
+  }
+
+  /// add
+  ///   Add a section holding the given bytes
+  void add ( uint64_t id, const char * bytes, uint64_t size ) {
+    std::string & section = sections_ [ id ];
+    section . assign ( bytes, bytes + size );
+  }
+
+  /// write
+  ///   Write the columnar file. The file is replaced atomically (see
+  ///   AtomicFile), so an interrupted write leaves the previous version.
+  ///   Throws std::runtime_error on failure.
+  void write ( const char * filename ) const {
+    AtomicFile file ( filename );
+    uint64_t num_sections = sections_ . size ();
+    uint64_t offset = 16 + 24 * num_sections;
+    file . write ( CMDB_COLUMNAR_MAGIC, 8 );
+    file . write ( (const char *) &num_sections, 8 );
+    typedef std::pair < const uint64_t, std::string > Section;
+    for ( const Section & section : sections_ ) {
+      uint64_t size = section . second . size ();
+      file . write ( (const char *) &section . first, 8 );
+      file . write ( (const char *) &offset, 8 );
+      file . write ( (const char *) &size, 8 );
+      offset += padded_ ( size );
+    }
+    const char zeros [ 8 ] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for ( const Section & section : sections_ ) {
+      uint64_t size = section . second . size ();
+      file . write ( section . second . data (), size );
+      file . write ( zeros, padded_ ( size ) - size );
+    }
+    file . commit ();
+  }
+
+private:
+  static uint64_t padded_ ( uint64_t size ) { return ( size + 7 ) & ~((uint64_t)7); }
+  std::map < uint64_t, std::string > sections_;
+};
+
+/// class ColumnarFile
+///   Read-only, memory-mapped view of a columnar file. Sections are
+///   returned as pointers into the mapping, so they are valid only as long
+///   as the ColumnarFile exists. Pages are shared between processes mapping
+///   the same file.
+class ColumnarFile {
+public:
+  ColumnarFile ( void ) : data_ ( NULL ), size_ ( 0 ) {}
+  ColumnarFile ( const char * filename ) : data_ ( NULL ), size_ ( 0 ) { open ( filename ); }
+  ~ColumnarFile ( void ) { close (); }
+
+  /// isColumnar
+  ///   Return true if the file exists and begins with the columnar magic
+  static bool isColumnar ( const char * filename ) {
+    char magic [ 8 ];
+    std::ifstream ifs ( filename, std::ios::binary );
+    if ( not ifs . read ( magic, 8 ) ) return false;
+    return std::memcmp ( magic, CMDB_COLUMNAR_MAGIC, 8 ) == 0;
+  }
+
+  /// open
+  ///   Map the file. Throws std::runtime_error if it is not a columnar file.
+  void open ( const char * filename ) {
+    close ();
+    int fd = ::open ( filename, O_RDONLY );
+    if ( fd < 0 ) {
+      throw std::runtime_error ( std::string ( "ColumnarFile::open. Could not open " )
+                                 + filename + "\n" );
+    }
+    struct stat st;
+    if ( fstat ( fd, &st ) != 0 || st . st_size < 16 ) {
+      ::close ( fd );
+      throw std::runtime_error ( std::string ( "ColumnarFile::open. Bad file " )
+                                 + filename + "\n" );
+    }
+    size_ = st . st_size;
+    void * mapping = mmap ( NULL, size_, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close ( fd );
+    if ( mapping == MAP_FAILED ) {
+      size_ = 0;
+      throw std::runtime_error ( std::string ( "ColumnarFile::open. Could not map " )
+                                 + filename + "\n" );
+    }
+    data_ = (const char *) mapping;
+    if ( std::memcmp ( data_, CMDB_COLUMNAR_MAGIC, 8 ) != 0 ) {
+      close ();
+      throw std::runtime_error ( std::string ( "ColumnarFile::open. Not a columnar file: " )
+                                 + filename + "\n" );
+    }
+    const uint64_t * header = (const uint64_t *) data_;
+    uint64_t num_sections = header [ 1 ];
+    if ( 16 + 24 * num_sections > size_ ) {
+      close ();
+      throw std::runtime_error ( "ColumnarFile::open. Corrupt section table.\n" );
+    }
+    for ( uint64_t i = 0; i < num_sections; ++ i ) {
+      const uint64_t * entry = header + 2 + 3 * i;
+      if ( entry [ 1 ] + entry [ 2 ] > size_ ) {
+        close ();
+        throw std::runtime_error ( "ColumnarFile::open. Corrupt section table.\n" );
+      }
+      sections_ [ entry [ 0 ] ] = std::make_pair ( entry [ 1 ], entry [ 2 ] );
+    }
+  }
+
+  /// close
+  void close ( void ) {
+    if ( data_ != NULL ) munmap ( (void *) data_, size_ );
+    data_ = NULL;
+    size_ = 0;
+    sections_ . clear ();
+  }
+
+  /// has
+  ///   Return true if the file contains section id
+  bool has ( uint64_t id ) const {
+    return sections_ . count ( id ) != 0;
+  }
+
+  /// size
+  ///   Return number of elements of type T in section id (0 if absent)
+  template < class T >
+  uint64_t size ( uint64_t id ) const {
+    std::map < uint64_t, std::pair<uint64_t, uint64_t> >::const_iterator it = sections_ . find ( id );
+    if ( it == sections_ . end () ) return 0;
+    return it -> second . second / sizeof(T);
+  }
+
+  /// section
+  ///   Return pointer to the array stored in section id (NULL if absent)
+  template < class T >
+  const T * section ( uint64_t id ) const {
+    std::map < uint64_t, std::pair<uint64_t, uint64_t> >::const_iterator it = sections_ . find ( id );
+    if ( it == sections_ . end () ) return NULL;
+    return (const T *) ( data_ + it -> second . first );
+  }
+
+  /// read
+  ///   Copy section id into a vector
+  template < class T >
+  void read ( uint64_t id, std::vector<T> * output ) const {
+    const T * begin = section<T> ( id );
+    output -> assign ( begin, begin + size<T> ( id ) );
+  }
+
+private:
+  ColumnarFile ( const ColumnarFile & );
+  ColumnarFile & operator = ( const ColumnarFile & );
+  const char * data_;
+  uint64_t size_;
+  std::map < uint64_t, std::pair<uint64_t, uint64_t> > sections_;
+};
+
+/// ColumnarHash
+///   Hash function used for the hash tables stored in columnar files.
+///   Stored tables must be probed with the same function that built them,
+///   so this is defined here (FNV-1a over 64-bit words, with a final mix)
+///   rather than taken from boost::hash, whose values may change between
+///   Boost versions. Any change to it must increment
+///   CMDB_COLUMNAR_HASH_VERSION, which is stored alongside the tables.
+#define CMDB_COLUMNAR_HASH_VERSION 1
+
+class ColumnarHash {
+public:
+  ColumnarHash ( void ) : h_ ( 14695981039346656037ULL ) {}
+  void word ( uint64_t w ) { h_ = ( h_ ^ w ) * 1099511628211ULL; }
+  void chars ( const std::string & s ) {
+    word ( s . size () );
+    for ( uint64_t i = 0; i < s . size (); ++ i ) word ( (unsigned char) s [ i ] );
+  }
+  uint64_t value ( void ) const {
+    uint64_t h = h_;
+    h = ( h ^ ( h >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    h = ( h ^ ( h >> 27 ) ) * 0x94d049bb133111ebULL;
+    return h ^ ( h >> 31 );
+  }
+private:
+  uint64_t h_;
+};
+
+/// ColumnarHashTable
+///   Open-addressing (linear probing) hash table mapping records to their
+///   indices, stored as a flat array so it can be written to a columnar file
+///   and probed in place. Slot value 0 means empty; otherwise index + 1.
+///   The table size is a power of two at least twice the number of records.
+///   "hash_of(i)" must return the hash of record i.
+template < class HashOf >
+std::vector<uint64_t>
+buildColumnarHashTable ( uint64_t num_records, HashOf hash_of ) {
+  uint64_t capacity = 2;
+  while ( capacity < 2 * num_records ) capacity <<= 1;
+  std::vector<uint64_t> table ( capacity, 0 );
+  for ( uint64_t i = 0; i < num_records; ++ i ) {
+    uint64_t slot = hash_of ( i ) & ( capacity - 1 );
+    while ( table [ slot ] != 0 ) slot = ( slot + 1 ) & ( capacity - 1 );
+    table [ slot ] = i + 1;
+  }
+  return table;
+}
+
+/// probeColumnarHashTable
+///   Look up "item" in a table made by buildColumnarHashTable. "equals(i)"
+///   must test whether record i equals item. Returns the record index, or
+///   not_found if absent.
+template < class Equals >
+uint64_t
+probeColumnarHashTable ( const uint64_t * table, uint64_t capacity,
+                         uint64_t hash, Equals equals, uint64_t not_found ) {
+  if ( capacity == 0 ) return not_found;
+  uint64_t slot = hash & ( capacity - 1 );
+  while ( table [ slot ] != 0 ) {
+    if ( equals ( table [ slot ] - 1 ) ) return table [ slot ] - 1;
+    slot = ( slot + 1 ) & ( capacity - 1 );
+  }
+  return not_found;
+}
+
+#endif
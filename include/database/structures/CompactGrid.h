@@ -0,0 +1,144 @@
+// CompactGrid.h
+
+#ifndef CMDB_COMPACTGRID_H
+#define CMDB_COMPACTGRID_H
+
+#include <stdint.h>
+#include <vector>
+#include <fstream>
+#include <exception>
+#include "database/structures/TreeGrid.h"
+#include "database/structures/Tree.h"
+#include "database/structures/CompactTree.h"
+#include "boost/shared_ptr.hpp"
+#include "boost/serialization/serialization.hpp"
+#include "boost/serialization/vector.hpp"
+#include "boost/serialization/export.hpp"
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+/// class CompactGrid
+///   TreeGrid implementation over a CompactTree. Grid elements are the
+///   leaves of the tree in preorder (as in PointerGrid and SuccinctGrid);
+///   TreeToGrid reads the element from the leaf's node word, and
+///   GridToTree is a single 32-bit array. This comes to about 16 bytes per
+///   grid element, compared to about 72 for PointerGrid.
+///   To use it for phase space, put
+///     #include "database/structures/CompactGrid.h"
+///     #define PHASE_GRID CompactGrid
+///   in Model.h.
+class CompactGrid : public TreeGrid {
+public:
+  CompactGrid ( void );
+  virtual ~CompactGrid ( void );
+  virtual Tree::iterator GridToTree ( Grid::iterator it ) const;
+  virtual Grid::iterator TreeToGrid ( Tree::iterator it ) const;
+  virtual const CompactTree & tree ( void ) const;
+  virtual CompactTree & tree ( void );
+  virtual CompactGrid * spawn ( void ) const;
+  virtual CompactGrid * clone ( void ) const;
+  virtual void subdivide ( void );
+  virtual void rebuild ( boost::shared_ptr<const CompressedTreeGrid> compressed );
+  void rebuildFromTree ( void );
+private:
+  CompactTree tree_;
+  std::vector < uint32_t > tree_iterators_;
+public:
+  virtual uint64_t memory ( void ) const {
+    return sizeof ( CompactGrid ) +
+           tree_ . memory () - sizeof ( CompactTree ) +
+           sizeof ( uint32_t ) * tree_iterators_ . capacity ();
+  }
+
+  friend class boost::serialization::access;
+  template<typename Archive>
+  void serialize(Archive & ar, const unsigned int file_version) {
+    ar & boost::serialization::base_object<TreeGrid>(*this);
+    ar & tree_;
+    rebuildFromTree();
+  }
+  // file operations
+  void save ( const char * filename ) const {
+    std::ofstream ofs(filename);
+    assert(ofs.good());
+    boost::archive::text_oarchive oa(ofs);
+    oa << * this;
+  }
+
+  void load ( const char * filename ) {
+    std::ifstream ifs(filename);
+    if ( not ifs . good () ) {
+      std::cout << "Could not load " << filename << "\n";
+      exit ( 1 );
+    }
+    boost::archive::text_iarchive ia(ifs);
+    ia >> * this;
+  }
+};
+
+BOOST_CLASS_EXPORT_KEY(CompactGrid);
+
+inline
+CompactGrid::CompactGrid ( void ) {
+  rebuildFromTree ();
+}
+
+inline
+CompactGrid::~CompactGrid ( void ) {
+}
+
+inline Grid::iterator
+CompactGrid::TreeToGrid ( Tree::iterator tree_it ) const {
+  if ( not tree_ . isLeaf ( tree_it ) ) return end ();
+  return Grid::iterator ( tree_ . leafIndex ( tree_it ) );
+}
+
+inline Tree::iterator
+CompactGrid::GridToTree ( Grid::iterator grid_it ) const {
+  return Tree::iterator ( tree_iterators_ [ * grid_it ] );
+}
+
+inline const CompactTree &
+CompactGrid::tree ( void ) const {
+  return tree_;
+}
+
+inline CompactTree &
+CompactGrid::tree ( void ) {
+  return tree_;
+}
+
+inline CompactGrid *
+CompactGrid::spawn ( void ) const {
+  return new CompactGrid;
+}
+
+inline CompactGrid *
+CompactGrid::clone ( void ) const {
+  return new CompactGrid ( *this );
+}
+
+inline void
+CompactGrid::subdivide ( void ) {
+  tree_ . subdivide ();
+  rebuildFromTree ();
+}
+
+inline void
+CompactGrid::rebuild ( boost::shared_ptr<const CompressedTreeGrid> compressed ) {
+  rebuildFromTree ();
+}
+
+inline void
+CompactGrid::rebuildFromTree ( void ) {
+  tree_iterators_ . assign ( tree_ . leafCount (), 0 );
+  Tree::iterator end = tree_ . end ();
+  for ( Tree::iterator it = tree_ . begin (); it != end; ++ it ) {
+    if ( tree_ . isLeaf ( it ) ) {
+      tree_iterators_ [ tree_ . leafIndex ( it ) ] = * it;
+    }
+  }
+  size_ = tree_ . leafCount ();
+}
+
+#endif
@@ -0,0 +1,211 @@
+/// CompactTree.h
+
+#ifndef CMDB_COMPACTTREE_H
+#define CMDB_COMPACTTREE_H
+
+#include <stdint.h>
+#include <vector>
+#include <stack>
+#include <exception>
+#include <stdexcept>
+#include "boost/shared_ptr.hpp"
+#include "database/structures/Tree.h"
+#include "database/structures/CompressedTree.h"
+#include "boost/serialization/serialization.hpp"
+#include "boost/serialization/vector.hpp"
+
+/// CompactTree
+///   Flat binary tree with one 32-bit word per node.
+///   The root is node 0. The children of a node are allocated as a pair
+///   of adjacent slots ( 2k+1, 2k+2 ), so right == left + 1 and a node is
+///   a left child exactly when its index is odd. The parent is stored once
+///   per pair. The node word holds either
+///     the index of the left child (internal node),
+///     LEAF | (index of the leaf among the leaves, in preorder), or
+///     ABSENT (an empty child slot; left/right return end () for it).
+///   Compared to PointerTree this uses 6 bytes per node instead of about 24,
+///   and the leaf/grid element mapping is read from the same word.
+///   Trees are limited to 2^32 - 1 nodes and 2^31 - 1 leaves.
+class CompactTree : public Tree {
+public:
+  enum : uint32_t { ABSENT = 0xFFFFFFFF, LEAF = 0x80000000 };
+
+  CompactTree ( void );
+  virtual ~CompactTree ( void );
+  virtual iterator parent ( iterator it ) const;
+  virtual iterator left ( iterator it ) const;
+  virtual iterator right ( iterator it ) const;
+  virtual bool isLeft ( iterator it ) const;
+  virtual bool isRight ( iterator it ) const;
+  virtual bool isLeaf ( iterator it ) const;
+  virtual void assign ( boost::shared_ptr<const CompressedTree> compressed );
+  virtual uint64_t memory ( void ) const;
+
+  /// leafIndex
+  ///   Return the preorder index of a leaf among the leaves of the tree
+  uint64_t leafIndex ( iterator it ) const;
+
+  /// leafCount
+  ///   Return the number of leaves
+  uint64_t leafCount ( void ) const;
+
+  /// subdivide
+  ///   Give every leaf two leaf children, appended as a new slot pair.
+  ///   The children of leaf k become leaves 2k and 2k+1, so leaves stay
+  ///   numbered in preorder.
+  void subdivide ( void );
+
+private:
+  std::vector < uint32_t > nodes_;
+  std::vector < uint32_t > parents_;
+  uint64_t leaf_count_;
+  friend class boost::serialization::access;
+  template<typename Archive>
+  void serialize(Archive & ar, const unsigned int file_version);
+};
+
+// CompactTree Definitions
+inline
+CompactTree::CompactTree ( void ) {
+  nodes_ . push_back ( LEAF | 0 );
+  leaf_count_ = 1;
+  size_ = 1;
+}
+
+inline
+CompactTree::~CompactTree ( void ) {
+}
+
+inline Tree::iterator
+CompactTree::parent ( iterator it ) const {
+  if ( *it == 0 ) return end ();
+  return Tree::iterator ( parents_ [ ( *it - 1 ) >> 1 ] );
+}
+
+inline Tree::iterator
+CompactTree::left ( iterator it ) const {
+  uint32_t word = nodes_ [ *it ];
+  if ( word & LEAF ) return end ();
+  if ( nodes_ [ word ] == ABSENT ) return end ();
+  return Tree::iterator ( word );
+}
+
+inline Tree::iterator
+CompactTree::right ( iterator it ) const {
+  uint32_t word = nodes_ [ *it ];
+  if ( word & LEAF ) return end ();
+  if ( nodes_ [ word + 1 ] == ABSENT ) return end ();
+  return Tree::iterator ( word + 1 );
+}
+
+inline bool
+CompactTree::isLeft ( iterator it ) const {
+  return not isRight ( it );
+}
+
+inline bool
+CompactTree::isRight ( iterator it ) const {
+  return *it != 0 && ( *it & 1 ) == 0;
+}
+
+inline bool
+CompactTree::isLeaf ( iterator it ) const {
+  uint32_t word = nodes_ [ *it ];
+  return ( word & LEAF ) && word != ABSENT;
+}
+
+inline uint64_t
+CompactTree::leafIndex ( iterator it ) const {
+  return nodes_ [ *it ] & ~LEAF;
+}
+
+inline uint64_t
+CompactTree::leafCount ( void ) const {
+  return leaf_count_;
+}
+
+inline void
+CompactTree::assign ( boost::shared_ptr<const CompressedTree> compressed ) {
+  const bool LEAF_BIT = false;
+  const std::vector<bool> & leaf_sequence =
+    compressed -> leaf_sequence;
+  const std::vector<bool> & valid_sequence =
+    compressed -> valid_sequence;
+  size_t N = leaf_sequence . size ();
+  nodes_ . clear ();
+  parents_ . clear ();
+  leaf_count_ = 0;
+  size_ = 0;
+  if ( compressed -> leafCount () == 0 ) return;
+  if ( N >= (size_t) ABSENT || compressed -> leafCount () >= (size_t) LEAF ) {
+    throw std::length_error ( "CompactTree::assign. Tree too large for 32-bit indices.\n" );
+  }
+  // Each node of the full tree fills one slot, so N slots suffice
+  nodes_ . reserve ( N );
+  parents_ . reserve ( N / 2 );
+  nodes_ . push_back ( ABSENT );
+  // Slots still to be filled, in preorder
+  std::stack < uint32_t > pending;
+  pending . push ( 0 );
+  uint64_t last_encountered_leaf = 0;
+  for ( size_t i = 0; i < N; ++ i ) {
+    uint32_t node = pending . top ();
+    pending . pop ();
+    if ( leaf_sequence [ i ] == LEAF_BIT ) {
+      if ( valid_sequence [ last_encountered_leaf ++ ] ) {
+        nodes_ [ node ] = LEAF | (uint32_t) leaf_count_ ++;
+      }
+      continue;
+    }
+    uint32_t child = nodes_ . size ();
+    nodes_ [ node ] = child;
+    nodes_ . push_back ( ABSENT );
+    nodes_ . push_back ( ABSENT );
+    parents_ . push_back ( node );
+    pending . push ( child + 1 );
+    pending . push ( child );
+  }
+  size_ = nodes_ . size ();
+}
+
+inline void
+CompactTree::subdivide ( void ) {
+  uint64_t old_size = nodes_ . size ();
+  uint64_t new_size = old_size + 2 * leaf_count_;
+  if ( new_size >= (uint64_t) ABSENT || 2 * leaf_count_ >= (uint64_t) LEAF ) {
+    throw std::length_error ( "CompactTree::subdivide. Tree too large for 32-bit indices.\n" );
+  }
+  nodes_ . resize ( new_size );
+  parents_ . reserve ( parents_ . size () + leaf_count_ );
+  uint32_t child = old_size;
+  for ( uint32_t i = 0; i < old_size; ++ i ) {
+    uint32_t word = nodes_ [ i ];
+    if ( not ( word & LEAF ) || word == ABSENT ) continue;
+    uint32_t leaf = word & ~LEAF;
+    nodes_ [ i ] = child;
+    nodes_ [ child ] = LEAF | ( 2 * leaf );
+    nodes_ [ child + 1 ] = LEAF | ( 2 * leaf + 1 );
+    parents_ . push_back ( i );
+    child += 2;
+  }
+  leaf_count_ *= 2;
+  size_ = new_size;
+}
+
+inline uint64_t
+CompactTree::memory ( void ) const {
+  return sizeof ( CompactTree ) +
+         sizeof ( uint32_t ) * nodes_ . capacity () +
+         sizeof ( uint32_t ) * parents_ . capacity ();
+}
+
+template<typename Archive> void
+CompactTree::serialize ( Archive & ar,
+                         const unsigned int file_version ) {
+  ar & boost::serialization::base_object<Tree>(*this);
+  ar & nodes_;
+  ar & parents_;
+  ar & leaf_count_;
+}
+
+#endif
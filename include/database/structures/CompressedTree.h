@@ -1,6 +1,10 @@
 #ifndef CMDB_COMPRESSED_TREE_H
 #define CMDB_COMPRESSED_TREE_H
 //CompressedTree.h
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
 class CompressedTree {
 public:
   /// leaf_sequence
@@ -27,44 +31,39 @@ public:
 
 inline size_t 
 CompressedTree::leafCount ( void ) const {
-  size_t result = 0;
-  size_t N = valid_sequence . size ();
-  for ( size_t i = 0; i < N; ++ i ) if ( valid_sequence [ i ] ) ++ result;
-  return result;
+  return std::count ( valid_sequence . begin (), valid_sequence . end (), true );
 }
 
 inline void 
 CompressedTree::subdivide ( void ) {
-  //std::cout << "CompressedTree::subdivide\n";
-  CompressedTree new_tree;
-  std::vector < bool > & new_leaf_sequence
-    = new_tree . leaf_sequence;
-  std::vector < bool > & new_valid_sequence
-    = new_tree . valid_sequence;
-
+  // The result has exactly 2 more nodes and 1 more leaf per valid leaf,
+  // so it is written into pre-sized, zero-filled sequences: only the
+  // 1 bits need to be set, and nothing is reallocated.
   size_t M = leaf_sequence . size ();
-  uint64_t leaf = 0;
-  for ( size_t i = 0; i < M; ++ i ) {
-    if ( leaf_sequence [ i ] ) {
+  size_t V = valid_sequence . size ();
+  size_t L = leafCount ();
+  std::vector < bool > new_leaf_sequence ( M + 2 * L, false );
+  std::vector < bool > new_valid_sequence ( V + L, false );
+  std::vector<bool>::const_iterator valid = valid_sequence . begin ();
+  std::vector<bool>::iterator new_leaf = new_leaf_sequence . begin ();
+  std::vector<bool>::iterator new_valid = new_valid_sequence . begin ();
+  for ( std::vector<bool>::const_iterator it = leaf_sequence . begin (); 
+        it != leaf_sequence . end (); ++ it ) {
+    if ( *it ) {
       // Not a leaf. Copy.
-      new_leaf_sequence . push_back ( 1 );
+      *new_leaf ++ = true;
+    } else if ( *valid ++ ) {
+      // The leaf is valid. Subdivide it.
+      *new_leaf = true;
+      new_leaf += 3;
+      *new_valid ++ = true;
+      *new_valid ++ = true;
     } else {
-      // This is a leaf. If it is valid, subdivide it
-      if ( valid_sequence [ leaf ++ ] ) {
-        // The leaf is valid. Subdivide it.
-        new_leaf_sequence . push_back ( 1 );
-        new_leaf_sequence . push_back ( 0 );
-        new_leaf_sequence . push_back ( 0 );
-        new_valid_sequence . push_back ( 1 );
-        new_valid_sequence . push_back ( 1 );
-      } else {
-        // The leaf is not valid. Do not subdivide. Mark as invalid.
-        new_leaf_sequence . push_back ( 0 );
-        new_valid_sequence . push_back ( 0 );
-      }
+      // The leaf is not valid. Do not subdivide. Mark as invalid.
+      ++ new_leaf;
+      ++ new_valid;
     }
   }
-
   std::swap ( leaf_sequence, new_leaf_sequence );
   std::swap ( valid_sequence, new_valid_sequence );
 }
@@ -5,6 +5,8 @@
 
 #include <cstddef>
 #include <vector>
+#include <algorithm>
+#include <sstream>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -33,10 +35,13 @@
 #include "database/structures/Grid.h"
 #include "database/structures/SuccinctGrid.h"
 #include "database/structures/PointerGrid.h"
+#include "database/structures/CompactGrid.h"
 #include "database/structures/UniformGrid.h"
 #include "database/structures/EdgeGrid.h"
 
 #include "database/structures/MorseGraph.h"
+#include "database/structures/ColumnarFile.h"
+#include "database/structures/AtomicFile.h"
 
 #include "boost/archive/binary_iarchive.hpp"
 #include "boost/archive/binary_oarchive.hpp"
@@ -388,15 +393,15 @@ private:
   std::vector < BG_Data > bg_data_;
   std::vector < CS_Data > cs_data_;
   std::vector < CI_Data > ci_data_;
-  std::unordered_map < std::string, uint64_t > string_index_;
-  std::unordered_map < Annotation_Record, uint64_t, boost::hash<Annotation_Record> > annotation_index_;
-  std::unordered_map < MorseGraphRecord, uint64_t, boost::hash<MorseGraphRecord> > morsegraph_index_;
-  std::unordered_map < DAG_Data, uint64_t, boost::hash<DAG_Data> > dag_index_;
-  std::unordered_map < BG_Data, uint64_t, boost::hash<BG_Data> > bg_index_;
-  std::unordered_map < CS_Data, uint64_t, boost::hash<CS_Data> > cs_index_;
-  std::unordered_map < CI_Data, uint64_t, boost::hash<CI_Data> > ci_index_;
+  mutable std::unordered_map < std::string, uint64_t > string_index_;
+  mutable std::unordered_map < Annotation_Record, uint64_t, boost::hash<Annotation_Record> > annotation_index_;
+  mutable std::unordered_map < MorseGraphRecord, uint64_t, boost::hash<MorseGraphRecord> > morsegraph_index_;
+  mutable std::unordered_map < DAG_Data, uint64_t, boost::hash<DAG_Data> > dag_index_;
+  mutable std::unordered_map < BG_Data, uint64_t, boost::hash<BG_Data> > bg_index_;
+  mutable std::unordered_map < CS_Data, uint64_t, boost::hash<CS_Data> > cs_index_;
+  mutable std::unordered_map < CI_Data, uint64_t, boost::hash<CI_Data> > ci_index_;
   // continuation data
-  std::unordered_map < INCCP_Record, uint64_t, boost::hash<INCCP_Record> > inccp_index_;
+  mutable std::unordered_map < INCCP_Record, uint64_t, boost::hash<INCCP_Record> > inccp_index_;
   std::vector < uint64_t > pb_to_mgccp_;
   std::vector < uint64_t > mgccp_to_mgcc_;
   std::vector < uint64_t > inccp_to_incc_;
@@ -409,9 +414,12 @@ private:
   std::vector < INCCP_Record > INCCP_records_;
   std::vector < MGCC_Record > MGCC_records_;
   std::vector < INCC_Record > INCC_records_;
+  // false if the xxx_index_ maps have not been built (after loadColumnar)
+  mutable bool indexed_;
+  void index_ ( void ) const;
 
 public:
-  Database ( void ) {}
+  Database ( void ) : indexed_ ( true ) {}
 
   /// merge
   ///    merge the contents of another database into this one
@@ -473,8 +481,36 @@ public:
   void postprocess ( void );
   void makeAttractorsMinimal ( void );
   void performTransitiveReductions ( void );
-  void save ( const char * filename );   
+
+  /// save
+  ///   Save the database. The columnar format (see MappedDatabase.h) is used
+  ///   unless CMDB_ARCHIVE_DATABASE is defined, in which case it is a
+  ///   boost binary archive.
+  void save ( const char * filename );
+
+  /// load
+  ///   Load a database saved in either format (detected from the file)
   void load ( const char * filename );
+
+  /// saveColumnar
+  ///   Save in the memory-mappable columnar format. The file is replaced
+  ///   atomically (see AtomicFile.h), so an interrupted save leaves the
+  ///   previous version in place.
+  void saveColumnar ( const char * filename ) const;
+
+  /// loadColumnar
+  ///   Load a database saved by saveColumnar. The lookup indices
+  ///   are rebuilt lazily, on the first insert or xxxIndex call.
+  void loadColumnar ( const char * filename );
+
+  /// saveArchive
+  ///   Save as a boost binary archive, replacing the file atomically
+  ///   as saveColumnar does
+  void saveArchive ( const char * filename );
+
+  /// loadArchive
+  ///   Load a database saved by saveArchive
+  void loadArchive ( const char * filename );
   
   const ParameterSpace & parameter_space ( void ) const { return *parameter_space_;}
  
@@ -500,21 +536,21 @@ public:
   const std::vector < CI_Data > & ciData ( void ) const 
     { return ci_data_; }
   uint64_t morsegraphIndex ( MorseGraphRecord const& item ) const 
-    { if ( morsegraph_index_ . count ( item ) == 0 ) return morsegraphData().size(); return morsegraph_index_ . find (item) -> second; }
+    { index_ (); if ( morsegraph_index_ . count ( item ) == 0 ) return morsegraphData().size(); return morsegraph_index_ . find (item) -> second; }
   uint64_t stringIndex ( std::string const& item ) const 
-    { if ( string_index_ . count ( item ) == 0 ) return stringData().size(); return string_index_ . find (item) -> second; }
+    { index_ (); if ( string_index_ . count ( item ) == 0 ) return stringData().size(); return string_index_ . find (item) -> second; }
   uint64_t annotationIndex ( Annotation_Record const& item ) const 
-    { if ( annotation_index_ . count ( item ) == 0 ) return annotationData().size(); return annotation_index_ . find (item) -> second; }
+    { index_ (); if ( annotation_index_ . count ( item ) == 0 ) return annotationData().size(); return annotation_index_ . find (item) -> second; }
   uint64_t dagIndex ( DAG_Data const& item ) const 
-    { if ( dag_index_ . count ( item ) == 0 ) return dagData().size(); return dag_index_ . find (item) -> second; }
+    { index_ (); if ( dag_index_ . count ( item ) == 0 ) return dagData().size(); return dag_index_ . find (item) -> second; }
   uint64_t bgIndex ( BG_Data const& item ) const 
-    { if ( bg_index_ . count ( item ) == 0 ) return bgData().size(); return bg_index_ . find (item) -> second; }
+    { index_ (); if ( bg_index_ . count ( item ) == 0 ) return bgData().size(); return bg_index_ . find (item) -> second; }
   uint64_t csIndex ( CS_Data const& item ) const 
-    { if ( cs_index_ . count ( item ) == 0 ) return csData().size(); return cs_index_ . find (item) -> second; }
+    { index_ (); if ( cs_index_ . count ( item ) == 0 ) return csData().size(); return cs_index_ . find (item) -> second; }
   uint64_t ciIndex ( CI_Data const& item ) const 
-    { if ( ci_index_ . count ( item ) == 0 ) return ciData().size(); return ci_index_ . find (item) -> second; }
+    { index_ (); if ( ci_index_ . count ( item ) == 0 ) return ciData().size(); return ci_index_ . find (item) -> second; }
   uint64_t inccpIndex ( INCCP_Record const& item ) const 
-    { if ( inccp_index_ . count ( item ) == 0 ) return INCCP_Records().size(); return inccp_index_ . find (item) -> second; }
+    { index_ (); if ( inccp_index_ . count ( item ) == 0 ) return INCCP_Records().size(); return inccp_index_ . find (item) -> second; }
 
 
   const std::vector < uint64_t > & pb_to_mgccp ( void ) const { return pb_to_mgccp_; }
@@ -534,6 +570,7 @@ public:
 
   template<class Archive>
   void serialize(Archive& ar, const unsigned int version) {
+    if ( Archive::is_saving::value ) index_ ();
     bool has_space = (bool) parameter_space_;
     ar & boost::serialization::make_nvp("HASPARAMETERSPACE", has_space);
     if ( has_space ) {
@@ -568,6 +605,7 @@ public:
     ar & boost::serialization::make_nvp("INCCSIZES", incc_sizes_);
     ar & boost::serialization::make_nvp("MGCCNB", mgcc_nb_);
     ar & boost::serialization::make_nvp("INCCCONLEY",incc_conley_);
+    indexed_ = true;
   }
    bool is_identity ( const MorseGraphRecord & mgr1, 
                       const MorseGraphRecord & mgr2, 
@@ -609,6 +647,7 @@ namespace std{
 // annotation data
 // morse graph data
 inline void Database::merge ( const Database & other ) {
+  index_ ();
   std::vector < uint64_t > dag_reindex ( other . dag_data_ . size () );
   std::vector < uint64_t > bg_reindex ( other . bg_data_ . size () );
   std::vector < uint64_t > string_reindex ( other . string_data_ . size () );
@@ -675,6 +714,7 @@ inline void Database::insert ( boost::shared_ptr<ParameterSpace> parameter_space
 }
 
 inline uint64_t Database::insert ( const DAG_Data & dag ) {
+  index_ ();
   if ( dag_index_ . count ( dag ) == 0 ) {
     dag_index_ [ dag ] = dag_data_ . size ();
     dag_data_ . push_back ( dag );
@@ -684,6 +724,7 @@ inline uint64_t Database::insert ( const DAG_Data & dag ) {
 
 
 inline uint64_t Database::insert ( const std::string & s ) {
+  index_ ();
   if ( string_index_ . count ( s ) == 0 ) {
     string_index_ [ s ] = string_data_ . size ();
     string_data_ . push_back ( s );
@@ -692,6 +733,7 @@ inline uint64_t Database::insert ( const std::string & s ) {
 }
 
 inline uint64_t Database::insert ( const Annotation_Record & ar ) {
+  index_ ();
   if ( annotation_index_ . count ( ar ) == 0 ) {
     annotation_index_ [ ar ] = annotation_data_ . size ();
     annotation_data_ . push_back ( ar );
@@ -708,6 +750,7 @@ inline uint64_t Database::insert ( const std::set<std::string> & annotation ) {
 }
 
 inline uint64_t Database::insert ( const MorseGraphRecord & mgr ) {
+  index_ ();
   if ( morsegraph_index_ . count ( mgr ) == 0 ) {
     morsegraph_index_ [ mgr ] = morsegraph_data_ . size ();
     morsegraph_data_ . push_back ( mgr );
@@ -744,6 +787,7 @@ inline void Database::insert ( uint64_t p, const MorseGraph & mg ) {
 }
 
 inline uint64_t Database::insert ( const BG_Data & bg ) {
+  index_ ();
   if ( bg_index_ . count ( bg ) == 0 ) {
     bg_index_ [ bg ] = bg_data_ . size ();
     bg_data_ . push_back ( bg );
@@ -752,6 +796,7 @@ inline uint64_t Database::insert ( const BG_Data & bg ) {
 }
 
 inline uint64_t Database::insert ( const CS_Data & cs ) {
+  index_ ();
   if ( cs_index_ . count ( cs ) == 0 ) {
     cs_index_ [ cs ] = cs_data_ . size ();
     cs_data_ . push_back ( cs );
@@ -760,6 +805,7 @@ inline uint64_t Database::insert ( const CS_Data & cs ) {
 }
 
 inline uint64_t Database::insert ( const CI_Data & ci ) {
+  index_ ();
   if ( ci_index_ . count ( ci ) == 0 ) {
     ci_index_ [ ci ] = ci_data_ . size ();
     ci_data_ . push_back ( ci );
@@ -895,6 +941,7 @@ inline void Database::postprocess ( void ) {
   typedef uint64_t ParameterIndex;
 
   uint64_t N = parameter_space_ -> size ();
+  index_ ();
 
   std::cout << "Database::postprocess\n";
   std::cout << " Number of parameters = " << N << "\n";
@@ -1178,13 +1225,20 @@ inline void Database::postprocess ( void ) {
   
   // mgcc_nb: stored adjacency structure of mgcc's
   mgcc_nb_ . resize ( MGCC_Records () . size () );
-  BOOST_FOREACH ( ParameterIndex pb, parameter_space () ) {
-    if ( pb_to_mgccp_[pb] == MGCCP_Records () . size () ) continue;
-    std::vector<ParameterIndex> nbs = parameter_space () . adjacencies ( pb );
-    BOOST_FOREACH ( ParameterIndex nb, nbs ) {
-      if ( nb == pb ) continue;
-      if ( pb_to_mgccp_[nb] == MGCCP_Records () . size () ) continue;
-      mgcc_nb_ [ mgccp_to_mgcc_[pb_to_mgccp_[pb]] ] . insert ( mgccp_to_mgcc_[pb_to_mgccp_[nb]] );
+  const uint64_t block = 4096;
+  std::vector<uint64_t> offsets;
+  std::vector<ParameterIndex> targets;
+  for ( ParameterIndex begin = 0; begin < N; begin += block ) {
+    ParameterIndex end = std::min ( N, begin + block );
+    parameter_space () . adjacencyBlock ( begin, end, & offsets, & targets );
+    for ( ParameterIndex pb = begin; pb < end; ++ pb ) {
+      if ( pb_to_mgccp_[pb] == MGCCP_Records () . size () ) continue;
+      for ( uint64_t k = offsets [ pb - begin ]; k < offsets [ pb - begin + 1 ]; ++ k ) {
+        ParameterIndex nb = targets [ k ];
+        if ( nb == pb ) continue;
+        if ( pb_to_mgccp_[nb] == MGCCP_Records () . size () ) continue;
+        mgcc_nb_ [ mgccp_to_mgcc_[pb_to_mgccp_[pb]] ] . insert ( mgccp_to_mgcc_[pb_to_mgccp_[nb]] );
+      }
     }
   }
 
@@ -1265,6 +1319,7 @@ inline void Database::makeAttractorsMinimal ( void ) {
 
 inline void Database::performTransitiveReductions ( void ) {
   // tricky part: to update the dags, we need to update the lookup table too
+  index_ ();
   for ( uint64_t dag_index = 0; dag_index < dag_data_ . size (); ++ dag_index ) {
     DAG_Data & dag = dag_data_ [ dag_index ];
     dag_index_ . erase ( dag );
@@ -1303,19 +1358,72 @@ inline const std::vector < INCC_Record > & Database::INCC_Records ( void ) const
 
 
 
+// lookup indices
+inline void Database::index_ ( void ) const {
+  if ( indexed_ ) return;
+  indexed_ = true;
+  string_index_ . clear ();
+  string_index_ . reserve ( string_data_ . size () );
+  for ( uint64_t i = 0; i < string_data_ . size (); ++ i ) string_index_ [ string_data_ [ i ] ] = i;
+  annotation_index_ . clear ();
+  annotation_index_ . reserve ( annotation_data_ . size () );
+  for ( uint64_t i = 0; i < annotation_data_ . size (); ++ i ) annotation_index_ [ annotation_data_ [ i ] ] = i;
+  morsegraph_index_ . clear ();
+  morsegraph_index_ . reserve ( morsegraph_data_ . size () );
+  for ( uint64_t i = 0; i < morsegraph_data_ . size (); ++ i ) morsegraph_index_ [ morsegraph_data_ [ i ] ] = i;
+  dag_index_ . clear ();
+  dag_index_ . reserve ( dag_data_ . size () );
+  for ( uint64_t i = 0; i < dag_data_ . size (); ++ i ) dag_index_ [ dag_data_ [ i ] ] = i;
+  bg_index_ . clear ();
+  bg_index_ . reserve ( bg_data_ . size () );
+  for ( uint64_t i = 0; i < bg_data_ . size (); ++ i ) bg_index_ [ bg_data_ [ i ] ] = i;
+  cs_index_ . clear ();
+  cs_index_ . reserve ( cs_data_ . size () );
+  for ( uint64_t i = 0; i < cs_data_ . size (); ++ i ) cs_index_ [ cs_data_ [ i ] ] = i;
+  ci_index_ . clear ();
+  ci_index_ . reserve ( ci_data_ . size () );
+  for ( uint64_t i = 0; i < ci_data_ . size (); ++ i ) ci_index_ [ ci_data_ [ i ] ] = i;
+  inccp_index_ . clear ();
+  inccp_index_ . reserve ( INCCP_records_ . size () );
+  for ( uint64_t i = 0; i < INCCP_records_ . size (); ++ i ) inccp_index_ [ INCCP_records_ [ i ] ] = i;
+}
+
 // file operations
 inline void Database::save ( const char * filename ) {
+#ifdef CMDB_ARCHIVE_DATABASE
+  saveArchive ( filename );
+#else
   std::cout << "Database SAVE\n";
-  std::ofstream ofs(filename);
-  assert(ofs.good());
-  boost::archive::binary_oarchive oa(ofs);
-      //boost::archive::text_oarchive oa(ofs);
-      //boost::archive::xml_oarchive oa(ofs);
-  oa << boost::serialization::make_nvp("database", * this);
-      //ofs . close ();
+  saveColumnar ( filename );
+#endif
 }
 
 inline void Database::load ( const char * filename ) {
+  if ( ColumnarFile::isColumnar ( filename ) ) {
+    std::cout << "Database LOAD\n";
+    loadColumnar ( filename );
+  } else {
+    loadArchive ( filename );
+  }
+}
+
+inline void Database::saveArchive ( const char * filename ) {
+  std::cout << "Database SAVE\n";
+  // Serialized in memory first so the file can be replaced atomically
+  std::ostringstream oss;
+  {
+  boost::archive::binary_oarchive oa(oss);
+      //boost::archive::text_oarchive oa(oss);
+      //boost::archive::xml_oarchive oa(oss);
+  oa << boost::serialization::make_nvp("database", * this);
+  }
+  std::string bytes = oss . str ();
+  AtomicFile file ( filename );
+  file . write ( bytes . data (), bytes . size () );
+  file . commit ();
+}
+
+inline void Database::loadArchive ( const char * filename ) {
   std::cout << "Database LOAD\n";
   std::ifstream ifs(filename);
   if ( not ifs . good () ) {
@@ -1331,4 +1439,6 @@ inline void Database::load ( const char * filename ) {
       //ifs . close ();
 }
 
+#include "database/structures/MappedDatabase.h"
+
 #endif
@@ -0,0 +1,285 @@
+/* DatabaseMerger.h */
+
+#ifndef CMDB_DATABASEMERGER_H
+#define CMDB_DATABASEMERGER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <exception>
+#include <stdexcept>
+
+#include "boost/shared_ptr.hpp"
+#include "boost/function.hpp"
+#include "boost/thread.hpp"
+#include "boost/foreach.hpp"
+#include "boost/archive/binary_iarchive.hpp"
+#include "boost/archive/binary_oarchive.hpp"
+
+#include "database/structures/Database.h"
+
+/// class DatabaseMerger
+///   Merges job result databases into a target Database on a background
+///   thread, so the coordinator returns to its message loop immediately.
+///   Results that arrive while a merge is in progress are taken as one
+///   batch on the next pass.
+///   Results are pushed as the bytes of a binary archive of the job
+///   Database (see serialize), exactly as received from the worker, and
+///   are deserialized on the merge thread. If a log file is given, those
+///   bytes are appended to it verbatim (length-prefixed) before the
+///   result is merged; nothing is re-serialized. Replaying the
+///   log over the database it was started from reproduces the merged
+///   database, so a checkpoint only needs to flush the log rather than
+///   serialize the whole database.
+///   The target must not be accessed by other threads except between a
+///   call to flush () (or stop ()) and the next push (), or from a task
+///   given to post ().
+class DatabaseMerger {
+public:
+  typedef boost::shared_ptr<const std::string> BytesPtr;
+  typedef boost::function<void(void)> Task;
+
+  DatabaseMerger ( void );
+  ~DatabaseMerger ( void );
+
+  /// start
+  ///   Begin merging into *target. If log_filename is nonempty, results
+  ///   are appended to that file (which is created if necessary).
+  void start ( Database * target, const std::string & log_filename = std::string () );
+
+  /// push
+  ///   Queue a job database, given as the bytes produced by serialize,
+  ///   for merging
+  void push ( BytesPtr job_bytes );
+
+  /// post
+  ///   Queue a task to run on the merge thread once every database pushed
+  ///   before it has been merged (and logged, with the log flushed).
+  ///   The task may read or write the target, e.g. to save a checkpoint.
+  void post ( Task task );
+
+  /// flush
+  ///   Block until every queued database has been merged and logged.
+  ///   Rethrows an exception raised on the merge thread.
+  void flush ( void );
+
+  /// stop
+  ///   Flush and join the merge thread
+  void stop ( void );
+
+  /// merged
+  ///   Number of databases merged so far
+  uint64_t merged ( void ) const;
+
+  /// replay
+  ///   Merge every database recorded in a log into *target.
+  ///   Returns the number of records read; a truncated final record
+  ///   (e.g. from a crash mid-write) is ignored.
+  static uint64_t replay ( const std::string & log_filename, Database * target );
+
+  /// serialize
+  ///   The binary archive of a job database, as sent in a result message
+  static std::string serialize ( const Database & job_database );
+
+  /// deserialize
+  ///   Read a job database from the bytes produced by serialize
+  static void deserialize ( const std::string & bytes, Database * job_database );
+
+private:
+  void run_ ( void );
+  void log_ ( const std::string & job_bytes );
+  struct Item {
+    BytesPtr job_bytes;
+    Task task;
+  };
+  Database * target_;
+  std::ofstream log_file_;
+  std::deque < Item > queue_;
+  boost::shared_ptr<boost::thread> thread_;
+  mutable boost::mutex mutex_;
+  boost::condition_variable work_available_;
+  boost::condition_variable work_done_;
+  bool busy_;
+  bool stopping_;
+  uint64_t merged_;
+  std::exception_ptr error_;
+};
+
+inline
+DatabaseMerger::DatabaseMerger ( void ) :
+target_ ( NULL ),
+busy_ ( false ),
+stopping_ ( false ),
+merged_ ( 0 ) {}
+
+inline
+DatabaseMerger::~DatabaseMerger ( void ) {
+  try {
+    stop ();
+  } catch ( ... ) {}
+}
+
+inline void
+DatabaseMerger::start ( Database * target, const std::string & log_filename ) {
+  stop ();
+  target_ = target;
+  stopping_ = false;
+  error_ = std::exception_ptr ();
+  if ( not log_filename . empty () ) {
+    log_file_ . open ( log_filename . c_str (), std::ios::binary | std::ios::app );
+    if ( not log_file_ . good () ) {
+      throw std::runtime_error ( "DatabaseMerger::start. Could not open " + log_filename + "\n" );
+    }
+  }
+  thread_ . reset ( new boost::thread ( &DatabaseMerger::run_, this ) );
+}
+
+inline void
+DatabaseMerger::push ( BytesPtr job_bytes ) {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  if ( error_ ) std::rethrow_exception ( error_ );
+  if ( not thread_ ) {
+    throw std::logic_error ( "DatabaseMerger::push. Merger not started.\n" );
+  }
+  Item item;
+  item . job_bytes = job_bytes;
+  queue_ . push_back ( item );
+  work_available_ . notify_one ();
+}
+
+inline void
+DatabaseMerger::post ( Task task ) {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  if ( error_ ) std::rethrow_exception ( error_ );
+  if ( not thread_ ) {
+    throw std::logic_error ( "DatabaseMerger::post. Merger not started.\n" );
+  }
+  Item item;
+  item . task = task;
+  queue_ . push_back ( item );
+  work_available_ . notify_one ();
+}
+
+inline void
+DatabaseMerger::flush ( void ) {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  while ( busy_ || not queue_ . empty () ) {
+    if ( error_ ) break;
+    work_done_ . wait ( lock );
+  }
+  if ( log_file_ . is_open () ) log_file_ . flush ();
+  if ( error_ ) std::rethrow_exception ( error_ );
+}
+
+inline void
+DatabaseMerger::stop ( void ) {
+  if ( not thread_ ) return;
+  {
+    boost::mutex::scoped_lock lock ( mutex_ );
+    stopping_ = true;
+    work_available_ . notify_one ();
+  }
+  thread_ -> join ();
+  thread_ . reset ();
+  if ( log_file_ . is_open () ) log_file_ . close ();
+  if ( error_ ) std::rethrow_exception ( error_ );
+}
+
+inline uint64_t
+DatabaseMerger::merged ( void ) const {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  return merged_;
+}
+
+inline void
+DatabaseMerger::run_ ( void ) {
+  std::deque < Item > batch;
+  while ( 1 ) {
+    {
+      boost::mutex::scoped_lock lock ( mutex_ );
+      busy_ = false;
+      work_done_ . notify_all ();
+      while ( queue_ . empty () && not stopping_ ) work_available_ . wait ( lock );
+      if ( queue_ . empty () ) return;
+      batch . swap ( queue_ );
+      busy_ = true;
+    }
+    uint64_t count = 0;
+    try {
+      BOOST_FOREACH ( const Item & item, batch ) {
+        if ( item . job_bytes ) {
+          if ( log_file_ . is_open () ) log_ ( *item . job_bytes );
+          Database job_database;
+          deserialize ( *item . job_bytes, &job_database );
+          target_ -> merge ( job_database );
+          ++ count;
+        }
+        if ( item . task ) {
+          if ( log_file_ . is_open () ) log_file_ . flush ();
+          item . task ();
+        }
+      }
+    } catch ( ... ) {
+      boost::mutex::scoped_lock lock ( mutex_ );
+      error_ = std::current_exception ();
+      queue_ . clear ();
+      busy_ = false;
+      work_done_ . notify_all ();
+      return;
+    }
+    boost::mutex::scoped_lock lock ( mutex_ );
+    merged_ += count;
+    batch . clear ();
+  }
+}
+
+inline void
+DatabaseMerger::log_ ( const std::string & job_bytes ) {
+  uint64_t size = job_bytes . size ();
+  log_file_ . write ( (const char *) &size, sizeof(uint64_t) );
+  log_file_ . write ( job_bytes . data (), size );
+  if ( not log_file_ . good () ) {
+    throw std::runtime_error ( "DatabaseMerger::log_. Error writing database log.\n" );
+  }
+}
+
+inline uint64_t
+DatabaseMerger::replay ( const std::string & log_filename, Database * target ) {
+  std::ifstream ifs ( log_filename . c_str (), std::ios::binary );
+  uint64_t count = 0;
+  if ( not ifs . good () ) return count;
+  std::string bytes;
+  while ( 1 ) {
+    uint64_t size;
+    if ( not ifs . read ( (char *) &size, sizeof(uint64_t) ) ) break;
+    bytes . resize ( size );
+    if ( size > 0 && not ifs . read ( &bytes[0], size ) ) break;
+    Database job_database;
+    deserialize ( bytes, &job_database );
+    target -> merge ( job_database );
+    ++ count;
+  }
+  return count;
+}
+
+inline std::string
+DatabaseMerger::serialize ( const Database & job_database ) {
+  std::ostringstream oss;
+  {
+    boost::archive::binary_oarchive oa ( oss );
+    oa << job_database;
+  }
+  return oss . str ();
+}
+
+inline void
+DatabaseMerger::deserialize ( const std::string & bytes, Database * job_database ) {
+  std::istringstream iss ( bytes );
+  boost::archive::binary_iarchive ia ( iss );
+  ia >> *job_database;
+}
+
+#endif
@@ -8,6 +8,14 @@
 
 #include "database/structures/ParameterSpace.h"
 #include "database/structures/RectGeo.h"
+#include "database/algorithms/parallelFor.h"
+
+#include <vector>
+#include <stack>
+#include <cmath>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
 
 #include "boost/shared_ptr.hpp"
 #include "boost/serialization/serialization.hpp"
@@ -87,6 +95,22 @@ public:
 	///    and the edge between them.
 	virtual boost::shared_ptr<ParameterPatch> patch ( void ) const;
 
+  /// adaptPatches
+  ///    Replace the uniform patches (about patch_width_ boxes across) by as
+  ///    many patches of roughly equal estimated cost. The lattice of
+  ///    PARAM_SUBDIV_SIZES cells is cut into blocks of stride^d cells and
+  ///    probe ( v ) is called (on num_threads threads) for one parameter v
+  ///    near the middle of each block; its value stands for the cost of every
+  ///    parameter of the block. The lattice is then bisected recursively,
+  ///    each cut splitting the cost in proportion to the number of patches
+  ///    on either side and, among the cuts which do so well enough, crossing
+  ///    the fewest cells, so that patches stay compact and the boxes shared
+  ///    by neighbouring patches (which are computed twice) stay few. Patches
+  ///    are at least patch_width_ / 2 cells across, so that a few costly
+  ///    boxes are not spread over many patches.
+  template < class Probe >
+  void adaptPatches ( const Probe & probe, int stride, int num_threads );
+
   /// dimension
   ///    Return dimension of parameter space
   int dimension ( void ) const;
@@ -108,6 +132,19 @@ private:
   mutable std::vector<int> coordinates_;
   mutable bool finished_;
 
+// Adaptive patches (see adaptPatches), used by the coordinator only
+  std::vector<uint64_t> lattice_;
+  std::vector<RectGeo> tiles_;
+  mutable size_t next_tile_;
+
+  // Rectangle of the lattice cells lo [ d ] <= x [ d ] <= hi [ d ], i.e. of
+  // a piece lo [ d ] <= x [ d ] < hi [ d ] and the cells just above it. The
+  // pieces tile the lattice, so neighbouring patches share one layer of
+  // boxes, and any two adjacent boxes lie in the patch of the piece holding
+  // their lowest corner.
+  RectGeo latticeGeo_ ( const std::vector<uint64_t> & lo,
+                        const std::vector<uint64_t> & hi ) const;
+
   // Serialization
   friend class boost::serialization::access;
   template<class Archive>
@@ -194,6 +231,11 @@ EuclideanParameterSpace::initialize ( const Configuration & config,
   coordinates_ . resize ( config.PARAM_DIM, 0);
   finished_ = false;
 
+  // Uniform patches until adaptPatches is called
+  lattice_ = config.PARAM_SUBDIV_SIZES;
+  tiles_ . clear ();
+  next_tile_ = 0;
+
 }
 
 inline std::vector<uint64_t> 
@@ -258,31 +300,52 @@ EuclideanParameterSpace::patch ( void ) const {
   //std::cout << "EuclideanParameterSpace::patch dimension_ = " << dimension_ << "\n";
 
   boost::shared_ptr<ParameterPatch> result ( new ParameterPatch );
-  if ( finished_ ) {
-  	finished_ = false;
-  	return result;
-  }
-
-  // Determine a rectangle based on "coordinates"
   RectGeo geo ( dimension_ );
-  for ( int d = 0; d < dimension_; ++ d ) {
-	 // tol included for robustness
-  	double tol = (bounds_.upper_bounds[d] - bounds_.lower_bounds[d]) 
-                   /(double)(1000000000.0);
-    geo . lower_bounds [ d ] = 
-        bounds_.lower_bounds[d]+((double)coordinates_[d])*
-        (bounds_.upper_bounds[d]-bounds_.lower_bounds[d]) 
-        /(double)patches_across_[d] - tol;
-    geo . upper_bounds [ d ] = 
-        bounds_.lower_bounds[d]+((double)(1+coordinates_[d]))*
-        (bounds_.upper_bounds[d]-bounds_.lower_bounds[d])
-        /(double)patches_across_[d] + tol;
+  if ( not tiles_ . empty () ) {
+    // Adaptive patches
+    if ( next_tile_ == tiles_ . size () ) {
+      next_tile_ = 0;
+      return result;
+    }
+    geo = tiles_ [ next_tile_ ++ ];
+  } else {
+    if ( finished_ ) {
+    	finished_ = false;
+    	return result;
+    }
+
+    // Determine a rectangle based on "coordinates"
+    for ( int d = 0; d < dimension_; ++ d ) {
+  	 // tol included for robustness
+    	double tol = (bounds_.upper_bounds[d] - bounds_.lower_bounds[d]) 
+                     /(double)(1000000000.0);
+      geo . lower_bounds [ d ] = 
+          bounds_.lower_bounds[d]+((double)coordinates_[d])*
+          (bounds_.upper_bounds[d]-bounds_.lower_bounds[d]) 
+          /(double)patches_across_[d] - tol;
+      geo . upper_bounds [ d ] = 
+          bounds_.lower_bounds[d]+((double)(1+coordinates_[d]))*
+          (bounds_.upper_bounds[d]-bounds_.lower_bounds[d])
+          /(double)patches_across_[d] + tol;
       
-    if ( not periodic_ [ d ] ) {
-      if ( geo . lower_bounds [ d ] < bounds_ . lower_bounds [ d ] ) 
-        geo . lower_bounds [ d ] = bounds_ . lower_bounds [ d ];
-      if ( geo . upper_bounds [ d ] > bounds_. upper_bounds [ d ] ) 
-        geo . upper_bounds [ d ] = bounds_ . upper_bounds [ d ];
+      if ( not periodic_ [ d ] ) {
+        if ( geo . lower_bounds [ d ] < bounds_ . lower_bounds [ d ] ) 
+          geo . lower_bounds [ d ] = bounds_ . lower_bounds [ d ];
+        if ( geo . upper_bounds [ d ] > bounds_. upper_bounds [ d ] ) 
+          geo . upper_bounds [ d ] = bounds_ . upper_bounds [ d ];
+      }
+    }
+
+    // Odometer step (multidimensional loop iteration)
+    finished_ = true;
+    for ( int d = 0; d < dimension_; ++ d ) {
+      ++ coordinates_ [ d ];
+      if ( coordinates_ [ d ] == patches_across_ [ d ] ) {
+        coordinates_ [ d ] = 0;
+      } else {
+        finished_ = false;
+        break;
+      }
     }
   }
    
@@ -313,20 +376,198 @@ EuclideanParameterSpace::patch ( void ) const {
     }
   }
 
-  // Odometer step (multidimensional loop iteration)
-  finished_ = true;
+  return result;
+#endif
+}
+
+template < class Probe > void
+EuclideanParameterSpace::adaptPatches ( const Probe & probe, 
+                                        int stride,
+                                        int num_threads ) {
+  if ( lattice_ . size () != (size_t) dimension_ ) {
+    throw std::logic_error ( "EuclideanParameterSpace::adaptPatches. Parameter space is not initialized.\n" );
+  }
+  if ( stride < 1 ) stride = 1;
+  // Cells and blocks of the lattice, numbered with the first coordinate fastest
+  std::vector<uint64_t> blocks ( dimension_ );
+  std::vector<uint64_t> place ( dimension_ );
+  uint64_t num_cells = 1;
+  uint64_t num_blocks = 1;
+  uint64_t num_patches = 1;
   for ( int d = 0; d < dimension_; ++ d ) {
-    ++ coordinates_ [ d ];
-    if ( coordinates_ [ d ] == patches_across_ [ d ] ) {
-      coordinates_ [ d ] = 0;
-    } else {
-      finished_ = false;
-      break;
+    blocks [ d ] = ( lattice_ [ d ] + stride - 1 ) / stride;
+    place [ d ] = num_cells;
+    num_cells *= lattice_ [ d ];
+    num_blocks *= blocks [ d ];
+    num_patches *= patches_across_ [ d ];
+  }
+
+  // Probe one parameter per block, at the center of its middle cell
+  std::vector<double> block_cost ( num_blocks, 0.0 );
+  parallelFor ( num_threads, num_blocks, [&] ( uint64_t b ) {
+    RectGeo point ( dimension_ );
+    uint64_t rest = b;
+    for ( int d = 0; d < dimension_; ++ d ) {
+      uint64_t lo = ( rest % blocks [ d ] ) * stride;
+      uint64_t hi = std::min ( lattice_ [ d ], lo + stride );
+      rest /= blocks [ d ];
+      double x = (double) ( ( lo + hi - 1 ) / 2 ) + 0.5;
+      point . lower_bounds [ d ] = point . upper_bounds [ d ] = 
+        bounds_ . lower_bounds [ d ] + x * 
+        ( bounds_ . upper_bounds [ d ] - bounds_ . lower_bounds [ d ] ) / (double) lattice_ [ d ];
+    }
+    std::vector<uint64_t> vertices = parameter_grid_ -> cover ( point );
+    if ( not vertices . empty () ) block_cost [ b ] = probe ( vertices [ 0 ] );
+  } );
+
+  // Cost of each cell. Every cell gets a little cost, so that parts of
+  // parameter space probed at no cost are still tiled by volume.
+  std::vector<double> cost ( num_cells );
+  double total = 0.0;
+  std::vector<uint64_t> x ( dimension_, 0 );
+  for ( uint64_t c = 0; c < num_cells; ++ c ) {
+    uint64_t b = 0;
+    uint64_t block_place = 1;
+    for ( int d = 0; d < dimension_; ++ d ) {
+      b += block_place * ( x [ d ] / stride );
+      block_place *= blocks [ d ];
+    }
+    cost [ c ] = block_cost [ b ];
+    total += cost [ c ];
+    for ( int d = 0; d < dimension_; ++ d ) {
+      if ( ++ x [ d ] < lattice_ [ d ] ) break;
+      x [ d ] = 0;
+    }
+  }
+  double base = ( total > 0.0 ? total : 1.0 ) / (double) num_cells / 1000.0;
+  for ( uint64_t c = 0; c < num_cells; ++ c ) cost [ c ] += base;
+
+  // Recursive bisection: each piece of the lattice is to become k patches
+  struct Piece {
+    std::vector<uint64_t> lo;
+    std::vector<uint64_t> hi;
+    uint64_t k;
+  };
+  tiles_ . clear ();
+  next_tile_ = 0;
+  uint64_t min_extent = std::max ( 1, patch_width_ / 2 );
+  // Most patches a piece can be cut into
+  auto capacity = [&] ( const Piece & piece ) {
+    uint64_t result = 1;
+    for ( int d = 0; d < dimension_; ++ d ) {
+      result *= std::max ( (uint64_t) 1, ( piece . hi [ d ] - piece . lo [ d ] ) / min_extent );
+    }
+    return result;
+  };
+  double max_cost = 0.0;
+  std::stack < Piece > work;
+  work . push ( Piece { std::vector<uint64_t> ( dimension_, 0 ), lattice_, num_patches } );
+  work . top () . k = std::min ( num_patches, capacity ( work . top () ) );
+  while ( not work . empty () ) {
+    Piece piece = work . top ();
+    work . pop ();
+    // Cost of the piece and of its slices across each dimension
+    std::vector < std::vector < double > > slices ( dimension_ );
+    uint64_t volume = 1;
+    for ( int d = 0; d < dimension_; ++ d ) {
+      slices [ d ] . assign ( piece . hi [ d ] - piece . lo [ d ], 0.0 );
+      volume *= piece . hi [ d ] - piece . lo [ d ];
+    }
+    double piece_cost = 0.0;
+    x = piece . lo;
+    for ( uint64_t i = 0; i < volume; ++ i ) {
+      uint64_t c = 0;
+      for ( int d = 0; d < dimension_; ++ d ) c += place [ d ] * x [ d ];
+      piece_cost += cost [ c ];
+      for ( int d = 0; d < dimension_; ++ d ) slices [ d ] [ x [ d ] - piece . lo [ d ] ] += cost [ c ];
+      for ( int d = 0; d < dimension_; ++ d ) {
+        if ( ++ x [ d ] < piece . hi [ d ] ) break;
+        x [ d ] = piece . lo [ d ];
+      }
+    }
+    // Choose the cut. The imbalance is measured in patches: a cut is
+    // balanced when it is off by at most a quarter of a patch's cost.
+    int cut_d = -1;
+    uint64_t cut_at = 0;
+    double cut_cost = 0.0;
+    double cut_imbalance = 0.0;
+    uint64_t cut_area = 0;
+    double target = piece_cost * (double) ( piece . k / 2 ) / (double) piece . k;
+    for ( int d = 0; piece . k > 1 && d < dimension_; ++ d ) {
+      uint64_t extent = piece . hi [ d ] - piece . lo [ d ];
+      if ( extent < 2 * min_extent ) continue;
+      double prefix = 0.0;
+      double best_prefix = 0.0;
+      uint64_t best_at = 0;
+      for ( uint64_t at = 1; at + min_extent <= extent; ++ at ) {
+        prefix += slices [ d ] [ at - 1 ];
+        if ( at < min_extent ) continue;
+        if ( best_at == 0 || std::fabs ( prefix - target ) < std::fabs ( best_prefix - target ) ) {
+          best_prefix = prefix;
+          best_at = at;
+        }
+      }
+      double imbalance = std::fabs ( best_prefix - target ) * (double) piece . k / piece_cost;
+      uint64_t area = volume / extent;
+      bool balanced = imbalance <= 0.25;
+      bool better = cut_d == -1 ||
+        ( balanced != ( cut_imbalance <= 0.25 ) ? balanced :
+          ( balanced ? area < cut_area : imbalance < cut_imbalance ) );
+      if ( better ) {
+        cut_d = d;
+        cut_at = piece . lo [ d ] + best_at;
+        cut_cost = best_prefix;
+        cut_imbalance = imbalance;
+        cut_area = area;
+      }
+    }
+    if ( cut_d == -1 ) {
+      tiles_ . push_back ( latticeGeo_ ( piece . lo, piece . hi ) );
+      max_cost = std::max ( max_cost, piece_cost );
+      continue;
     }
+    // Share out the patches in proportion to the cost on either side, 
+    // as far as the sides can take them
+    Piece first = piece;
+    Piece second = piece;
+    first . hi [ cut_d ] = cut_at;
+    second . lo [ cut_d ] = cut_at;
+    int64_t k = (int64_t) piece . k;
+    int64_t k1 = (int64_t) std::floor ( (double) k * cut_cost / piece_cost + 0.5 );
+    k1 = std::max ( k1, k - (int64_t) capacity ( second ) );
+    k1 = std::min ( k1, (int64_t) capacity ( first ) );
+    k1 = std::max ( (int64_t) 1, std::min ( k - 1, k1 ) );
+    first . k = k1;
+    second . k = std::min ( k - k1, (int64_t) capacity ( second ) );
+    work . push ( second );
+    work . push ( first );
   }
+  std::cout << "EuclideanParameterSpace::adaptPatches. " << tiles_ . size () 
+    << " patches, estimated cost per patch: mean " 
+    << ( total + base * num_cells ) / (double) tiles_ . size ()
+    << ", max " << max_cost << "\n";
+}
 
-  return result;
-#endif
+inline RectGeo
+EuclideanParameterSpace::latticeGeo_ ( const std::vector<uint64_t> & lo,
+                                       const std::vector<uint64_t> & hi ) const {
+  RectGeo geo ( dimension_ );
+  for ( int d = 0; d < dimension_; ++ d ) {
+    // tol included for robustness
+    double width = bounds_.upper_bounds[d] - bounds_.lower_bounds[d];
+    double tol = width / (double)(1000000000.0);
+    geo . lower_bounds [ d ] = bounds_.lower_bounds[d] + 
+      (double) lo [ d ] * width / (double) lattice_ [ d ] + tol;
+    geo . upper_bounds [ d ] = bounds_.lower_bounds[d] + 
+      (double) hi [ d ] * width / (double) lattice_ [ d ] + tol;
+    if ( not periodic_ [ d ] ) {
+      if ( geo . lower_bounds [ d ] < bounds_ . lower_bounds [ d ] ) 
+        geo . lower_bounds [ d ] = bounds_ . lower_bounds [ d ];
+      if ( geo . upper_bounds [ d ] > bounds_. upper_bounds [ d ] ) 
+        geo . upper_bounds [ d ] = bounds_ . upper_bounds [ d ];
+    }
+  }
+  return geo;
 }
 
 
@@ -0,0 +1,210 @@
+// ExternalStack.h
+
+#ifndef CMDB_EXTERNALSTACK_H
+#define CMDB_EXTERNALSTACK_H
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <exception>
+#include <stdexcept>
+
+/// CMDB_EXTERNAL_STACK_BLOCK
+///   Size in bytes of the blocks an ExternalStack writes to and reads from
+///   its temporary file. At most two blocks (plus one read cache) of each
+///   stack are held in memory.
+#ifndef CMDB_EXTERNAL_STACK_BLOCK
+#define CMDB_EXTERNAL_STACK_BLOCK (((uint64_t)1) << 20)
+#endif
+
+/// class ExternalStack
+///   Stack of plain-old-data values backed by an anonymous temporary file.
+///   The top of the stack (between one and two blocks) is kept in memory;
+///   when it fills two blocks the lower one is written to the file, and
+///   when it empties the last block is read back, so each block crosses
+///   the file once per push or pop of a block's worth of values, and all
+///   I/O is in whole blocks. Provides the part of the std::deque interface
+///   the stacks of computeStrongComponents use, plus operator [], which is
+///   cheap for sequential (forward or backward) access.
+template < class T >
+class ExternalStack {
+public:
+  typedef T value_type;
+  typedef uint64_t size_type;
+
+  /// ExternalStack
+  ///   Construct an empty stack. The file is created on the first spill.
+  ExternalStack ( uint64_t block_bytes = CMDB_EXTERNAL_STACK_BLOCK );
+
+  /// ~ExternalStack
+  ///   Close the file, if any.
+  ~ExternalStack ( void );
+
+  /// push_back
+  void push_back ( const T & value );
+
+  /// pop_back
+  void pop_back ( void );
+
+  /// back
+  const T & back ( void ) const;
+
+  /// operator []
+  ///   Element i, counting from the bottom of the stack
+  const T & operator [] ( uint64_t i ) const;
+
+  /// size
+  uint64_t size ( void ) const;
+
+  /// empty
+  bool empty ( void ) const;
+
+  /// clear
+  ///   Empty the stack (the file is kept for reuse)
+  void clear ( void );
+
+  /// swap
+  void swap ( ExternalStack & other );
+
+  /// spilled
+  ///   Return number of elements currently on disk
+  uint64_t spilled ( void ) const;
+
+  /// memory
+  ///   Return (approximate) number of bytes used in memory
+  uint64_t memory ( void ) const;
+
+private:
+  ExternalStack ( const ExternalStack & );
+  ExternalStack & operator = ( const ExternalStack & );
+  void write_ ( const T * data, uint64_t position );
+  void read_ ( T * data, uint64_t position ) const;
+  uint64_t block_;
+  // elements [ 0, file_size_ ) live in file_, in blocks of block_ elements
+  // elements [ file_size_, size () ) live in top_
+  std::vector<T> top_;
+  uint64_t file_size_;
+  std::FILE * file_;
+  // block of the file starting at element cache_begin_, for operator []
+  mutable std::vector<T> cache_;
+  mutable uint64_t cache_begin_;
+};
+
+template < class T >
+ExternalStack<T>::ExternalStack ( uint64_t block_bytes ) :
+  block_ ( std::max ( (uint64_t) 1, block_bytes / sizeof ( T ) ) ),
+  file_size_ ( 0 ),
+  file_ ( NULL ),
+  cache_begin_ ( std::numeric_limits<uint64_t>::max () ) {
+}
+
+template < class T >
+ExternalStack<T>::~ExternalStack ( void ) {
+  if ( file_ != NULL ) std::fclose ( file_ );
+}
+
+template < class T > void
+ExternalStack<T>::push_back ( const T & value ) {
+  top_ . push_back ( value );
+  if ( top_ . size () < 2 * block_ ) return;
+  if ( file_ == NULL ) {
+    file_ = std::tmpfile ();
+    if ( file_ == NULL ) {
+      throw std::runtime_error ( "ExternalStack::push_back. Unable to create temporary file.\n" );
+    }
+  }
+  write_ ( &top_[0], file_size_ );
+  if ( cache_begin_ == file_size_ ) cache_begin_ = std::numeric_limits<uint64_t>::max ();
+  file_size_ += block_;
+  std::copy ( top_ . begin () + block_, top_ . end (), top_ . begin () );
+  top_ . resize ( block_ );
+}
+
+template < class T > void
+ExternalStack<T>::pop_back ( void ) {
+  top_ . pop_back ();
+  if ( top_ . empty () && file_size_ > 0 ) {
+    file_size_ -= block_;
+    top_ . resize ( block_ );
+    if ( cache_begin_ == file_size_ ) {
+      std::copy ( cache_ . begin (), cache_ . end (), top_ . begin () );
+    } else {
+      read_ ( &top_[0], file_size_ );
+    }
+  }
+}
+
+template < class T > const T &
+ExternalStack<T>::back ( void ) const {
+  return top_ . back ();
+}
+
+template < class T > const T &
+ExternalStack<T>::operator [] ( uint64_t i ) const {
+  if ( i >= file_size_ ) return top_ [ i - file_size_ ];
+  uint64_t begin = i - i % block_;
+  if ( cache_begin_ != begin ) {
+    cache_ . resize ( block_ );
+    read_ ( &cache_[0], begin );
+    cache_begin_ = begin;
+  }
+  return cache_ [ i - begin ];
+}
+
+template < class T > uint64_t
+ExternalStack<T>::size ( void ) const {
+  return file_size_ + top_ . size ();
+}
+
+template < class T > bool
+ExternalStack<T>::empty ( void ) const {
+  return top_ . empty ();
+}
+
+template < class T > void
+ExternalStack<T>::clear ( void ) {
+  top_ . clear ();
+  file_size_ = 0;
+  cache_begin_ = std::numeric_limits<uint64_t>::max ();
+}
+
+template < class T > void
+ExternalStack<T>::swap ( ExternalStack & other ) {
+  std::swap ( block_, other . block_ );
+  top_ . swap ( other . top_ );
+  std::swap ( file_size_, other . file_size_ );
+  std::swap ( file_, other . file_ );
+  cache_ . swap ( other . cache_ );
+  std::swap ( cache_begin_, other . cache_begin_ );
+}
+
+template < class T > uint64_t
+ExternalStack<T>::spilled ( void ) const {
+  return file_size_;
+}
+
+template < class T > uint64_t
+ExternalStack<T>::memory ( void ) const {
+  return sizeof ( ExternalStack ) +
+         sizeof ( T ) * ( top_ . capacity () + cache_ . capacity () );
+}
+
+template < class T > void
+ExternalStack<T>::write_ ( const T * data, uint64_t position ) {
+  if ( std::fseek ( file_, (long) ( sizeof(T) * position ), SEEK_SET ) != 0 ||
+       std::fwrite ( data, sizeof(T), block_, file_ ) != block_ ) {
+    throw std::runtime_error ( "ExternalStack::write_. Unable to write temporary file.\n" );
+  }
+}
+
+template < class T > void
+ExternalStack<T>::read_ ( T * data, uint64_t position ) const {
+  if ( std::fseek ( file_, (long) ( sizeof(T) * position ), SEEK_SET ) != 0 ||
+       std::fread ( data, sizeof(T), block_, file_ ) != block_ ) {
+    throw std::runtime_error ( "ExternalStack::read_. Unable to read temporary file.\n" );
+  }
+}
+
+#endif
@@ -9,6 +9,8 @@
 #include <deque>
 #include <algorithm>
 #include <iterator>
+#include <exception>
+#include <stdexcept>
 #include "boost/foreach.hpp"
 #include "boost/iterator/counting_iterator.hpp"
 #include "boost/unordered_set.hpp"
@@ -18,6 +20,8 @@
 #include "database/structures/Geo.h"
 #include "database/structures/UnionGeo.h"
 #include "database/structures/IntersectionGeo.h"
+#include "database/structures/RectGeo.h"
+#include "database/structures/BoxBatch.h"
 
 // Declaration
 class Grid {
@@ -58,6 +62,20 @@ public:
   /// intersectionCover
   template < class T >
   std::vector<Grid::GridElement> intersectionCover ( const std::vector < T > & V  ) const;
+
+  /// batchGeometry
+  ///   Write the geometry of elements [ 0, count ) into *boxes (resized to
+  ///   count). The default uses geometry, which must return RectGeo.
+  virtual void batchGeometry ( const GridElement * elements, uint64_t count,
+                               BoxBatch * boxes ) const;
+
+  /// batchCover
+  ///   For each box i, append the grid elements covering it to *targets,
+  ///   then append targets -> size () to *offsets. (So with offsets
+  ///   starting as { 0 }, the result is in CSR form.)
+  virtual void batchCover ( const BoxBatch & boxes,
+                            std::vector<uint64_t> * offsets,
+                            std::vector<GridElement> * targets ) const;
   
   /// memory
   ///   Return memory usage of this data structure
@@ -146,6 +164,34 @@ Grid::intersectionCover ( const std::vector < T > & V ) const {
   return result;
 }
 
+inline void 
+Grid::batchGeometry ( const GridElement * elements, uint64_t count,
+                      BoxBatch * boxes ) const {
+  if ( count == 0 ) boxes -> resize ( boxes -> dimension (), 0 );
+  for ( uint64_t i = 0; i < count; ++ i ) {
+    boost::shared_ptr<RectGeo> box = 
+      boost::dynamic_pointer_cast<RectGeo> ( geometry ( elements [ i ] ) );
+    if ( not box ) {
+      throw std::logic_error ( "Grid::batchGeometry. Geometry is not a RectGeo.\n" );
+    }
+    if ( i == 0 ) boxes -> resize ( box -> dimension (), count );
+    boxes -> set ( i, *box );
+  }
+}
+
+inline void 
+Grid::batchCover ( const BoxBatch & boxes,
+                   std::vector<uint64_t> * offsets,
+                   std::vector<GridElement> * targets ) const {
+  RectGeo box ( boxes . dimension () );
+  for ( uint64_t i = 0; i < boxes . size (); ++ i ) {
+    boxes . get ( i, &box );
+    std::vector<GridElement> cover_vec = cover ( box );
+    targets -> insert ( targets -> end (), cover_vec . begin (), cover_vec . end () );
+    offsets -> push_back ( targets -> size () );
+  }
+}
+
 inline Grid::Grid ( void ) {
   size_ = 1;
 }
@@ -0,0 +1,258 @@
+// LabelledTree.h
+
+#ifndef CMDB_LABELLEDTREE_H
+#define CMDB_LABELLEDTREE_H
+
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <stack>
+#include <utility>
+#include <boost/shared_ptr.hpp>
+
+#include "database/structures/Grid.h"
+#include "database/structures/TreeGrid.h"
+#include "database/structures/Atlas.h"
+#include "database/structures/StateGrid.h"
+
+/// class LabelledTree
+///   The trees of the Morse sets of a Morse graph (in one chart of phase
+///   space) merged into a single binary tree, stored in preorder. Each
+///   node records which children it has and the Morse set, if any, of
+///   which it is a grid element. Built once per Morse graph (see
+///   MorseGraph::labelledTrees), it lets Clutching intersect two Morse
+///   graphs with one simultaneous walk of two trees.
+class LabelledTree {
+public:
+  typedef int Label;
+  enum { LEFT = 1, RIGHT = 2 };
+  enum { NONE = -1 };
+
+  /// LabelledTree
+  ///   Construct an empty tree
+  LabelledTree ( void ) {}
+
+  /// assign
+  ///   Merge the trees of trees [ v ], labelling the grid elements of
+  ///   trees [ v ] by v. Null pointers are skipped.
+  void assign ( const std::vector < boost::shared_ptr<const TreeGrid> > & trees );
+
+  /// assign
+  ///   The same for StateGrids, whose states are placed in a complete
+  ///   binary tree by their binary digits, most significant first (so
+  ///   two StateGrids of the same states give matching trees)
+  void assign ( const std::vector < boost::shared_ptr<const StateGrid> > & grids );
+
+  /// size
+  ///   Number of nodes (0 for an empty tree, otherwise node 0 is the root)
+  uint64_t size ( void ) const { return children_ . size (); }
+
+  /// children
+  ///   LEFT | RIGHT bits of the children node has. When present, the left
+  ///   child is node + 1 and the right child follows the left subtree.
+  int children ( uint64_t node ) const { return children_ [ node ]; }
+
+  /// label
+  ///   The Morse set node is a grid element of, or NONE
+  Label label ( uint64_t node ) const { return labels_ [ node ]; }
+
+  /// skip
+  ///   The node following the subtree of node in preorder
+  uint64_t skip ( uint64_t node ) const;
+
+  /// labels
+  ///   Call f ( label ) for the labelled nodes of the subtree of node
+  ///   (repeated labels on consecutive nodes are reported once), and
+  ///   return skip ( node )
+  template < class Function >
+  uint64_t labels ( uint64_t node, const Function & f ) const;
+
+  /// memory
+  uint64_t memory ( void ) const {
+    return sizeof ( LabelledTree ) + children_ . capacity () +
+           sizeof ( Label ) * labels_ . capacity ();
+  }
+
+private:
+  // Write out the pointer-based tree built by assign in preorder
+  void write_ ( const std::vector < uint64_t > & child,
+                const std::vector < Label > & label,
+                bool disjoint );
+  std::vector < uint8_t > children_;
+  std::vector < Label > labels_;
+};
+
+/// buildLabelledTrees
+///   One LabelledTree per chart of phase_space (one in all if it is a
+///   TreeGrid or a StateGrid, none if it is none of these nor an Atlas), labelling
+///   the grid elements of grids [ v ] by v. Charts are matched by their
+///   position in Atlas::charts (), as in Clutching.
+inline void
+buildLabelledTrees ( std::vector < LabelledTree > * output,
+                     boost::shared_ptr<const Grid> phase_space,
+                     const std::vector < boost::shared_ptr<Grid> > & grids ) {
+  output -> clear ();
+  size_t N = grids . size ();
+  std::vector < std::vector < boost::shared_ptr<const TreeGrid> > > trees;
+  if ( boost::dynamic_pointer_cast<const Atlas> ( phase_space ) ) {
+    const Atlas & atlas = * boost::dynamic_pointer_cast<const Atlas> ( phase_space );
+    trees . resize ( atlas . numCharts (),
+      std::vector < boost::shared_ptr<const TreeGrid> > ( N ) );
+    for ( size_t i = 0; i < N; ++ i ) {
+      boost::shared_ptr<const Atlas> set_atlas =
+        boost::dynamic_pointer_cast<const Atlas> ( grids [ i ] );
+      if ( not set_atlas ) continue;
+      size_t count = 0;
+      for ( Atlas::IdChartPair const& pair : set_atlas -> charts () ) {
+        if ( count == trees . size () ) break;
+        if ( pair . second -> size () > 0 ) trees [ count ] [ i ] = pair . second;
+        ++ count;
+      }
+    }
+  } else if ( boost::dynamic_pointer_cast<const TreeGrid> ( phase_space ) ) {
+    trees . resize ( 1, std::vector < boost::shared_ptr<const TreeGrid> > ( N ) );
+    for ( size_t i = 0; i < N; ++ i ) {
+      trees [ 0 ] [ i ] = boost::dynamic_pointer_cast<const TreeGrid> ( grids [ i ] );
+    }
+  } else if ( boost::dynamic_pointer_cast<const StateGrid> ( phase_space ) ) {
+    std::vector < boost::shared_ptr<const StateGrid> > state_grids ( N );
+    for ( size_t i = 0; i < N; ++ i ) {
+      state_grids [ i ] = boost::dynamic_pointer_cast<const StateGrid> ( grids [ i ] );
+    }
+    output -> resize ( 1 );
+    (*output) [ 0 ] . assign ( state_grids );
+    return;
+  }
+  output -> resize ( trees . size () );
+  for ( size_t chart = 0; chart < trees . size (); ++ chart ) {
+    (*output) [ chart ] . assign ( trees [ chart ] );
+  }
+}
+
+inline void
+LabelledTree::assign ( const std::vector < boost::shared_ptr<const TreeGrid> > & trees ) {
+  // Merge into a pointer-based tree: node n has children child [ 2n ]
+  // and child [ 2n + 1 ] (0 for none, as the root is nobody's child)
+  std::vector < uint64_t > child ( 2, 0 );
+  std::vector < Label > label ( 1, NONE );
+  bool disjoint = true;
+  for ( size_t v = 0; v < trees . size (); ++ v ) {
+    if ( not trees [ v ] ) continue;
+    const TreeGrid & grid = * trees [ v ];
+    Tree::iterator end = grid . treeEnd ();
+    std::stack < std::pair < Tree::iterator, uint64_t > > work_stack;
+    work_stack . push ( std::make_pair ( grid . treeBegin (), (uint64_t) 0 ) );
+    while ( not work_stack . empty () ) {
+      Tree::iterator it = work_stack . top () . first;
+      uint64_t node = work_stack . top () . second;
+      work_stack . pop ();
+      if ( grid . isGrid ( it ) ) {
+        if ( label [ node ] != NONE ) disjoint = false;
+        label [ node ] = (Label) v;
+        continue;
+      }
+      for ( int side = 0; side < 2; ++ side ) {
+        Tree::iterator next = side ? grid . right ( it ) : grid . left ( it );
+        if ( next == end ) continue;
+        if ( child [ 2 * node + side ] == 0 ) {
+          child [ 2 * node + side ] = label . size ();
+          label . push_back ( NONE );
+          child . push_back ( 0 );
+          child . push_back ( 0 );
+        }
+        work_stack . push ( std::make_pair ( next, child [ 2 * node + side ] ) );
+      }
+    }
+  }
+  write_ ( child, label, disjoint );
+}
+
+inline void
+LabelledTree::assign ( const std::vector < boost::shared_ptr<const StateGrid> > & grids ) {
+  // Depth of the tree: number of binary digits of the largest state
+  int depth = 0;
+  for ( size_t v = 0; v < grids . size (); ++ v ) {
+    if ( not grids [ v ] || grids [ v ] -> numStates () == 0 ) continue;
+    uint64_t largest = grids [ v ] -> numStates () - 1;
+    while ( depth < 64 && ( largest >> depth ) != 0 ) ++ depth;
+  }
+  std::vector < uint64_t > child ( 2, 0 );
+  std::vector < Label > label ( 1, NONE );
+  bool disjoint = true;
+  for ( size_t v = 0; v < grids . size (); ++ v ) {
+    if ( not grids [ v ] ) continue;
+    const StateGrid & grid = * grids [ v ];
+    for ( Grid::GridElement ge = 0; ge < grid . size (); ++ ge ) {
+      uint64_t state = grid . state ( ge );
+      uint64_t node = 0;
+      for ( int digit = depth - 1; digit >= 0; -- digit ) {
+        int side = ( state >> digit ) & 1;
+        if ( child [ 2 * node + side ] == 0 ) {
+          child [ 2 * node + side ] = label . size ();
+          label . push_back ( NONE );
+          child . push_back ( 0 );
+          child . push_back ( 0 );
+        }
+        node = child [ 2 * node + side ];
+      }
+      if ( label [ node ] != NONE ) disjoint = false;
+      label [ node ] = (Label) v;
+    }
+  }
+  write_ ( child, label, disjoint );
+}
+
+inline void
+LabelledTree::write_ ( const std::vector < uint64_t > & child,
+                       const std::vector < Label > & label,
+                       bool disjoint ) {
+  // Write out in preorder
+  children_ . clear ();
+  labels_ . clear ();
+  if ( label . size () == 1 && label [ 0 ] == NONE ) return;
+  children_ . reserve ( label . size () );
+  labels_ . reserve ( label . size () );
+  std::stack < uint64_t > work_stack;
+  work_stack . push ( 0 );
+  while ( not work_stack . empty () ) {
+    uint64_t node = work_stack . top ();
+    work_stack . pop ();
+    uint8_t bits = 0;
+    if ( child [ 2 * node ] != 0 ) bits |= LEFT;
+    if ( child [ 2 * node + 1 ] != 0 ) bits |= RIGHT;
+    if ( bits != 0 && label [ node ] != NONE ) disjoint = false;
+    children_ . push_back ( bits );
+    labels_ . push_back ( label [ node ] );
+    if ( bits & RIGHT ) work_stack . push ( child [ 2 * node + 1 ] );
+    if ( bits & LEFT ) work_stack . push ( child [ 2 * node ] );
+  }
+  if ( not disjoint ) std::cout << "Warning, morse sets are not disjoint.\n";
+}
+
+inline uint64_t
+LabelledTree::skip ( uint64_t node ) const {
+  uint64_t pending = 1;
+  while ( pending > 0 ) {
+    int bits = children_ [ node ++ ];
+    pending += ( bits & 1 ) + ( bits >> 1 ) - 1;
+  }
+  return node;
+}
+
+template < class Function > uint64_t
+LabelledTree::labels ( uint64_t node, const Function & f ) const {
+  uint64_t pending = 1;
+  Label last = NONE;
+  while ( pending > 0 ) {
+    Label l = labels_ [ node ];
+    if ( l != NONE && l != last ) {
+      f ( l );
+      last = l;
+    }
+    int bits = children_ [ node ++ ];
+    pending += ( bits & 1 ) + ( bits >> 1 ) - 1;
+  }
+  return node;
+}
+
+#endif
@@ -14,6 +14,10 @@
 #include "boost/foreach.hpp"
 
 #include "database/structures/Grid.h"
+#include "database/structures/BoxBatch.h"
+#include "database/maps/Map.h"
+#include "database/algorithms/parallelFor.h"
+#include "database/structures/AdjacencyStore.h"
 
 #ifdef CMDB_STORE_GRAPH
 #include "database/program/ComputeGraph.h"
@@ -22,7 +26,11 @@
 /// class MapGraph
 ///    This class is used to created an object suitable for graph algorithms
 ///    given a grid and a map object. By default "adjacencies" is computed on demand
-///    in order to avoid storing the adjacency lists.
+///    in order to avoid storing the adjacency lists. Calling "storeAdjacencies"
+///    enables a memory-bounded AdjacencyStore: each list is recorded the first
+///    time it is computed and later passes (e.g. reachability) reuse it.
+///    Maps with combinatorial evaluation (Map::hasAdjacencies, e.g. StateMap)
+///    give the adjacency lists directly, with no geometry involved.
 class MapGraph {
 public:
   // Typedefs
@@ -41,15 +49,67 @@ public:
   ///   Return number of vertices
   size_type num_vertices ( void ) const;
 
+  /// storeAdjacencies
+  ///   Record adjacency lists as they are computed, using at most
+  ///   memory_budget bytes (index and edges, see AdjacencyStore). If spill is true, lists beyond
+  ///   the budget are written to a temporary file instead of being dropped.
+  void storeAdjacencies ( uint64_t memory_budget, bool spill = false );
+
+  /// computeAdjacencies
+  ///   Compute the adjacency lists of all vertices with num_threads threads
+  ///   and record them in the adjacency store in vertex order, so the store
+  ///   holds the graph in CSR form. Requires storeAdjacencies to have been
+  ///   called; stops early if the memory budget is exhausted (remaining
+  ///   lists are then computed on demand). The Map must be safe to evaluate
+  ///   concurrently. Maps with batch evaluation (Map::hasBatchEvaluation)
+  ///   are evaluated a block of vertices at a time through Grid::batchGeometry,
+  ///   Map::evaluate and Grid::batchCover; maps with combinatorial
+  ///   evaluation (Map::hasAdjacencies) through Map::adjacencies.
+  void computeAdjacencies ( int num_threads );
+
+  /// adjacencyBlock
+  ///   Compute the adjacency lists of vertices begin to end-1 in CSR form:
+  ///   the list of begin + i is (*targets) [ (*offsets) [ i ] ] to
+  ///   (*targets) [ (*offsets) [ i + 1 ] - 1 ]. Unlike adjacencies this
+  ///   neither consults nor fills the adjacency store, so it may be called
+  ///   from several threads at once, provided the Map may be evaluated
+  ///   concurrently. (Used by computeStrongComponentsParallel.)
+  void adjacencyBlock ( Vertex begin, Vertex end,
+                        std::vector<uint64_t> * offsets,
+                        std::vector<Vertex> * targets ) const;
+
+  /// recordAdjacencies
+  ///   Record the adjacency list [first, last) of v, as computed by
+  ///   adjacencyBlock, in the adjacency store (if enabled), so later
+  ///   calls to adjacencies need not evaluate the map. Returns false if
+  ///   it could not be recorded.
+  template < class InputIterator >
+  bool recordAdjacencies ( Vertex v, InputIterator first, InputIterator last ) const;
+
+  /// evaluationsSaved
+  ///   Return the number of map evaluations avoided by the adjacency store
+  uint64_t evaluationsSaved ( void ) const;
+
+  /// evaluations
+  ///   Return the number of map evaluations performed
+  uint64_t evaluations ( void ) const;
+
 private:
   // Private methods
   std::vector<size_type> compute_adjacencies ( const size_type & v ) const;
+  void compute_block ( Vertex begin, Vertex end,
+                       std::vector<uint64_t> * offsets,
+                       std::vector<Vertex> * targets ) const;
   // Private data
   boost::shared_ptr<const Grid> grid_;
   boost::shared_ptr<const Map> f_;
   // Variables used if graph is stored in memory. (See CMDB_STORE_GRAPH define)
   bool stored_graph;
   std::vector<std::vector<Vertex> > adjacency_lists_;
+  // Variables used if adjacency lists are recorded (see storeAdjacencies)
+  mutable AdjacencyStore store_;
+  mutable uint64_t evaluations_;
+  mutable uint64_t requests_;
 };
 
 inline 
@@ -57,7 +117,9 @@ MapGraph::MapGraph ( boost::shared_ptr<const Grid> grid,
            boost::shared_ptr<const Map> f ) : 
 grid_ ( grid ),
 f_ ( f ),
-stored_graph ( false ) {
+stored_graph ( false ),
+evaluations_ ( 0 ),
+requests_ ( 0 ) {
   if ( not f_ ) {
     throw std::logic_error ( "MapGraph::MapGraph. Unable to construct with uninitialized Map f\n");
   }
@@ -103,21 +165,141 @@ inline std::vector<MapGraph::Vertex>
 MapGraph::adjacencies ( const size_type & source ) const {
   if ( stored_graph )
     return adjacency_lists_ [ source ];
-  else
+  ++ requests_;
+  if ( not store_ . enabled () )
     return compute_adjacencies ( source );
+  std::vector<Vertex> result;
+  if ( store_ . fetch ( source, &result ) ) return result;
+  result = compute_adjacencies ( source );
+  store_ . insert ( source, result );
+  return result;
 }
 
 inline std::vector<MapGraph::Vertex>
 MapGraph::compute_adjacencies ( const Vertex & source ) const {
+  ++ evaluations_;
+  if ( f_ -> hasAdjacencies () || f_ -> hasBatchEvaluation () ) {
+    static thread_local std::vector<uint64_t> offsets;
+    static thread_local std::vector<Vertex> targets;
+    compute_block ( source, source + 1, &offsets, &targets );
+    return targets;
+  }
   std::vector < Vertex > target = 
     grid_ -> cover ( (*f_) ( grid_ -> geometry ( source ) ) ); // here is the work
   return target;
 }
 
+inline void
+MapGraph::compute_block ( Vertex begin, Vertex end,
+                          std::vector<uint64_t> * offsets,
+                          std::vector<Vertex> * targets ) const {
+  offsets -> clear ();
+  targets -> clear ();
+  offsets -> push_back ( 0 );
+  if ( f_ -> hasAdjacencies () ) {
+    f_ -> adjacencies ( *grid_, begin, end, offsets, targets );
+    return;
+  }
+  if ( f_ -> hasBatchEvaluation () ) {
+    // Batch path: the block's boxes and images are computed in
+    // per-thread buffers, without a Geo allocation per vertex
+    static thread_local std::vector<Vertex> vertices;
+    static thread_local BoxBatch domain;
+    static thread_local BoxBatch image;
+    vertices . resize ( end - begin );
+    for ( Vertex v = begin; v < end; ++ v ) vertices [ v - begin ] = v;
+    grid_ -> batchGeometry ( vertices . data (), vertices . size (), &domain );
+    f_ -> evaluate ( domain, &image );
+    grid_ -> batchCover ( image, offsets, targets );
+    return;
+  }
+  for ( Vertex v = begin; v < end; ++ v ) {
+    std::vector < Vertex > target = 
+      grid_ -> cover ( (*f_) ( grid_ -> geometry ( v ) ) );
+    targets -> insert ( targets -> end (), target . begin (), target . end () );
+    offsets -> push_back ( targets -> size () );
+  }
+}
+
+inline void
+MapGraph::computeAdjacencies ( int num_threads ) {
+  if ( stored_graph || not store_ . enabled () ) return;
+  if ( num_threads < 1 ) num_threads = 1;
+  const size_type N = num_vertices ();
+  // Vertices are handed out in blocks; a "round" of blocks is computed in
+  // parallel and then appended to the store in order, so the store stays
+  // in CSR order and its memory budget is checked between rounds.
+  const size_type block_size = 1024;
+  const size_type blocks_per_round = 16 * (size_type) num_threads;
+  std::vector < std::vector < uint64_t > > offsets ( blocks_per_round );
+  std::vector < std::vector < Vertex > > targets ( blocks_per_round );
+  for ( size_type round_begin = 0; round_begin < N; 
+        round_begin += block_size * blocks_per_round ) {
+    size_type num_blocks = std::min ( blocks_per_round, 
+      ( N - round_begin + block_size - 1 ) / block_size );
+    parallelFor ( num_threads, num_blocks, [&] ( uint64_t b ) {
+      Vertex begin = round_begin + b * block_size;
+      Vertex end = std::min ( (size_type) begin + block_size, N );
+      compute_block ( begin, end, &offsets [ b ], &targets [ b ] );
+    } );
+    // Append the round to the store, in vertex order
+    for ( size_type b = 0; b < num_blocks; ++ b ) {
+      Vertex begin = round_begin + b * block_size;
+      const std::vector<uint64_t> & off = offsets [ b ];
+      const std::vector<Vertex> & tar = targets [ b ];
+      evaluations_ += off . size () - 1;
+      for ( size_type i = 0; i + 1 < off . size (); ++ i ) {
+        if ( not store_ . insert ( begin + i, 
+                                   tar . begin () + off [ i ], 
+                                   tar . begin () + off [ i + 1 ] ) ) return;
+      }
+    }
+  }
+}
+
+inline void
+MapGraph::adjacencyBlock ( Vertex begin, Vertex end,
+                           std::vector<uint64_t> * offsets,
+                           std::vector<Vertex> * targets ) const {
+  if ( stored_graph ) {
+    offsets -> assign ( 1, 0 );
+    targets -> clear ();
+    for ( Vertex v = begin; v < end; ++ v ) {
+      const std::vector<Vertex> & list = adjacency_lists_ [ v ];
+      targets -> insert ( targets -> end (), list . begin (), list . end () );
+      offsets -> push_back ( targets -> size () );
+    }
+    return;
+  }
+  compute_block ( begin, end, offsets, targets );
+  __atomic_fetch_add ( &evaluations_, (uint64_t) ( end - begin ), __ATOMIC_RELAXED );
+}
+
+template < class InputIterator > bool
+MapGraph::recordAdjacencies ( Vertex v, InputIterator first, InputIterator last ) const {
+  if ( stored_graph || not store_ . enabled () ) return false;
+  return store_ . insert ( v, first, last );
+}
 
 inline MapGraph::size_type
 MapGraph::num_vertices ( void ) const {
   return grid_ -> size ();
 }
 
+inline void
+MapGraph::storeAdjacencies ( uint64_t memory_budget, bool spill ) {
+  if ( stored_graph ) return;
+  store_ . initialize ( num_vertices (), memory_budget, spill );
+}
+
+inline uint64_t
+MapGraph::evaluationsSaved ( void ) const {
+  return requests_ > evaluations_ ? requests_ - evaluations_ : 0;
+}
+
+inline uint64_t
+MapGraph::evaluations ( void ) const {
+  return evaluations_;
+}
+
 #endif
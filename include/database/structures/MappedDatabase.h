@@ -0,0 +1,776 @@
+/* MappedDatabase.h */
+
+#ifndef CMDB_MAPPEDDATABASE_H
+#define CMDB_MAPPEDDATABASE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <map>
+
+#include "boost/shared_ptr.hpp"
+#include "boost/foreach.hpp"
+#include "boost/archive/binary_iarchive.hpp"
+#include "boost/archive/binary_oarchive.hpp"
+
+#include "database/structures/Database.h"
+#include "database/structures/ColumnarFile.h"
+
+/// DatabaseSection
+///   Section identifiers of the columnar database format (see ColumnarFile.h)
+///   Variable-length records are stored as an OFFSETS column (one more entry
+///   than there are records, starting with 0) and a VALUES column.
+enum DatabaseSection {
+  DB_PARAMETER_SPACE = 1,   // boost binary archive of shared_ptr<ParameterSpace>
+  DB_PR_PARAMETER, DB_PR_MORSEGRAPH, DB_PR_MSS_OFFSETS, DB_PR_MSS,
+  DB_CR_PARAMETER_1, DB_CR_PARAMETER_2, DB_CR_BG,
+  DB_STRING_OFFSETS, DB_STRING_CHARS,
+  DB_ANNOTATION_OFFSETS, DB_ANNOTATION_VALUES,
+  DB_MG_DAG, DB_MG_ANNOTATION, DB_MG_ABV_OFFSETS, DB_MG_ABV,
+  DB_DAG_NUM_VERTICES, DB_DAG_OFFSETS, DB_DAG_EDGES,
+  DB_BG_OFFSETS, DB_BG_EDGES,
+  DB_CS_OFFSETS, DB_CS_VALUES,
+  DB_CI_OFFSETS, DB_CI_STRING_OFFSETS, DB_CI_CHARS,
+  DB_MGCCP_OFFSETS, DB_MGCCP_PARAMETERS, DB_MGCCP_MORSEGRAPH,
+  DB_INCCP_CS, DB_INCCP_MGCCP,
+  DB_MGCC_OFFSETS, DB_MGCC_VALUES,
+  DB_INCC_OFFSETS, DB_INCC_VALUES, DB_INCC_REP_OFFSETS, DB_INCC_REPS,
+  DB_PB_TO_MGCCP, DB_MGCCP_TO_MGCC, DB_INCCP_TO_INCC,
+  DB_INCC_TO_MGCC_OFFSETS, DB_INCC_TO_MGCC,
+  DB_MGCC_SIZES, DB_INCC_SIZES,
+  DB_MGCC_NB_OFFSETS, DB_MGCC_NB,
+  DB_INCC_CONLEY,
+  DB_STRING_HASH, DB_ANNOTATION_HASH, DB_MG_HASH, DB_DAG_HASH,
+  DB_BG_HASH, DB_CS_HASH, DB_CI_HASH, DB_INCCP_HASH,
+  DB_HASH_VERSION,          // CMDB_COLUMNAR_HASH_VERSION used for the xxx_HASH tables
+  DB_NUM_SECTIONS
+};
+
+/// columnarHash
+///   Hash of a record, as used by the hash tables of the columnar format.
+///   Each hashes the record's fields in the order they are stored.
+inline uint64_t columnarHash ( const std::string & s ) {
+  ColumnarHash h; h . chars ( s ); return h . value ();
+}
+inline uint64_t columnarHash ( const Annotation_Record & record ) {
+  ColumnarHash h;
+  BOOST_FOREACH ( uint64_t i, record . string_indices ) h . word ( i );
+  return h . value ();
+}
+inline uint64_t columnarHash ( const MorseGraphRecord & record ) {
+  ColumnarHash h;
+  h . word ( record . dag_index );
+  h . word ( record . annotation_index );
+  BOOST_FOREACH ( uint64_t i, record . annotation_index_by_vertex ) h . word ( i );
+  return h . value ();
+}
+inline uint64_t columnarHash ( const DAG_Data & dag ) {
+  ColumnarHash h;
+  h . word ( (uint64_t) (int64_t) dag . num_vertices );
+  typedef std::pair<int,int> intpair;
+  BOOST_FOREACH ( const intpair & e, dag . partial_order ) {
+    h . word ( (uint64_t) (int64_t) e . first );
+    h . word ( (uint64_t) (int64_t) e . second );
+  }
+  return h . value ();
+}
+inline uint64_t columnarHash ( const BG_Data & bg ) {
+  ColumnarHash h;
+  typedef std::pair<int,int> intpair;
+  BOOST_FOREACH ( const intpair & e, bg . edges ) {
+    h . word ( (uint64_t) (int64_t) e . first );
+    h . word ( (uint64_t) (int64_t) e . second );
+  }
+  return h . value ();
+}
+inline uint64_t columnarHash ( const CS_Data & cs ) {
+  ColumnarHash h;
+  BOOST_FOREACH ( int v, cs . vertices ) h . word ( (uint64_t) (int64_t) v );
+  return h . value ();
+}
+inline uint64_t columnarHash ( const CI_Data & ci ) {
+  ColumnarHash h;
+  BOOST_FOREACH ( const std::string & s, ci . conley_index ) h . chars ( s );
+  return h . value ();
+}
+inline uint64_t columnarHash ( const INCCP_Record & record ) {
+  ColumnarHash h;
+  h . word ( record . cs_index );
+  h . word ( record . mgccp_index );
+  return h . value ();
+}
+
+/// class MappedDatabase
+///   Read-only view of a database saved in the columnar format.
+///   The file is memory-mapped, so opening is immediate regardless of size
+///   and processes opening the same file share its pages. Records are
+///   decoded on access, and the xxxIndex lookups probe the hash tables
+///   stored in the file instead of building std::unordered_maps. If the
+///   file was written with a different CMDB_COLUMNAR_HASH_VERSION (or
+///   none), the tables are rebuilt in memory when the file is opened.
+///   Lookups return the number of records if the item is absent, as
+///   in Database.
+class MappedDatabase {
+public:
+  MappedDatabase ( void ) {}
+  MappedDatabase ( const char * filename ) { open ( filename ); }
+
+  /// open
+  ///   Map a columnar database file
+  void open ( const char * filename );
+
+  /// file
+  const ColumnarFile & file ( void ) const { return file_; }
+
+  /// parameterSpace
+  ///   Deserialize and return the parameter space (null if none was stored)
+  boost::shared_ptr<ParameterSpace> parameterSpace ( void ) const;
+
+  // Counts
+  uint64_t numParameterRecords ( void ) const { return size_ ( DB_PR_PARAMETER ); }
+  uint64_t numClutchRecords ( void ) const { return size_ ( DB_CR_PARAMETER_1 ); }
+  uint64_t numStrings ( void ) const { return records_ ( DB_STRING_OFFSETS ); }
+  uint64_t numAnnotations ( void ) const { return records_ ( DB_ANNOTATION_OFFSETS ); }
+  uint64_t numMorseGraphs ( void ) const { return size_ ( DB_MG_DAG ); }
+  uint64_t numDAGs ( void ) const { return size_ ( DB_DAG_NUM_VERTICES ); }
+  uint64_t numBGs ( void ) const { return records_ ( DB_BG_OFFSETS ); }
+  uint64_t numCSs ( void ) const { return records_ ( DB_CS_OFFSETS ); }
+  uint64_t numCIs ( void ) const { return records_ ( DB_CI_OFFSETS ); }
+  uint64_t numMGCCPs ( void ) const { return size_ ( DB_MGCCP_MORSEGRAPH ); }
+  uint64_t numINCCPs ( void ) const { return size_ ( DB_INCCP_CS ); }
+  uint64_t numMGCCs ( void ) const { return records_ ( DB_MGCC_OFFSETS ); }
+  uint64_t numINCCs ( void ) const { return records_ ( DB_INCC_OFFSETS ); }
+
+  // Record access
+  ParameterRecord parameterRecord ( uint64_t i ) const;
+  ClutchingRecord clutchRecord ( uint64_t i ) const;
+  std::string string ( uint64_t i ) const;
+  Annotation_Record annotation ( uint64_t i ) const;
+  MorseGraphRecord morsegraph ( uint64_t i ) const;
+  DAG_Data dag ( uint64_t i ) const;
+  BG_Data bg ( uint64_t i ) const;
+  CS_Data cs ( uint64_t i ) const;
+  CI_Data ci ( uint64_t i ) const;
+  MGCCP_Record MGCCP ( uint64_t i ) const;
+  INCCP_Record INCCP ( uint64_t i ) const;
+  MGCC_Record MGCC ( uint64_t i ) const;
+  INCC_Record INCC ( uint64_t i ) const;
+
+  // Flat continuation data (pointer into the mapping, and length)
+  const uint64_t * column ( DatabaseSection id ) const { return column_ [ id ] . data; }
+  uint64_t columnSize ( DatabaseSection id ) const { return column_ [ id ] . size; }
+  std::vector<uint64_t> incc_to_mgcc ( uint64_t i ) const;
+  std::vector<uint64_t> mgcc_nb ( uint64_t i ) const;
+
+  // Index lookups
+  uint64_t stringIndex ( const std::string & item ) const;
+  uint64_t annotationIndex ( const Annotation_Record & item ) const;
+  uint64_t morsegraphIndex ( const MorseGraphRecord & item ) const;
+  uint64_t dagIndex ( const DAG_Data & item ) const;
+  uint64_t bgIndex ( const BG_Data & item ) const;
+  uint64_t csIndex ( const CS_Data & item ) const;
+  uint64_t ciIndex ( const CI_Data & item ) const;
+  uint64_t inccpIndex ( const INCCP_Record & item ) const;
+
+private:
+  struct Column {
+    const uint64_t * data;
+    uint64_t size;
+    Column ( void ) : data ( NULL ), size ( 0 ) {}
+  };
+  uint64_t at_ ( DatabaseSection id, uint64_t i ) const { return column_ [ id ] . data [ i ]; }
+  uint64_t size_ ( DatabaseSection id ) const { return column_ [ id ] . size; }
+  uint64_t records_ ( DatabaseSection offsets ) const {
+    return size_ ( offsets ) == 0 ? 0 : size_ ( offsets ) - 1;
+  }
+  // range of record i in a variable-length (offsets, values) column pair
+  std::pair < const uint64_t *, const uint64_t * >
+  range_ ( DatabaseSection offsets, DatabaseSection values, uint64_t i ) const {
+    const uint64_t * base = column_ [ values ] . data;
+    return std::make_pair ( base + at_ ( offsets, i ), base + at_ ( offsets, i + 1 ) );
+  }
+  std::string chars_ ( DatabaseSection offsets, uint64_t i ) const;
+  void rebuildHashTables_ ( void );
+  template < class HashOf >
+  void rebuild_ ( DatabaseSection id, uint64_t num_records, HashOf hash_of );
+  std::vector < std::pair < int, int > > edges_ ( DatabaseSection offsets,
+                                                   DatabaseSection values,
+                                                   uint64_t i ) const;
+  ColumnarFile file_;
+  Column column_ [ DB_NUM_SECTIONS ];
+  // hash tables rebuilt on open, replacing those in the file
+  std::map < int, std::vector<uint64_t> > rebuilt_;
+};
+
+inline void
+MappedDatabase::open ( const char * filename ) {
+  file_ . open ( filename );
+  for ( int id = 1; id < DB_NUM_SECTIONS; ++ id ) {
+    // Character data is addressed bytewise through chars_
+    if ( id == DB_PARAMETER_SPACE || id == DB_STRING_CHARS || id == DB_CI_CHARS ) continue;
+    column_ [ id ] . data = file_ . section<uint64_t> ( id );
+    column_ [ id ] . size = file_ . size<uint64_t> ( id );
+  }
+  if ( size_ ( DB_HASH_VERSION ) != 1 ||
+       at_ ( DB_HASH_VERSION, 0 ) != CMDB_COLUMNAR_HASH_VERSION ) {
+    rebuildHashTables_ ();
+  }
+}
+
+template < class HashOf > void
+MappedDatabase::rebuild_ ( DatabaseSection id, uint64_t num_records, HashOf hash_of ) {
+  std::vector<uint64_t> & table = rebuilt_ [ id ];
+  table = buildColumnarHashTable ( num_records, hash_of );
+  column_ [ id ] . data = & table [ 0 ];
+  column_ [ id ] . size = table . size ();
+}
+
+inline void
+MappedDatabase::rebuildHashTables_ ( void ) {
+  rebuilt_ . clear ();
+  rebuild_ ( DB_STRING_HASH, numStrings (),
+    [&] ( uint64_t i ) { return columnarHash ( string ( i ) ); } );
+  rebuild_ ( DB_ANNOTATION_HASH, numAnnotations (),
+    [&] ( uint64_t i ) { return columnarHash ( annotation ( i ) ); } );
+  rebuild_ ( DB_MG_HASH, numMorseGraphs (),
+    [&] ( uint64_t i ) { return columnarHash ( morsegraph ( i ) ); } );
+  rebuild_ ( DB_DAG_HASH, numDAGs (),
+    [&] ( uint64_t i ) { return columnarHash ( dag ( i ) ); } );
+  rebuild_ ( DB_BG_HASH, numBGs (),
+    [&] ( uint64_t i ) { return columnarHash ( bg ( i ) ); } );
+  rebuild_ ( DB_CS_HASH, numCSs (),
+    [&] ( uint64_t i ) { return columnarHash ( cs ( i ) ); } );
+  rebuild_ ( DB_CI_HASH, numCIs (),
+    [&] ( uint64_t i ) { return columnarHash ( ci ( i ) ); } );
+  rebuild_ ( DB_INCCP_HASH, numINCCPs (),
+    [&] ( uint64_t i ) { return columnarHash ( INCCP ( i ) ); } );
+}
+
+inline boost::shared_ptr<ParameterSpace>
+MappedDatabase::parameterSpace ( void ) const {
+  boost::shared_ptr<ParameterSpace> result;
+  if ( not file_ . has ( DB_PARAMETER_SPACE ) ) return result;
+  std::string bytes ( file_ . section<char> ( DB_PARAMETER_SPACE ),
+                      file_ . size<char> ( DB_PARAMETER_SPACE ) );
+  std::istringstream iss ( bytes );
+  boost::archive::binary_iarchive ia ( iss );
+  ia >> result;
+  return result;
+}
+
+inline std::string
+MappedDatabase::chars_ ( DatabaseSection offsets, uint64_t i ) const {
+  DatabaseSection chars = ( offsets == DB_STRING_OFFSETS ) ? DB_STRING_CHARS : DB_CI_CHARS;
+  const char * base = file_ . section<char> ( chars );
+  return std::string ( base + at_ ( offsets, i ), base + at_ ( offsets, i + 1 ) );
+}
+
+inline std::vector < std::pair < int, int > >
+MappedDatabase::edges_ ( DatabaseSection offsets, DatabaseSection values, uint64_t i ) const {
+  std::vector < std::pair < int, int > > result;
+  std::pair < const uint64_t *, const uint64_t * > r = range_ ( offsets, values, i );
+  for ( const uint64_t * it = r . first; it != r . second; it += 2 ) {
+    result . push_back ( std::make_pair ( (int) (int64_t) it [ 0 ], (int) (int64_t) it [ 1 ] ) );
+  }
+  return result;
+}
+
+inline ParameterRecord
+MappedDatabase::parameterRecord ( uint64_t i ) const {
+  std::pair < const uint64_t *, const uint64_t * > r = range_ ( DB_PR_MSS_OFFSETS, DB_PR_MSS, i );
+  return ParameterRecord ( at_ ( DB_PR_PARAMETER, i ), at_ ( DB_PR_MORSEGRAPH, i ),
+                           std::vector<uint64_t> ( r . first, r . second ) );
+}
+
+inline ClutchingRecord
+MappedDatabase::clutchRecord ( uint64_t i ) const {
+  return ClutchingRecord ( at_ ( DB_CR_PARAMETER_1, i ),
+                           at_ ( DB_CR_PARAMETER_2, i ),
+                           at_ ( DB_CR_BG, i ) );
+}
+
+inline std::string
+MappedDatabase::string ( uint64_t i ) const {
+  return chars_ ( DB_STRING_OFFSETS, i );
+}
+
+inline Annotation_Record
+MappedDatabase::annotation ( uint64_t i ) const {
+  Annotation_Record result;
+  std::pair < const uint64_t *, const uint64_t * > r =
+    range_ ( DB_ANNOTATION_OFFSETS, DB_ANNOTATION_VALUES, i );
+  result . string_indices . insert ( r . first, r . second );
+  return result;
+}
+
+inline MorseGraphRecord
+MappedDatabase::morsegraph ( uint64_t i ) const {
+  std::pair < const uint64_t *, const uint64_t * > r = range_ ( DB_MG_ABV_OFFSETS, DB_MG_ABV, i );
+  return MorseGraphRecord ( at_ ( DB_MG_DAG, i ), at_ ( DB_MG_ANNOTATION, i ),
+                            std::vector<uint64_t> ( r . first, r . second ) );
+}
+
+inline DAG_Data
+MappedDatabase::dag ( uint64_t i ) const {
+  DAG_Data result;
+  result . num_vertices = (int) at_ ( DB_DAG_NUM_VERTICES, i );
+  result . partial_order = edges_ ( DB_DAG_OFFSETS, DB_DAG_EDGES, i );
+  return result;
+}
+
+inline BG_Data
+MappedDatabase::bg ( uint64_t i ) const {
+  BG_Data result;
+  result . edges = edges_ ( DB_BG_OFFSETS, DB_BG_EDGES, i );
+  return result;
+}
+
+inline CS_Data
+MappedDatabase::cs ( uint64_t i ) const {
+  CS_Data result;
+  std::pair < const uint64_t *, const uint64_t * > r = range_ ( DB_CS_OFFSETS, DB_CS_VALUES, i );
+  for ( const uint64_t * it = r . first; it != r . second; ++ it ) {
+    result . vertices . push_back ( (int) (int64_t) *it );
+  }
+  return result;
+}
+
+inline CI_Data
+MappedDatabase::ci ( uint64_t i ) const {
+  CI_Data result;
+  // DB_CI_OFFSETS indexes into the list of strings described by DB_CI_STRING_OFFSETS
+  for ( uint64_t s = at_ ( DB_CI_OFFSETS, i ); s < at_ ( DB_CI_OFFSETS, i + 1 ); ++ s ) {
+    result . conley_index . push_back ( chars_ ( DB_CI_STRING_OFFSETS, s ) );
+  }
+  return result;
+}
+
+inline MGCCP_Record
+MappedDatabase::MGCCP ( uint64_t i ) const {
+  MGCCP_Record result;
+  std::pair < const uint64_t *, const uint64_t * > r =
+    range_ ( DB_MGCCP_OFFSETS, DB_MGCCP_PARAMETERS, i );
+  result . parameter_indices . assign ( r . first, r . second );
+  result . morsegraph_index = at_ ( DB_MGCCP_MORSEGRAPH, i );
+  return result;
+}
+
+inline INCCP_Record
+MappedDatabase::INCCP ( uint64_t i ) const {
+  INCCP_Record result;
+  result . cs_index = at_ ( DB_INCCP_CS, i );
+  result . mgccp_index = at_ ( DB_INCCP_MGCCP, i );
+  return result;
+}
+
+inline MGCC_Record
+MappedDatabase::MGCC ( uint64_t i ) const {
+  MGCC_Record result;
+  std::pair < const uint64_t *, const uint64_t * > r =
+    range_ ( DB_MGCC_OFFSETS, DB_MGCC_VALUES, i );
+  result . mgccp_indices . assign ( r . first, r . second );
+  return result;
+}
+
+inline INCC_Record
+MappedDatabase::INCC ( uint64_t i ) const {
+  INCC_Record result;
+  std::pair < const uint64_t *, const uint64_t * > r =
+    range_ ( DB_INCC_OFFSETS, DB_INCC_VALUES, i );
+  result . inccp_indices . assign ( r . first, r . second );
+  r = range_ ( DB_INCC_REP_OFFSETS, DB_INCC_REPS, i );
+  for ( const uint64_t * it = r . first; it != r . second; it += 3 ) {
+    result . smallest_reps . insert ( std::make_pair ( it [ 0 ],
+                                      std::make_pair ( it [ 1 ], it [ 2 ] ) ) );
+  }
+  return result;
+}
+
+inline std::vector<uint64_t>
+MappedDatabase::incc_to_mgcc ( uint64_t i ) const {
+  std::pair < const uint64_t *, const uint64_t * > r =
+    range_ ( DB_INCC_TO_MGCC_OFFSETS, DB_INCC_TO_MGCC, i );
+  return std::vector<uint64_t> ( r . first, r . second );
+}
+
+inline std::vector<uint64_t>
+MappedDatabase::mgcc_nb ( uint64_t i ) const {
+  std::pair < const uint64_t *, const uint64_t * > r =
+    range_ ( DB_MGCC_NB_OFFSETS, DB_MGCC_NB, i );
+  return std::vector<uint64_t> ( r . first, r . second );
+}
+
+// Index lookups. Each probes the stored hash table, comparing candidates
+// by decoding them.
+
+inline uint64_t
+MappedDatabase::stringIndex ( const std::string & item ) const {
+  return probeColumnarHashTable ( column ( DB_STRING_HASH ), columnSize ( DB_STRING_HASH ),
+    columnarHash ( item ),
+    [&] ( uint64_t i ) { return string ( i ) == item; }, numStrings () );
+}
+
+inline uint64_t
+MappedDatabase::annotationIndex ( const Annotation_Record & item ) const {
+  return probeColumnarHashTable ( column ( DB_ANNOTATION_HASH ), columnSize ( DB_ANNOTATION_HASH ),
+    columnarHash ( item ),
+    [&] ( uint64_t i ) { return annotation ( i ) == item; }, numAnnotations () );
+}
+
+inline uint64_t
+MappedDatabase::morsegraphIndex ( const MorseGraphRecord & item ) const {
+  return probeColumnarHashTable ( column ( DB_MG_HASH ), columnSize ( DB_MG_HASH ),
+    columnarHash ( item ),
+    [&] ( uint64_t i ) { return morsegraph ( i ) == item; }, numMorseGraphs () );
+}
+
+inline uint64_t
+MappedDatabase::dagIndex ( const DAG_Data & item ) const {
+  return probeColumnarHashTable ( column ( DB_DAG_HASH ), columnSize ( DB_DAG_HASH ),
+    columnarHash ( item ),
+    [&] ( uint64_t i ) { return dag ( i ) == item; }, numDAGs () );
+}
+
+inline uint64_t
+MappedDatabase::bgIndex ( const BG_Data & item ) const {
+  return probeColumnarHashTable ( column ( DB_BG_HASH ), columnSize ( DB_BG_HASH ),
+    columnarHash ( item ),
+    [&] ( uint64_t i ) { return bg ( i ) == item; }, numBGs () );
+}
+
+inline uint64_t
+MappedDatabase::csIndex ( const CS_Data & item ) const {
+  return probeColumnarHashTable ( column ( DB_CS_HASH ), columnSize ( DB_CS_HASH ),
+    columnarHash ( item ),
+    [&] ( uint64_t i ) { return cs ( i ) == item; }, numCSs () );
+}
+
+inline uint64_t
+MappedDatabase::ciIndex ( const CI_Data & item ) const {
+  return probeColumnarHashTable ( column ( DB_CI_HASH ), columnSize ( DB_CI_HASH ),
+    columnarHash ( item ),
+    [&] ( uint64_t i ) { return ci ( i ) == item; }, numCIs () );
+}
+
+inline uint64_t
+MappedDatabase::inccpIndex ( const INCCP_Record & item ) const {
+  return probeColumnarHashTable ( column ( DB_INCCP_HASH ), columnSize ( DB_INCCP_HASH ),
+    columnarHash ( item ),
+    [&] ( uint64_t i ) { return INCCP ( i ) == item; }, numINCCPs () );
+}
+
+/// columnarDatabaseFile
+///   Return the name of a columnar copy of the database "filename", for
+///   MappedDatabase. A columnar file is its own copy; an archive-format one
+///   (see CMDB_ARCHIVE_DATABASE) is converted to "filename.columnar".
+inline std::string
+columnarDatabaseFile ( const std::string & filename ) {
+  if ( ColumnarFile::isColumnar ( filename . c_str () ) ) return filename;
+  Database archived;
+  archived . load ( filename . c_str () );
+  std::string columnar = filename + ".columnar";
+  archived . saveColumnar ( columnar . c_str () );
+  return columnar;
+}
+
+/**********************************/
+/*  Database columnar save/load   */
+/**********************************/
+
+namespace database_columnar_detail {
+
+  inline void
+  beginColumn ( std::vector<uint64_t> * offsets ) {
+    offsets -> clear ();
+    offsets -> push_back ( 0 );
+  }
+
+  template < class Container > void
+  appendRecord ( const Container & items,
+                 std::vector<uint64_t> * offsets,
+                 std::vector<uint64_t> * values ) {
+    for ( typename Container::const_iterator it = items . begin (); it != items . end (); ++ it ) {
+      values -> push_back ( (uint64_t) *it );
+    }
+    offsets -> push_back ( values -> size () );
+  }
+
+  inline void
+  appendEdges ( const std::vector < std::pair < int, int > > & edges,
+                std::vector<uint64_t> * offsets,
+                std::vector<uint64_t> * values ) {
+    typedef std::pair<int,int> intpair;
+    BOOST_FOREACH ( const intpair & e, edges ) {
+      values -> push_back ( (uint64_t) (int64_t) e . first );
+      values -> push_back ( (uint64_t) (int64_t) e . second );
+    }
+    offsets -> push_back ( values -> size () );
+  }
+
+  inline void
+  appendChars ( const std::string & s,
+                std::vector<uint64_t> * offsets,
+                std::vector<char> * chars ) {
+    chars -> insert ( chars -> end (), s . begin (), s . end () );
+    offsets -> push_back ( chars -> size () );
+  }
+
+}
+
+inline void
+Database::saveColumnar ( const char * filename ) const {
+  using namespace database_columnar_detail;
+  ColumnarWriter writer;
+  std::vector<uint64_t> a, b, c, d;
+  std::vector<char> chars;
+
+  // Parameter space (polymorphic, so it remains a boost archive)
+  if ( parameter_space_ ) {
+    std::ostringstream oss;
+    {
+      boost::archive::binary_oarchive oa ( oss );
+      oa << parameter_space_;
+    }
+    std::string bytes = oss . str ();
+    writer . add ( DB_PARAMETER_SPACE, bytes . data (), bytes . size () );
+  }
+
+  // Parameter records
+  a . clear (); b . clear (); d . clear (); beginColumn ( &c );
+  BOOST_FOREACH ( const ParameterRecord & record, parameter_records_ ) {
+    a . push_back ( record . parameter_index );
+    b . push_back ( record . morsegraph_index );
+    appendRecord ( record . morseset_sizes, &c, &d );
+  }
+  writer . add ( DB_PR_PARAMETER, a );
+  writer . add ( DB_PR_MORSEGRAPH, b );
+  writer . add ( DB_PR_MSS_OFFSETS, c );
+  writer . add ( DB_PR_MSS, d );
+
+  // Clutching records
+  a . clear (); b . clear (); c . clear ();
+  BOOST_FOREACH ( const ClutchingRecord & record, clutch_records_ ) {
+    a . push_back ( record . parameter_index_1 );
+    b . push_back ( record . parameter_index_2 );
+    c . push_back ( record . bg_index );
+  }
+  writer . add ( DB_CR_PARAMETER_1, a );
+  writer . add ( DB_CR_PARAMETER_2, b );
+  writer . add ( DB_CR_BG, c );
+
+  // Strings
+  beginColumn ( &a ); chars . clear ();
+  BOOST_FOREACH ( const std::string & s, string_data_ ) appendChars ( s, &a, &chars );
+  writer . add ( DB_STRING_OFFSETS, a );
+  writer . add ( DB_STRING_CHARS, chars );
+
+  // Annotations
+  beginColumn ( &a ); b . clear ();
+  BOOST_FOREACH ( const Annotation_Record & record, annotation_data_ ) {
+    appendRecord ( record . string_indices, &a, &b );
+  }
+  writer . add ( DB_ANNOTATION_OFFSETS, a );
+  writer . add ( DB_ANNOTATION_VALUES, b );
+
+  // Morse graphs
+  a . clear (); b . clear (); beginColumn ( &c ); d . clear ();
+  BOOST_FOREACH ( const MorseGraphRecord & record, morsegraph_data_ ) {
+    a . push_back ( record . dag_index );
+    b . push_back ( record . annotation_index );
+    appendRecord ( record . annotation_index_by_vertex, &c, &d );
+  }
+  writer . add ( DB_MG_DAG, a );
+  writer . add ( DB_MG_ANNOTATION, b );
+  writer . add ( DB_MG_ABV_OFFSETS, c );
+  writer . add ( DB_MG_ABV, d );
+
+  // DAGs
+  a . clear (); beginColumn ( &b ); c . clear ();
+  BOOST_FOREACH ( const DAG_Data & dag, dag_data_ ) {
+    a . push_back ( (uint64_t) dag . num_vertices );
+    appendEdges ( dag . partial_order, &b, &c );
+  }
+  writer . add ( DB_DAG_NUM_VERTICES, a );
+  writer . add ( DB_DAG_OFFSETS, b );
+  writer . add ( DB_DAG_EDGES, c );
+
+  // Bipartite graphs
+  beginColumn ( &a ); b . clear ();
+  BOOST_FOREACH ( const BG_Data & bg, bg_data_ ) appendEdges ( bg . edges, &a, &b );
+  writer . add ( DB_BG_OFFSETS, a );
+  writer . add ( DB_BG_EDGES, b );
+
+  // Convex sets
+  beginColumn ( &a ); b . clear ();
+  BOOST_FOREACH ( const CS_Data & cs, cs_data_ ) {
+    std::vector<uint64_t> vertices;
+    BOOST_FOREACH ( int v, cs . vertices ) vertices . push_back ( (uint64_t) (int64_t) v );
+    appendRecord ( vertices, &a, &b );
+  }
+  writer . add ( DB_CS_OFFSETS, a );
+  writer . add ( DB_CS_VALUES, b );
+
+  // Conley indices
+  beginColumn ( &a ); beginColumn ( &b ); chars . clear ();
+  BOOST_FOREACH ( const CI_Data & ci, ci_data_ ) {
+    BOOST_FOREACH ( const std::string & s, ci . conley_index ) appendChars ( s, &b, &chars );
+    a . push_back ( b . size () - 1 );
+  }
+  writer . add ( DB_CI_OFFSETS, a );
+  writer . add ( DB_CI_STRING_OFFSETS, b );
+  writer . add ( DB_CI_CHARS, chars );
+
+  // Continuation records
+  beginColumn ( &a ); b . clear (); c . clear ();
+  BOOST_FOREACH ( const MGCCP_Record & record, MGCCP_records_ ) {
+    appendRecord ( record . parameter_indices, &a, &b );
+    c . push_back ( record . morsegraph_index );
+  }
+  writer . add ( DB_MGCCP_OFFSETS, a );
+  writer . add ( DB_MGCCP_PARAMETERS, b );
+  writer . add ( DB_MGCCP_MORSEGRAPH, c );
+
+  a . clear (); b . clear ();
+  BOOST_FOREACH ( const INCCP_Record & record, INCCP_records_ ) {
+    a . push_back ( record . cs_index );
+    b . push_back ( record . mgccp_index );
+  }
+  writer . add ( DB_INCCP_CS, a );
+  writer . add ( DB_INCCP_MGCCP, b );
+
+  beginColumn ( &a ); b . clear ();
+  BOOST_FOREACH ( const MGCC_Record & record, MGCC_records_ ) {
+    appendRecord ( record . mgccp_indices, &a, &b );
+  }
+  writer . add ( DB_MGCC_OFFSETS, a );
+  writer . add ( DB_MGCC_VALUES, b );
+
+  beginColumn ( &a ); b . clear (); beginColumn ( &c ); d . clear ();
+  typedef std::pair<uint64_t,std::pair<uint64_t,uint64_t> > Rep;
+  BOOST_FOREACH ( const INCC_Record & record, INCC_records_ ) {
+    appendRecord ( record . inccp_indices, &a, &b );
+    BOOST_FOREACH ( const Rep & rep, record . smallest_reps ) {
+      d . push_back ( rep . first );
+      d . push_back ( rep . second . first );
+      d . push_back ( rep . second . second );
+    }
+    c . push_back ( d . size () );
+  }
+  writer . add ( DB_INCC_OFFSETS, a );
+  writer . add ( DB_INCC_VALUES, b );
+  writer . add ( DB_INCC_REP_OFFSETS, c );
+  writer . add ( DB_INCC_REPS, d );
+
+  writer . add ( DB_PB_TO_MGCCP, pb_to_mgccp_ );
+  writer . add ( DB_MGCCP_TO_MGCC, mgccp_to_mgcc_ );
+  writer . add ( DB_INCCP_TO_INCC, inccp_to_incc_ );
+  writer . add ( DB_MGCC_SIZES, mgcc_sizes_ );
+  writer . add ( DB_INCC_SIZES, incc_sizes_ );
+  writer . add ( DB_INCC_CONLEY, incc_conley_ );
+
+  beginColumn ( &a ); b . clear ();
+  BOOST_FOREACH ( const std::unordered_set<uint64_t> & s, incc_to_mgcc_ ) appendRecord ( s, &a, &b );
+  writer . add ( DB_INCC_TO_MGCC_OFFSETS, a );
+  writer . add ( DB_INCC_TO_MGCC, b );
+
+  beginColumn ( &a ); b . clear ();
+  BOOST_FOREACH ( const std::unordered_set<uint64_t> & s, mgcc_nb_ ) appendRecord ( s, &a, &b );
+  writer . add ( DB_MGCC_NB_OFFSETS, a );
+  writer . add ( DB_MGCC_NB, b );
+
+  // Prebuilt hash indices
+  writer . add ( DB_STRING_HASH, buildColumnarHashTable ( string_data_ . size (),
+    [&] ( uint64_t i ) { return columnarHash ( string_data_ [ i ] ); } ) );
+  writer . add ( DB_ANNOTATION_HASH, buildColumnarHashTable ( annotation_data_ . size (),
+    [&] ( uint64_t i ) { return columnarHash ( annotation_data_ [ i ] ); } ) );
+  writer . add ( DB_MG_HASH, buildColumnarHashTable ( morsegraph_data_ . size (),
+    [&] ( uint64_t i ) { return columnarHash ( morsegraph_data_ [ i ] ); } ) );
+  writer . add ( DB_DAG_HASH, buildColumnarHashTable ( dag_data_ . size (),
+    [&] ( uint64_t i ) { return columnarHash ( dag_data_ [ i ] ); } ) );
+  writer . add ( DB_BG_HASH, buildColumnarHashTable ( bg_data_ . size (),
+    [&] ( uint64_t i ) { return columnarHash ( bg_data_ [ i ] ); } ) );
+  writer . add ( DB_CS_HASH, buildColumnarHashTable ( cs_data_ . size (),
+    [&] ( uint64_t i ) { return columnarHash ( cs_data_ [ i ] ); } ) );
+  writer . add ( DB_CI_HASH, buildColumnarHashTable ( ci_data_ . size (),
+    [&] ( uint64_t i ) { return columnarHash ( ci_data_ [ i ] ); } ) );
+  writer . add ( DB_INCCP_HASH, buildColumnarHashTable ( INCCP_records_ . size (),
+    [&] ( uint64_t i ) { return columnarHash ( INCCP_records_ [ i ] ); } ) );
+  std::vector<uint64_t> hash_version ( 1, CMDB_COLUMNAR_HASH_VERSION );
+  writer . add ( DB_HASH_VERSION, hash_version );
+
+  writer . write ( filename );
+}
+
+inline void
+Database::loadColumnar ( const char * filename ) {
+  MappedDatabase mapped ( filename );
+  const ColumnarFile & file = mapped . file ();
+  * this = Database ();
+  parameter_space_ = mapped . parameterSpace ();
+
+  parameter_records_ . resize ( mapped . numParameterRecords () );
+  for ( uint64_t i = 0; i < parameter_records_ . size (); ++ i )
+    parameter_records_ [ i ] = mapped . parameterRecord ( i );
+  clutch_records_ . resize ( mapped . numClutchRecords () );
+  for ( uint64_t i = 0; i < clutch_records_ . size (); ++ i )
+    clutch_records_ [ i ] = mapped . clutchRecord ( i );
+  string_data_ . resize ( mapped . numStrings () );
+  for ( uint64_t i = 0; i < string_data_ . size (); ++ i )
+    string_data_ [ i ] = mapped . string ( i );
+  annotation_data_ . resize ( mapped . numAnnotations () );
+  for ( uint64_t i = 0; i < annotation_data_ . size (); ++ i )
+    annotation_data_ [ i ] = mapped . annotation ( i );
+  morsegraph_data_ . resize ( mapped . numMorseGraphs () );
+  for ( uint64_t i = 0; i < morsegraph_data_ . size (); ++ i )
+    morsegraph_data_ [ i ] = mapped . morsegraph ( i );
+  dag_data_ . resize ( mapped . numDAGs () );
+  for ( uint64_t i = 0; i < dag_data_ . size (); ++ i )
+    dag_data_ [ i ] = mapped . dag ( i );
+  bg_data_ . resize ( mapped . numBGs () );
+  for ( uint64_t i = 0; i < bg_data_ . size (); ++ i )
+    bg_data_ [ i ] = mapped . bg ( i );
+  cs_data_ . resize ( mapped . numCSs () );
+  for ( uint64_t i = 0; i < cs_data_ . size (); ++ i )
+    cs_data_ [ i ] = mapped . cs ( i );
+  ci_data_ . resize ( mapped . numCIs () );
+  for ( uint64_t i = 0; i < ci_data_ . size (); ++ i )
+    ci_data_ [ i ] = mapped . ci ( i );
+  MGCCP_records_ . resize ( mapped . numMGCCPs () );
+  for ( uint64_t i = 0; i < MGCCP_records_ . size (); ++ i )
+    MGCCP_records_ [ i ] = mapped . MGCCP ( i );
+  INCCP_records_ . resize ( mapped . numINCCPs () );
+  for ( uint64_t i = 0; i < INCCP_records_ . size (); ++ i )
+    INCCP_records_ [ i ] = mapped . INCCP ( i );
+  MGCC_records_ . resize ( mapped . numMGCCs () );
+  for ( uint64_t i = 0; i < MGCC_records_ . size (); ++ i )
+    MGCC_records_ [ i ] = mapped . MGCC ( i );
+  INCC_records_ . resize ( mapped . numINCCs () );
+  for ( uint64_t i = 0; i < INCC_records_ . size (); ++ i )
+    INCC_records_ [ i ] = mapped . INCC ( i );
+
+  file . read ( DB_PB_TO_MGCCP, &pb_to_mgccp_ );
+  file . read ( DB_MGCCP_TO_MGCC, &mgccp_to_mgcc_ );
+  file . read ( DB_INCCP_TO_INCC, &inccp_to_incc_ );
+  file . read ( DB_MGCC_SIZES, &mgcc_sizes_ );
+  file . read ( DB_INCC_SIZES, &incc_sizes_ );
+  file . read ( DB_INCC_CONLEY, &incc_conley_ );
+  uint64_t num_incc_to_mgcc = mapped . columnSize ( DB_INCC_TO_MGCC_OFFSETS );
+  if ( num_incc_to_mgcc > 0 ) -- num_incc_to_mgcc;
+  incc_to_mgcc_ . resize ( num_incc_to_mgcc );
+  for ( uint64_t i = 0; i < incc_to_mgcc_ . size (); ++ i ) {
+    std::vector<uint64_t> items = mapped . incc_to_mgcc ( i );
+    incc_to_mgcc_ [ i ] . insert ( items . begin (), items . end () );
+  }
+  uint64_t num_mgcc_nb = mapped . columnSize ( DB_MGCC_NB_OFFSETS );
+  if ( num_mgcc_nb > 0 ) -- num_mgcc_nb;
+  mgcc_nb_ . resize ( num_mgcc_nb );
+  for ( uint64_t i = 0; i < mgcc_nb_ . size (); ++ i ) {
+    std::vector<uint64_t> items = mapped . mgcc_nb ( i );
+    mgcc_nb_ [ i ] . insert ( items . begin (), items . end () );
+  }
+  // The std::unordered_map indices are rebuilt only if they are used
+  indexed_ = false;
+}
+
+#endif
@@ -22,6 +22,7 @@
 #include <boost/archive/text_iarchive.hpp>
 
 #include "database/structures/Grid.h"
+#include "database/structures/LabelledTree.h"
 #include "chomp/ConleyIndex.h"
 
 
@@ -99,6 +100,12 @@ class MorseGraph {
 
   /** Remove the grids associated with the vertices */
   void clearGrids ( void );
+
+  /** The trees of the Morse sets merged into one labelled tree per chart
+   *  of phase space (see LabelledTree.h). Built on the first call and
+   *  kept until the grids are changed through a non-const accessor;
+   *  the first call is not thread-safe. */
+  const std::vector < LabelledTree > & labelledTrees ( void ) const;
   
   //// FILE IO
 
@@ -119,6 +126,7 @@ class MorseGraph {
     }
     boost::archive::text_iarchive ia(ifs);
     ia >> *this;
+    labelled_trees_ . reset ();
   }
 private:
   // DATA
@@ -129,6 +137,7 @@ private:
   std::vector < boost::shared_ptr < chomp::ConleyIndex_t > > conleyindexes_;
   std::set < std::string > annotation_;
   std::vector < std::set < std::string > > annotation_by_vertex_;
+  mutable boost::shared_ptr < std::vector < LabelledTree > > labelled_trees_;
   //// SERIALIZATION
   friend class boost::serialization::access;
   template<class Archive>
@@ -168,6 +177,7 @@ MorseGraph::MorseGraph ( const char * filename ) {
  */
 inline MorseGraph::Vertex MorseGraph::AddVertex ( void ) {
   int v = num_vertices_ ++;
+  labelled_trees_ . reset ();
   grids_ . push_back ( boost::shared_ptr <Grid > ());
   conleyindexes_ . push_back ( boost::shared_ptr <chomp::ConleyIndex_t > ());
   annotation_by_vertex_ . resize ( num_vertices_ );
@@ -206,6 +216,7 @@ MorseGraph::Edges ( void ) const {
 /** accessor method for phase space grid */
 inline
 boost::shared_ptr<Grid> & MorseGraph::phaseSpace ( void ) {
+  labelled_trees_ . reset ();
   return phasespace_;
 }
 /** accessor method for phase space grid, const version */
@@ -216,6 +227,7 @@ boost::shared_ptr<const Grid> MorseGraph::phaseSpace ( void ) const {
 
 /** accessor method for grid assigned to vertex */
 inline boost::shared_ptr<Grid> & MorseGraph::grid(Vertex vertex) {
+  labelled_trees_ . reset ();
   return grids_[vertex];
 }
 
@@ -262,5 +274,17 @@ inline void MorseGraph::clearGrids ( void ) {
   }
 }
 
+/** labelled trees of the Morse sets, built on first use */
+inline const std::vector < LabelledTree > & 
+MorseGraph::labelledTrees ( void ) const {
+  if ( not labelled_trees_ ) {
+    boost::shared_ptr < std::vector < LabelledTree > > 
+      trees ( new std::vector < LabelledTree > );
+    buildLabelledTrees ( trees . get (), phasespace_, grids_ );
+    labelled_trees_ = trees;
+  }
+  return * labelled_trees_;
+}
+
 
 #endif
@@ -0,0 +1,194 @@
+/* MorseGraphCache.h */
+
+#ifndef CMDB_MORSEGRAPHCACHE_H
+#define CMDB_MORSEGRAPHCACHE_H
+
+#include <stdint.h>
+#include <list>
+#include <utility>
+
+#include "boost/unordered_map.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
+
+#include "database/structures/MorseGraph.h"
+
+/// class MorseGraphCache
+///   Least-recently-used cache of computed Morse graphs, keyed by
+///   parameter index. Parameters on the boundary of a ParameterPatch
+///   belong to several patches; a worker that receives more than one of
+///   those patches can reuse the Morse graph (with its Morse set grids,
+///   which clutching needs) instead of recomputing it.
+///   The cache evicts least-recently-used entries to stay within a memory
+///   budget, estimated from the grids and labelled trees held by each 
+///   Morse graph.
+///   A memory budget of 0 disables the cache.
+class MorseGraphCache {
+public:
+  typedef boost::shared_ptr<MorseGraph> MorseGraphPtr;
+
+  /// MorseGraphCache
+  MorseGraphCache ( uint64_t memory_budget = 0 );
+
+  /// budget
+  ///   Accessor for the memory budget (in bytes)
+  uint64_t budget ( void ) const;
+  void setBudget ( uint64_t memory_budget );
+
+  /// find
+  ///   Return the cached Morse graph of parameter index, or a null
+  ///   pointer if there is none. Marks the entry as recently used.
+  MorseGraphPtr find ( uint64_t index );
+
+  /// insert
+  ///   Cache the Morse graph of parameter index, evicting least-recently
+  ///   used entries as necessary. Graphs larger than the budget are not cached.
+  ///   The labelled trees of the graph are built first, so that their memory
+  ///   is charged too; the graph must not yet be in use by other threads.
+  void insert ( uint64_t index, MorseGraphPtr morse_graph );
+
+  /// clear
+  void clear ( void );
+
+  /// size
+  ///   Number of cached Morse graphs
+  uint64_t size ( void ) const;
+
+  /// memory
+  ///   Estimated number of bytes held by the cache
+  uint64_t memory ( void ) const;
+
+  /// hits
+  uint64_t hits ( void ) const;
+
+  /// misses
+  uint64_t misses ( void ) const;
+
+  /// estimateMemory
+  ///   Estimate the memory held by a Morse graph (phase space, Morse set
+  ///   grids and labelled trees, which are built if need be)
+  static uint64_t estimateMemory ( const MorseGraph & morse_graph );
+
+private:
+  void evict_ ( void );
+  typedef std::pair < uint64_t, MorseGraphPtr > Entry;
+  typedef std::list < Entry > EntryList;
+  EntryList entries_; // most recently used at front
+  boost::unordered_map < uint64_t, EntryList::iterator > index_;
+  boost::unordered_map < uint64_t, uint64_t > memory_of_;
+  uint64_t budget_;
+  uint64_t memory_;
+  uint64_t hits_;
+  uint64_t misses_;
+  mutable boost::mutex mutex_;
+};
+
+inline
+MorseGraphCache::MorseGraphCache ( uint64_t memory_budget ) :
+budget_ ( memory_budget ),
+memory_ ( 0 ),
+hits_ ( 0 ),
+misses_ ( 0 ) {}
+
+inline uint64_t
+MorseGraphCache::budget ( void ) const {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  return budget_;
+}
+
+inline void
+MorseGraphCache::setBudget ( uint64_t memory_budget ) {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  budget_ = memory_budget;
+  evict_ ();
+}
+
+inline MorseGraphCache::MorseGraphPtr
+MorseGraphCache::find ( uint64_t index ) {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  boost::unordered_map < uint64_t, EntryList::iterator >::iterator it =
+    index_ . find ( index );
+  if ( it == index_ . end () ) {
+    ++ misses_;
+    return MorseGraphPtr ();
+  }
+  ++ hits_;
+  entries_ . splice ( entries_ . begin (), entries_, it -> second );
+  return it -> second -> second;
+}
+
+inline void
+MorseGraphCache::insert ( uint64_t index, MorseGraphPtr morse_graph ) {
+  if ( budget () == 0 || not morse_graph ) return;
+  // Estimated outside the lock, as it may build the labelled trees
+  uint64_t bytes = estimateMemory ( * morse_graph );
+  boost::mutex::scoped_lock lock ( mutex_ );
+  if ( bytes > budget_ || index_ . count ( index ) ) return;
+  entries_ . push_front ( Entry ( index, morse_graph ) );
+  index_ [ index ] = entries_ . begin ();
+  memory_of_ [ index ] = bytes;
+  memory_ += bytes;
+  evict_ ();
+}
+
+inline void
+MorseGraphCache::clear ( void ) {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  entries_ . clear ();
+  index_ . clear ();
+  memory_of_ . clear ();
+  memory_ = 0;
+}
+
+inline uint64_t
+MorseGraphCache::size ( void ) const {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  return entries_ . size ();
+}
+
+inline uint64_t
+MorseGraphCache::memory ( void ) const {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  return memory_;
+}
+
+inline uint64_t
+MorseGraphCache::hits ( void ) const {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  return hits_;
+}
+
+inline uint64_t
+MorseGraphCache::misses ( void ) const {
+  boost::mutex::scoped_lock lock ( mutex_ );
+  return misses_;
+}
+
+inline uint64_t
+MorseGraphCache::estimateMemory ( const MorseGraph & morse_graph ) {
+  uint64_t result = sizeof ( MorseGraph );
+  if ( morse_graph . phaseSpace () ) {
+    result += morse_graph . phaseSpace () -> memory ();
+  }
+  for ( MorseGraph::Vertex v = 0; v < (MorseGraph::Vertex) morse_graph . NumVertices (); ++ v ) {
+    if ( morse_graph . grid ( v ) ) result += morse_graph . grid ( v ) -> memory ();
+  }
+  for ( LabelledTree const& tree : morse_graph . labelledTrees () ) {
+    result += tree . memory ();
+  }
+  return result;
+}
+
+inline void
+MorseGraphCache::evict_ ( void ) {
+  // Assumes mutex_ is held
+  while ( memory_ > budget_ && not entries_ . empty () ) {
+    uint64_t index = entries_ . back () . first;
+    memory_ -= memory_of_ [ index ];
+    memory_of_ . erase ( index );
+    index_ . erase ( index );
+    entries_ . pop_back ();
+  }
+}
+
+#endif
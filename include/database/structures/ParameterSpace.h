@@ -1,6 +1,7 @@
 #ifndef CMDB_PARAMETERSPACE_H
 #define CMDB_PARAMETERSPACE_H
 
+#include <stdint.h>
 #include <vector>
 #include <utility>
 #include "unordered_map"
@@ -86,6 +87,16 @@ public:
 	/// adjacencies
 	///    Return a vector of adjacent vertices.
 	virtual std::vector<ParameterIndex> adjacencies ( ParameterIndex v ) const = 0;
+
+	/// adjacencyBlock
+	///    Write the adjacencies of the vertices begin, ..., end - 1 in compressed
+	///    sparse row form: the neighbors of begin + i are
+	///    targets [ offsets [ i ] ], ..., targets [ offsets [ i + 1 ] - 1 ]
+	///    (offsets gets end - begin + 1 entries). Must be safe to call from
+	///    several threads at once. The default implementation calls adjacencies.
+	virtual void adjacencyBlock ( ParameterIndex begin, ParameterIndex end,
+	                              std::vector<uint64_t> * offsets,
+	                              std::vector<ParameterIndex> * targets ) const;
 	
 	/// size
 	///    Return the number of vertices
@@ -126,6 +137,7 @@ private:
 	// variables for default implementation of "patch" method
 	mutable uint64_t default_patch_method_vertex_;
 	mutable uint64_t default_patch_method_edge_;
+	mutable std::vector<uint64_t> default_patch_method_offsets_;
 	mutable std::vector<ParameterIndex> default_patch_method_neighbors_;
 
 	// Serialization
@@ -152,7 +164,9 @@ ParameterSpace::patch ( void ) const {
         //std::cout << "ParameterSpace::patch. Returning empty patch.\n"; // DEBUG
 				return result;
 			} else {
-				default_patch_method_neighbors_ = adjacencies ( default_patch_method_vertex_ );
+				adjacencyBlock ( default_patch_method_vertex_, default_patch_method_vertex_ + 1,
+				                 & default_patch_method_offsets_,
+				                 & default_patch_method_neighbors_ );
 			}
 		}
 		ParameterIndex u = default_patch_method_vertex_;
@@ -187,6 +201,19 @@ ParameterSpace::patch ( void ) const {
 	return result;
 }
 
+inline void
+ParameterSpace::adjacencyBlock ( ParameterIndex begin, ParameterIndex end,
+                                 std::vector<uint64_t> * offsets,
+                                 std::vector<ParameterIndex> * targets ) const {
+	offsets -> assign ( 1, 0 );
+	targets -> clear ();
+	for ( ParameterIndex v = begin; v < end; ++ v ) {
+		std::vector<ParameterIndex> neighbors = adjacencies ( v );
+		targets -> insert ( targets -> end (), neighbors . begin (), neighbors . end () );
+		offsets -> push_back ( targets -> size () );
+	}
+}
+
 	/// begin
 	///    Return "begin" iterator
 
@@ -31,6 +31,8 @@ public:
   virtual const PointerTree & tree ( void ) const;
   virtual PointerTree & tree ( void );
   virtual PointerGrid * spawn ( void ) const;
+  virtual PointerGrid * clone ( void ) const;
+  virtual void subdivide ( void );
   virtual void rebuild ( boost::shared_ptr<const CompressedTreeGrid> compressed );
   void rebuildFromTree ( void );
 private:
@@ -110,6 +112,21 @@ PointerGrid::spawn ( void ) const {
   return new PointerGrid;
 }
 
+inline PointerGrid * 
+PointerGrid::clone ( void ) const {
+  // Copy directly rather than through compress () and assign ()
+  PointerGrid * result = new PointerGrid ( *this );
+  result -> tree_ . reset ( new PointerTree ( *tree_ ) );
+  return result;
+}
+
+inline void 
+PointerGrid::subdivide ( void ) {
+  // Append the children in place rather than rebuilding the tree
+  tree_ -> subdivide ();
+  rebuildFromTree ();
+}
+
 inline void 
 PointerGrid::rebuild ( boost::shared_ptr<const CompressedTreeGrid> compressed ) {
   rebuildFromTree ();
@@ -120,6 +137,7 @@ PointerGrid::rebuildFromTree ( void ) {
   // Now we rebuild the GridIterator to TreeIterator conversions
   grid_iterators_ . clear ();
   tree_iterators_ . clear ();
+  grid_iterators_ . reserve ( tree () . size () );
   uint64_t leaf_count = 0;
   Tree::iterator end = tree () . end ();
   for ( Tree::iterator it = tree () . begin (); it != end; ++ it ) {
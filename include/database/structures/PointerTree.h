@@ -10,6 +10,7 @@
 #include <deque>
 #include <stack>
 #include <utility>
+#include <algorithm>
 #include <boost/foreach.hpp>
 #include "boost/shared_ptr.hpp"
 #include "database/structures/Tree.h"
@@ -34,6 +35,12 @@ public:
   virtual bool isLeaf ( iterator it ) const;
   virtual void assign ( boost::shared_ptr<const CompressedTree> compressed );
   virtual uint64_t memory ( void ) const;
+
+  /// subdivide
+  ///   Give every leaf two leaf children, appended after the existing
+  ///   nodes in the order of their parents. Since leaves are numbered in
+  ///   node order this keeps them in preorder.
+  void subdivide ( void );
 private:
   std::vector < PointerTreeNode > nodes_;
   std::vector < bool > parity_;
@@ -169,6 +176,33 @@ PointerTree::assign ( boost::shared_ptr<const CompressedTree> compressed ) {
   }
 }
 
+inline void 
+PointerTree::subdivide ( void ) {
+  int64_t old_size = size_;
+  int64_t new_size = old_size + 2 * std::count ( isleaf_ . begin (), isleaf_ . end (), true );
+  nodes_ . reserve ( new_size );
+  parity_ . reserve ( new_size );
+  isleaf_ . reserve ( new_size );
+  for ( int64_t i = 0; i < old_size; ++ i ) {
+    // Missing nodes are represented by size (), which changes
+    if ( nodes_[i] . left_ == old_size ) nodes_[i] . left_ = new_size;
+    if ( nodes_[i] . right_ == old_size ) nodes_[i] . right_ = new_size;
+    if ( nodes_[i] . parent_ == old_size ) nodes_[i] . parent_ = new_size;
+    if ( not isleaf_ [ i ] ) continue;
+    int64_t child = nodes_ . size ();
+    nodes_[i] . left_ = child;
+    nodes_[i] . right_ = child + 1;
+    isleaf_ [ i ] = false;
+    nodes_ . push_back ( PointerTreeNode ( new_size, new_size, i ) );
+    nodes_ . push_back ( PointerTreeNode ( new_size, new_size, i ) );
+    parity_ . push_back ( false );
+    parity_ . push_back ( true );
+    isleaf_ . push_back ( true );
+    isleaf_ . push_back ( true );
+  }
+  size_ = new_size;
+}
+
 inline uint64_t 
 PointerTree::memory ( void ) const {
   return sizeof ( PointerTree ) +
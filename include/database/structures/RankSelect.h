@@ -12,6 +12,7 @@
 #include "boost/serialization/serialization.hpp"
 #include "boost/serialization/vector.hpp"
 #include <inttypes.h>
+#include <utility>
 #include "sdsl/rank_support_v5.hpp"
 #include "sdsl/select_support_mcl.hpp"
 #include "sdsl/util.hpp"
@@ -32,6 +33,12 @@ public:
     assign ( bits );
   }
 
+  /// RankSelect
+  ///    Copy constructor (the supports must refer to the copied bits)
+  RankSelect ( const RankSelect & other ) {
+    *this = other;
+  }
+
   /// assign
   ///    Delayed constructor.
   void assign ( const std::vector < bool > & bits ) {
@@ -41,6 +48,14 @@ public:
     select_ = sdsl::select_support_mcl < > ( &bits_ );
   }
 
+  /// assign
+  ///    Delayed constructor taking over an sdsl bit vector (no copy).
+  void assign ( sdsl::bit_vector && bits ) {
+    bits_ = std::move ( bits );
+    rank_ = sdsl::rank_support_v5 < > ( &bits_ );
+    select_ = sdsl::select_support_mcl < > ( &bits_ );
+  }
+
   /// rank
   ///   @return the rank of the bit sequence at a given position. 
   ///   Here the rank is defined as the number of 1's on [0,i-1]  
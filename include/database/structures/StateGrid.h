@@ -0,0 +1,169 @@
+// StateGrid.h
+
+#ifndef CMDB_STATEGRID_H
+#define CMDB_STATEGRID_H
+
+#include <iostream>
+#include <stdint.h>
+#include <exception>
+#include <stdexcept>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include "boost/shared_ptr.hpp"
+#include "boost/serialization/serialization.hpp"
+#include "boost/serialization/vector.hpp"
+#include "boost/serialization/export.hpp"
+#include "database/structures/Grid.h"
+#include "database/structures/Geo.h"
+
+/// class StateGrid
+///   Grid whose elements are the states of a finite combinatorial system
+///   (e.g. the walls of a switching network), numbered 0 to
+///   numStates () - 1. The grid built by initialize holds every state,
+///   element i being state i; subgrids hold an increasing list of states.
+///   There is no geometry: maps on a StateGrid are StateMaps, which give
+///   adjacency lists directly (see StateMap::adjacencies), and
+///   subdivide leaves the grid unchanged, as states cannot be refined.
+class StateGrid : public Grid {
+public:
+  // Contructor/ Desctructor
+  StateGrid ( void );
+  virtual ~StateGrid ( void ) { }
+
+  // Builders
+  /// initialize
+  ///   Make the grid of all states 0, 1, ..., num_states - 1
+  void initialize ( uint64_t num_states );
+
+  /// assign
+  ///   Make the grid of the given states (increasing, each less than num_states)
+  void assign ( uint64_t num_states, const std::vector<uint64_t> & states );
+
+  // General Methods
+  virtual StateGrid * clone ( void ) const;
+  virtual void subdivide ( void );
+  virtual Grid * subgrid ( const std::deque < GridElement > & grid_elements ) const;
+  virtual std::vector<GridElement> subset ( const Grid & other ) const;
+  virtual boost::shared_ptr<Geo> geometry ( GridElement ge ) const;
+  virtual std::vector<Grid::GridElement> cover ( const Geo & geo ) const;
+  using Grid::geometry;
+  using Grid::cover;
+  virtual uint64_t memory ( void ) const;
+
+  // Features
+  /// numStates
+  ///   Number of states of the system (not of the grid)
+  uint64_t numStates ( void ) const;
+
+  /// state
+  ///   The state grid element ge stands for
+  uint64_t state ( GridElement ge ) const;
+
+  /// element
+  ///   The grid element standing for state, or size () if it is not in the grid
+  GridElement element ( uint64_t state ) const;
+
+private:
+  uint64_t num_states_;
+  // empty when the grid holds every state
+  std::vector<uint64_t> states_;
+
+  friend class boost::serialization::access;
+  template<typename Archive>
+  void serialize(Archive & ar, const unsigned int file_version) {
+    ar & boost::serialization::base_object<Grid>(*this);
+    ar & num_states_;
+    ar & states_;
+  }
+};
+
+BOOST_CLASS_EXPORT_KEY(StateGrid);
+
+inline StateGrid::StateGrid ( void ) : num_states_ ( 0 ) {
+  size_ = 0;
+}
+
+inline void StateGrid::initialize ( uint64_t num_states ) {
+  num_states_ = num_states;
+  states_ . clear ();
+  size_ = num_states;
+}
+
+inline void StateGrid::assign ( uint64_t num_states,
+                                const std::vector<uint64_t> & states ) {
+  if ( states . size () == num_states ) {
+    initialize ( num_states );
+    return;
+  }
+  num_states_ = num_states;
+  states_ = states;
+  size_ = states_ . size ();
+}
+
+inline StateGrid * StateGrid::clone ( void ) const {
+  return new StateGrid ( *this );
+}
+
+inline void StateGrid::subdivide ( void ) {
+  return;
+}
+
+inline Grid * StateGrid::subgrid ( const std::deque < GridElement > & grid_elements ) const {
+  std::vector<uint64_t> states;
+  states . reserve ( grid_elements . size () );
+  for ( GridElement ge : grid_elements ) states . push_back ( state ( ge ) );
+  std::sort ( states . begin (), states . end () );
+  states . erase ( std::unique ( states . begin (), states . end () ), states . end () );
+  StateGrid * newStateGrid = new StateGrid;
+  newStateGrid -> assign ( num_states_, states );
+  return (Grid *) newStateGrid;
+}
+
+inline std::vector<Grid::GridElement>
+StateGrid::subset ( const Grid & other ) const {
+  const StateGrid & otherStateGrid = dynamic_cast<const StateGrid &> (other);
+  std::vector<Grid::GridElement> result;
+  for ( GridElement other_ge = 0; other_ge < otherStateGrid . size (); ++ other_ge ) {
+    GridElement ge = element ( otherStateGrid . state ( other_ge ) );
+    if ( ge != size () ) result . push_back ( ge );
+  }
+  return result;
+}
+
+inline boost::shared_ptr<Geo>
+StateGrid::geometry ( Grid::GridElement ge ) const {
+  throw std::logic_error ( "StateGrid::geometry. States have no geometry.\n" );
+}
+
+inline std::vector<Grid::GridElement>
+StateGrid::cover ( const Geo & geo ) const {
+  throw std::logic_error ( "StateGrid::cover. States have no geometry.\n" );
+}
+
+inline uint64_t StateGrid::memory ( void ) const {
+  return sizeof ( StateGrid ) + sizeof ( uint64_t ) * states_ . capacity ();
+}
+
+// Features
+
+inline uint64_t
+StateGrid::numStates ( void ) const {
+  return num_states_;
+}
+
+inline uint64_t
+StateGrid::state ( GridElement ge ) const {
+  return states_ . empty () ? ge : states_ [ ge ];
+}
+
+inline Grid::GridElement
+StateGrid::element ( uint64_t state ) const {
+  if ( states_ . empty () ) return state < size () ? state : size ();
+  std::vector<uint64_t>::const_iterator it =
+    std::lower_bound ( states_ . begin (), states_ . end (), state );
+  if ( it == states_ . end () || *it != state ) return size ();
+  return it - states_ . begin ();
+}
+
+#endif
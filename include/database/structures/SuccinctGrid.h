@@ -11,6 +11,7 @@
 #include <vector>
 #include <stack>
 #include <deque>
+#include <utility>
 #include "boost/unordered_set.hpp"
 #include "boost/unordered_map.hpp"
 #include "boost/shared_ptr.hpp"
@@ -47,6 +48,8 @@ public:
   virtual const SuccinctTree & tree ( void ) const;
   virtual SuccinctTree & tree ( void );
   virtual SuccinctGrid * spawn ( void ) const;
+  virtual SuccinctGrid * clone ( void ) const;
+  virtual void subdivide ( void );
   virtual void rebuild ( boost::shared_ptr<const CompressedTreeGrid> compressed );
   
 private:
@@ -125,6 +128,45 @@ SuccinctGrid::spawn ( void ) const {
   return new SuccinctGrid;
 }
 
+inline SuccinctGrid * 
+SuccinctGrid::clone ( void ) const {
+  // Copy directly rather than through compress () and assign ()
+  return new SuccinctGrid ( *this );
+}
+
+inline void 
+SuccinctGrid::subdivide ( void ) {
+  // Write the subdivided sequences straight from the current ones
+  // (rather than through compress ()), into pre-sized bit vectors:
+  // every valid leaf "0" becomes "100" and its valid bit becomes "11".
+  const sdsl::bit_vector & leaf_sequence = tree () . leafSequence ();
+  const sdsl::bit_vector & valid_sequence = valid_sequence_ . bitSequence ();
+  uint64_t N = leaf_sequence . size ();
+  uint64_t L = size ();
+  sdsl::bit_vector new_leaf_sequence ( N + 2 * L, 0 );
+  sdsl::bit_vector new_valid_sequence ( valid_sequence . size () + L, 0 );
+  uint64_t j = 0;
+  uint64_t leaf = 0;
+  uint64_t new_leaf = 0;
+  new_leaf_sequence [ j ++ ] = 1; // leading parenthesis
+  for ( uint64_t i = 1; i < N; ++ i ) {
+    if ( leaf_sequence [ i ] ) {
+      new_leaf_sequence [ j ++ ] = 1;
+    } else if ( valid_sequence [ leaf ++ ] ) {
+      new_leaf_sequence [ j ] = 1;
+      j += 3;
+      new_valid_sequence [ new_leaf ++ ] = 1;
+      new_valid_sequence [ new_leaf ++ ] = 1;
+    } else {
+      ++ j;
+      ++ new_leaf;
+    }
+  }
+  tree () . assignFromBitVector ( std::move ( new_leaf_sequence ) );
+  valid_sequence_ . assign ( std::move ( new_valid_sequence ) );
+  size_ = 2 * L;
+}
+
 inline void 
 SuccinctGrid::rebuild ( boost::shared_ptr<const CompressedTreeGrid> compressed ) {
   valid_sequence_ . assign ( compressed -> tree () -> valid_sequence );
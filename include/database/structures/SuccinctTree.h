@@ -6,6 +6,7 @@
 /// @description This file defines class SuccinctTree which 
 /// provides an implementation of a full binary tree using SDSL.
 #include <exception>
+#include <utility>
 #include "boost/foreach.hpp"
 #include "boost/shared_ptr.hpp"
 #include "boost/iterator/counting_iterator.hpp"
@@ -34,6 +35,14 @@ public:
   ///   Default constructor. Creates root node with no children.
   SuccinctTree ( void );
 
+  /// SuccinctTree
+  ///   Copy constructor. Copies the bits and rebuilds the supports,
+  ///   which must refer to the copy.
+  SuccinctTree ( const SuccinctTree & other );
+
+  /// operator =
+  SuccinctTree & operator = ( const SuccinctTree & other );
+
   /// assign
   ///   Reset structure as if it had been constructed with leaf_sequence
   virtual void assign ( boost::shared_ptr<const CompressedTree> compressed );
@@ -41,6 +50,12 @@ public:
   /// assignFromLeafSequence 
   void assignFromLeafSequence ( const std::vector<bool> & leaf_sequence );
 
+  /// assignFromBitVector
+  ///   Reset structure to the balanced parentheses sequence "bits", in the
+  ///   form returned by leafSequence () (an extra leading 1 followed by the
+  ///   leaf sequence). Takes over the bits without copying.
+  void assignFromBitVector ( sdsl::bit_vector && bits );
+
   /// leafEnd
   ///   Give the one-past-the-end leaf (i.e. return number of leaves)
   int64_t leafEnd ( void ) const;
@@ -114,6 +129,23 @@ SuccinctTree::SuccinctTree ( void ) {
   // TODO: default constructor
 }
 
+inline 
+SuccinctTree::SuccinctTree ( const SuccinctTree & other ) : Tree ( other ) {
+  *this = other;
+}
+
+inline SuccinctTree & 
+SuccinctTree::operator = ( const SuccinctTree & other ) {
+  if ( this == &other ) return *this;
+  size_ = other . size_;
+  leaf_count_ = other . leaf_count_;
+  leaf_sequence_ = other . leaf_sequence_;
+  tree_ = sdsl::bp_support_sada <> ( & leaf_sequence_ );
+  rank_ = sdsl::rank_support_v5 <0> ( &leaf_sequence_ );
+  select_ =  sdsl::select_support_mcl <0> ( &leaf_sequence_ );
+  return *this;
+}
+
 inline void 
 SuccinctTree::assign ( boost::shared_ptr<const CompressedTree> compressed ) {
   const std::vector < bool > & leaf_sequence = compressed -> leaf_sequence;
@@ -135,6 +167,17 @@ SuccinctTree::assignFromLeafSequence ( const std::vector<bool> & leaf_sequence )
   select_ =  sdsl::select_support_mcl <0> ( &leaf_sequence_ );
 }
 
+inline void 
+SuccinctTree::assignFromBitVector ( sdsl::bit_vector && bits ) {
+  // A full binary tree with L leaves has 2L-1 nodes
+  leaf_sequence_ = std::move ( bits );
+  size_ = leaf_sequence_ . size () - 1;
+  leaf_count_ = leaf_sequence_ . size () / 2;
+  tree_ = sdsl::bp_support_sada <> ( & leaf_sequence_ );
+  rank_ = sdsl::rank_support_v5 <0> ( &leaf_sequence_ );
+  select_ =  sdsl::select_support_mcl <0> ( &leaf_sequence_ );
+}
+
 inline int64_t 
 SuccinctTree::leafEnd ( void ) const {
   return leaf_count_;
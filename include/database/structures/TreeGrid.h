@@ -25,6 +25,21 @@
 #include "boost/serialization/vector.hpp"
 #include "boost/serialization/serialization.hpp"
 
+/// CMDB_TREEGRID_DIMENSION_DISPATCH
+///   Call the member template function<D> with the given (parenthesized)
+///   arguments, where D is the dimension of the grid if it is between 1
+///   and 4, and 0 otherwise. function<0> reads the dimension at run time;
+///   the others have it as a constant, so their per-dimension loops unroll
+///   and their coordinate arrays are fixed-size.
+#define CMDB_TREEGRID_DIMENSION_DISPATCH(function, arguments) \
+  switch ( dimension_ ) { \
+    case 1: function<1> arguments; break; \
+    case 2: function<2> arguments; break; \
+    case 3: function<3> arguments; break; \
+    case 4: function<4> arguments; break; \
+    default: function<0> arguments; break; \
+  }
+
 // Declaration
 class TreeGrid : public Grid {
 protected:
@@ -151,9 +166,47 @@ public:
   std::vector<GridElement> 
 
   /// coverAccept for RectGeo
+  ///   Thread-safe: each calling thread uses its own CoverScratch
   coverAccept ( const RectGeo & visitor ) const;
+
+  /// coverAccept for RectGeo
+  ///   Append the cover to *results. Does not allocate once the
+  ///   per-thread scratch space and *results have grown large enough
+  ///   (except with periodicity).
+  void 
+  coverAccept ( const RectGeo & visitor, 
+                std::vector<GridElement> * results ) const;
   using Grid::cover;
 
+  /// batchGeometry
+  ///   (See Grid::batchGeometry) Computed directly into the batch
+  virtual void 
+  batchGeometry ( const GridElement * elements, uint64_t count,
+                  BoxBatch * boxes ) const;
+
+  /// batchCover
+  ///   (See Grid::batchCover) Uses the appending coverAccept
+  virtual void 
+  batchCover ( const BoxBatch & boxes,
+               std::vector<uint64_t> * offsets,
+               std::vector<GridElement> * targets ) const;
+
+  /// CoverScratch
+  ///   Working storage for coverAccept ( const RectGeo & ), kept between
+  ///   calls to avoid reallocation. One instance exists per thread.
+  struct CoverScratch {
+    typedef std::stack<Tree::iterator, std::vector<Tree::iterator> > ParentStack;
+    typedef std::stack<std::pair<Tree::iterator, Tree::iterator>, 
+                       std::vector<std::pair<Tree::iterator, Tree::iterator> > > ChildrenStack;
+    // Coordinates used when the dimension is not a template argument
+    std::vector<int64_t> LB, UB, NLB, NUB;
+    std::vector<double> width;
+    ParentStack parent;
+    ChildrenStack children;
+    // Boxes to cover; entries are reused, not reconstructed
+    std::vector<RectGeo> boxes;
+  };
+
   /// memory
   virtual uint64_t 
   memory ( void ) const = 0;
@@ -176,6 +229,27 @@ public:
                    int depth ) const;
 #endif
   
+private:
+  /// nodeGeometry
+  ///   Bounds of the region of a tree node, written to lower [ 0 .. d-1 ]
+  ///   and upper [ 0 .. d-1 ]. D is the dimension, or 0 for dimension_
+  ///   (see CMDB_TREEGRID_DIMENSION_DISPATCH).
+  template < int D > void
+  nodeGeometry ( Tree::iterator it, Real * lower, Real * upper ) const;
+
+  /// batchGeometryOf
+  ///   batchGeometry for dimension D (or 0 for dimension_)
+  template < int D > void
+  batchGeometryOf ( const GridElement * elements, uint64_t count,
+                    BoxBatch * boxes ) const;
+
+  /// coverBox
+  ///   Append the grid elements intersecting one box (within the bounds)
+  ///   to *results. D is the dimension, or 0 for dimension_.
+  template < int D > void
+  coverBox ( const RectGeo & box, CoverScratch & scratch,
+             std::vector<GridElement> * results ) const;
+
 protected:
   RectGeo bounds_;
   int dimension_;
@@ -192,6 +266,67 @@ private:
   }
 };
 
+
+/// class LeafGeometryIterator
+///   Visits the grid elements of a TreeGrid in order, i.e. the leaves of
+///   its tree in preorder, together with their boxes. The tree is walked
+///   once: the box of the current node is kept up to date as the walk
+///   descends and rises, so each step costs amortized O(1) tree
+///   operations, against O(depth) parent steps (twice) for geometry ( ge ).
+///   Boxes are identical to those returned by geometry ( ge ).
+///   Usage:
+///     for ( LeafGeometryIterator it ( grid ); not it . done (); it . next () ) {
+///       ... it . element () ... it . box () ...
+///     }
+class LeafGeometryIterator {
+public:
+  typedef TreeGrid::GridElement GridElement;
+
+  /// LeafGeometryIterator
+  ///   Start at grid element "start" (this costs O(depth) once)
+  LeafGeometryIterator ( const TreeGrid & grid, GridElement start = 0 );
+
+  /// done
+  ///   True when all grid elements from start on have been visited
+  bool done ( void ) const;
+
+  /// element
+  ///   Current grid element
+  GridElement element ( void ) const;
+
+  /// box
+  ///   Geometry of the current grid element
+  const RectGeo & box ( void ) const;
+
+  /// next
+  ///   Advance to the next grid element
+  void next ( void );
+
+private:
+  // A step of the walk from a node ("parent") to one of its children
+  struct Step {
+    Tree::iterator parent;
+    bool right;
+  };
+  void descend ( bool right );
+  void rise ( void );
+  void descendToLeaf ( void );
+  void advance ( void );
+  void setBox ( void );
+  const TreeGrid & grid_;
+  const Tree & tree_;
+  Tree::iterator node_;
+  std::vector<Step> path_;
+  // Box of node_ in [0,1] coordinates, represented as in geometry:
+  // lower_ [ d ] is the lower bound, upper_ [ d ] is 1 - the upper bound,
+  // and width_ [ d ] is the width.
+  std::vector<Real> lower_;
+  std::vector<Real> upper_;
+  std::vector<Real> width_;
+  RectGeo box_;
+  bool done_;
+};
+
 // DEFINITIONS
 
 inline 
@@ -475,57 +610,19 @@ TreeGrid::periodicity ( void )  {
 
 inline boost::shared_ptr<Geo> 
 TreeGrid::geometryOfTreeNode ( Tree::iterator it ) const {
-  //std::cout << "dimension_ = " << dimension_ << "\n";
   boost::shared_ptr<RectGeo> return_value ( new RectGeo ( dimension(), Real ( 0 ) ) );
   
   // Special Case for dimension 0 
   if ( dimension () == 0 ) return return_value;
 
   RectGeo & rect = * return_value ; 
-  //std::cout << "Grid::geometry ( " << * cell_iterator << ")\n";
-  /* Climb the tree */
-  Tree::iterator root = tree () . begin ();
-  int division_dimension = tree () . depth ( it ) % dimension ();
-
-  while ( it != root ) {
-    //std::cout << "visiting " << *it << " with parent " <<  * tree().parent(it) << "\n";
-    //std::cout . flush ();
-    Tree::iterator parent = tree () . parent ( it );
-    -- division_dimension; if ( division_dimension < 0 ) division_dimension = dimension () - 1;
-    if ( tree () . left ( parent ) == it ) {
-      /* This is a left-child */
-      rect . upper_bounds [ division_dimension ] += Real ( 1 );
-    } else {
-      /* This is a right-child */
-      rect . lower_bounds [ division_dimension ] += Real ( 1 );
-    } /* if-else */
-    rect . lower_bounds [ division_dimension ] /= Real ( 2 );
-    rect . upper_bounds [ division_dimension ] /= Real ( 2 );
-    it = parent;
-  } /* while */
-  for ( int d = 0; d < dimension(); ++ d ) {
-    //std::cout << "d =  " << d << " out of " << dimension_ << "\n";
-    //std::cout << "rect . lower_bounds . size () == " << rect . lower_bounds . size () << "\n";
-    //std::cout << "bounds_ . lower_bounds . size () == " << bounds_ . lower_bounds . size () << "\n";
-
-    /* Produce convex combinations */
-    rect . lower_bounds [ d ] = rect . lower_bounds [ d ] * bounds_ . upper_bounds [ d ] +
-    ( Real ( 1 ) - rect . lower_bounds [ d ] ) * bounds_ . lower_bounds [ d ];
-    rect . upper_bounds [ d ] = rect . upper_bounds [ d ] * bounds_ . lower_bounds [ d ] +
-    ( Real ( 1 ) - rect . upper_bounds [ d ] ) * bounds_ . upper_bounds [ d ];
-    //DEBUG
-    if ( rect . lower_bounds [ d ] > rect . lower_bounds [ d ] ) {
-      std::cout << "Grid::geometry ERROR: constructed invalid region.\n";
-      exit(1);
-    }
-  } /* for */
-  //std::cout << "returning from TreeGrid::geometry with " << rect << ".\n";
+  CMDB_TREEGRID_DIMENSION_DISPATCH ( nodeGeometry, 
+    ( it, rect . lower_bounds . data (), rect . upper_bounds . data () ) );
   return return_value;
-} /* TreeGrid::geometry */
+} /* TreeGrid::geometryOfTreeNode */
 
 inline boost::shared_ptr<Geo> 
 TreeGrid::geometry ( GridElement ge ) const {
-  //std::cout << "TreeGrid::geometry. dimension_ = " << dimension_ << "\n";
   iterator cell_iterator ( ge ); 
   boost::shared_ptr<RectGeo> return_value ( new RectGeo ( dimension(), Real ( 0 ) ) );
   
@@ -533,52 +630,51 @@ TreeGrid::geometry ( GridElement ge ) const {
   if ( dimension () == 0 ) return return_value;
 
   RectGeo & rect = * return_value ; 
-  
-  //std::cout << "TreeGrid::geometry ( " << ge << ")\n";
-  //std::cout << "TreeGrid::geometry. bounds = " << bounds () << "\n";
+  CMDB_TREEGRID_DIMENSION_DISPATCH ( nodeGeometry, 
+    ( GridToTree ( cell_iterator ), rect . lower_bounds . data (), 
+      rect . upper_bounds . data () ) );
+  return return_value;
+} /* TreeGrid::geometry */
 
+template < int D >
+inline void
+TreeGrid::nodeGeometry ( Tree::iterator it, Real * lower, Real * upper ) const {
+  const int dimension = D ? D : dimension_;
+  // Bounds in [0,1] coordinates: fixed-size arrays when the dimension
+  // is a template argument, else the output itself
+  Real fixed [ 2 ] [ D ? D : 1 ];
+  Real * rect_lower = D ? fixed [ 0 ] : lower;
+  Real * rect_upper = D ? fixed [ 1 ] : upper;
+  for ( int d = 0; d < dimension; ++ d ) {
+    rect_lower [ d ] = Real ( 0 );
+    rect_upper [ d ] = Real ( 0 );
+  }
   /* Climb the tree */
   Tree::iterator root = tree () . begin ();
-  Tree::iterator it = GridToTree ( cell_iterator );
-  int division_dimension = tree () . depth ( it ) % dimension ();
-
-  //std::cout << "TreeGrid::geometry. depth = " << tree () . depth ( it ) << "\n";
+  int division_dimension = tree () . depth ( it ) % dimension;
 
   while ( it != root ) {
-    //std::cout << "TreeGrid::geometry. Visiting " << *it << " with parent " <<  * tree().parent(it) << "\n";
-    //std::cout . flush ();
     Tree::iterator parent = tree () . parent ( it );
-    -- division_dimension; if ( division_dimension < 0 ) division_dimension = dimension () - 1;
+    -- division_dimension; if ( division_dimension < 0 ) division_dimension = dimension - 1;
     if ( tree () . left ( parent ) == it ) {
       /* This is a left-child */
-      rect . upper_bounds [ division_dimension ] += Real ( 1 );
+      rect_upper [ division_dimension ] += Real ( 1 );
     } else {
       /* This is a right-child */
-      rect . lower_bounds [ division_dimension ] += Real ( 1 );
+      rect_lower [ division_dimension ] += Real ( 1 );
     } /* if-else */
-    rect . lower_bounds [ division_dimension ] /= Real ( 2 );
-    rect . upper_bounds [ division_dimension ] /= Real ( 2 );
+    rect_lower [ division_dimension ] /= Real ( 2 );
+    rect_upper [ division_dimension ] /= Real ( 2 );
     it = parent;
   } /* while */
-  for ( int d = 0; d < dimension(); ++ d ) {
-    //std::cout << "d =  " << d << " out of " << dimension_ << "\n";
-    //std::cout << "rect . lower_bounds . size () == " << rect . lower_bounds . size () << "\n";
-    //std::cout << "bounds_ . lower_bounds . size () == " << bounds_ . lower_bounds . size () << "\n";
-
+  for ( int d = 0; d < dimension; ++ d ) {
     /* Produce convex combinations */
-    rect . lower_bounds [ d ] = rect . lower_bounds [ d ] * bounds_ . upper_bounds [ d ] +
-    ( Real ( 1 ) - rect . lower_bounds [ d ] ) * bounds_ . lower_bounds [ d ];
-    rect . upper_bounds [ d ] = rect . upper_bounds [ d ] * bounds_ . lower_bounds [ d ] +
-    ( Real ( 1 ) - rect . upper_bounds [ d ] ) * bounds_ . upper_bounds [ d ];
-    //DEBUG
-    if ( rect . lower_bounds [ d ] > rect . lower_bounds [ d ] ) {
-      std::cout << "Grid::geometry ERROR: constructed invalid region.\n";
-      exit(1);
-    }
+    lower [ d ] = rect_lower [ d ] * bounds_ . upper_bounds [ d ] +
+    ( Real ( 1 ) - rect_lower [ d ] ) * bounds_ . lower_bounds [ d ];
+    upper [ d ] = rect_upper [ d ] * bounds_ . lower_bounds [ d ] +
+    ( Real ( 1 ) - rect_upper [ d ] ) * bounds_ . upper_bounds [ d ];
   } /* for */
-  //std::cout << "returning from TreeGrid::geometry with " << rect << ".\n";
-  return return_value;
-} /* TreeGrid::geometry */
+} /* TreeGrid::nodeGeometry */
 
 
 /////////////////////////////////////////////////////////
@@ -603,6 +699,14 @@ TreeGrid::cover ( const Geo & geo ) const {
 
 inline std::vector<Grid::GridElement>
 TreeGrid::coverAccept ( const RectGeo & visitor ) const  {
+  std::vector<Grid::GridElement> results;
+  coverAccept ( visitor, &results );
+  return results;
+}
+
+inline void
+TreeGrid::coverAccept ( const RectGeo & visitor, 
+                        std::vector<GridElement> * output ) const  {
   // A note on rigorous numerics:
   // We convert to phase space coordinates into integers for speed. 
   // To do this we convert to a [0,1] double range, and then to {0,1,2,...,2^60}
@@ -616,7 +720,8 @@ TreeGrid::coverAccept ( const RectGeo & visitor ) const  {
 
 
   const RectGeo & geometric_region = visitor;
-  std::vector<Grid::GridElement> results;
+  std::vector<Grid::GridElement> & results = * output;
+  size_t first_result = results . size ();
   // using namespace chomp;
   //std::cout << "RectGeo version of Cover\n";
   //std::cout << "Covering " << geometric_region << "\n";
@@ -626,21 +731,21 @@ TreeGrid::coverAccept ( const RectGeo & visitor ) const  {
   
   //boost::unordered_set < GridElement > redundancy_check;
   
-  std::vector < double > width ( dimension_ );
+  // Scratch space is per-thread so that cover may be called concurrently
+  static thread_local CoverScratch scratch;
+  std::vector<double> & width = scratch . width; width . resize ( dimension_ );
   for ( int d = 0; d < dimension_; ++ d ) {
     width [ d ] = bounds_ . upper_bounds [ d ] - bounds_ . lower_bounds [ d ];
   }
   
     // Initialize variables
-  RectGeo region ( dimension_ );
-  static  std::vector<int64_t> LB; LB . resize ( dimension_);
-  static std::vector<int64_t> UB; UB . resize ( dimension_);
-  static std::vector<int64_t> NLB; NLB . resize ( dimension_);
-  static std::vector<int64_t> NUB; NUB . resize ( dimension_);
-  static std::stack<Tree::iterator, std::vector<Tree::iterator> > parent;
-  static std::stack<std::pair<Tree::iterator, Tree::iterator>, 
-                    std::vector<std::pair<Tree::iterator, Tree::iterator>> > children;
-  static std::stack < RectGeo, std::vector<RectGeo> > work_stack;
+  std::vector<RectGeo> & boxes = scratch . boxes;
+  size_t num_boxes = 0;
+  auto push_box = [&] ( const RectGeo & box ) {
+    if ( num_boxes == boxes . size () ) boxes . push_back ( box );
+    else boxes [ num_boxes ] = box;
+    ++ num_boxes;
+  };
 
   // TODO: Make this computation happen once and for all
   bool periodic_flag = false;
@@ -679,228 +784,382 @@ TreeGrid::coverAccept ( const RectGeo & visitor ) const  {
           r . upper_bounds [ d ] += width [ d ];
         }
       }
-      work_stack . push ( r );
+      push_box ( r );
       //std::cout << "Pushed " << r << "\n";
     }
   } else {
-    work_stack . push ( geometric_region );
+    push_box ( geometric_region );
   }
 
   //std::cout << "ready to cover pushed things\n";
+  while ( num_boxes > 0 ) {
+    //std::cout << "Top of cover loop. Size of work stack = " << num_boxes << "\n";
+    const RectGeo & GR = boxes [ -- num_boxes ];
+    CMDB_TREEGRID_DIMENSION_DISPATCH ( coverBox, ( GR, scratch, &results ) );
+  }
+  //std::cout << "Returning from cover.\n";
+
+  if ( periodic_flag ) {
+    // Remove duplicates if necessary. (This is needed only
+    // with periodicity)
+    std::sort ( results . begin () + first_result, results . end () );
+    results . erase ( std::unique ( results . begin () + first_result, 
+                                    results . end () ),
+                      results . end () );
+  }
+} // cover
+
+template < int D >
+inline void
+TreeGrid::coverBox ( const RectGeo & GR, CoverScratch & scratch,
+                     std::vector<GridElement> * output ) const {
   /* Use a stack, not a queue, and do depth first search.
    The advantage of this is that we can maintain the geometry during our Euler Tour.
    We can maintain our geometry without any roundoff error if we use the standard box
    [0,1]^d. To avoid having to translate to real coordinates at each leaf, we instead
    convert the input to these standard coordinates, which we put into integers. */
-  
+  std::vector<Grid::GridElement> & results = * output;
+  const int dimension = D ? D : dimension_;
+  // Integer coordinates of the box (LB, UB) and of the current node (NLB, NUB):
+  // fixed-size arrays when the dimension is a template argument
+  int64_t fixed [ 4 ] [ D ? D : 1 ];
+  if ( D == 0 ) {
+    scratch . LB . resize ( dimension_ );
+    scratch . UB . resize ( dimension_ );
+    scratch . NLB . resize ( dimension_ );
+    scratch . NUB . resize ( dimension_ );
+  }
+  int64_t * LB = D ? fixed [ 0 ] : scratch . LB . data ();
+  int64_t * UB = D ? fixed [ 1 ] : scratch . UB . data ();
+  int64_t * NLB = D ? fixed [ 2 ] : scratch . NLB . data ();
+  int64_t * NUB = D ? fixed [ 3 ] : scratch . NUB . data ();
+  CoverScratch::ParentStack & parent = scratch . parent;
+  CoverScratch::ChildrenStack & children = scratch . children;
 
-  while ( not work_stack . empty () ) {
-    //std::cout << "Top of cover loop. Size of work stack = " << work_stack . size () << "\n";
-    RectGeo GR = work_stack . top ();
-    work_stack . pop (); // PROFILED
-    //std::cout << "Trying to cover " << GR << "\n";
-    // Step 1. Convert input to standard coordinates.
+  // Step 1. Convert input to standard coordinates.
 
 #define INTPHASEWIDTH (((int64_t)1) << 60)
 #define TRUNCATIONERROR (((int64_t)1) << 10 )
-    Real bignum ( INTPHASEWIDTH );
-    bool out_of_bounds = false;
-    for ( int d = 0; d < dimension_; ++ d ) {
-      // Convert lower bounds to standard coordinates (i.e. [0,1] range)
-      region . lower_bounds [ d ] =
-        (GR . lower_bounds [ d ] - bounds_ . lower_bounds [ d ]) /
-        (bounds_ . upper_bounds [ d ] - bounds_ . lower_bounds [ d ]);
-      // Convert upper bounds to standard coordinates (i.e. [0,1] range)
-      region . upper_bounds [ d ] =
-        (GR . upper_bounds [ d ] - bounds_ . lower_bounds [ d ]) /
-        (bounds_ . upper_bounds [ d ] - bounds_ . lower_bounds [ d ]);
-      // Check if completely out of bounds
-      if (region . upper_bounds [ d ] < Real ( 0 ) ||
-          region . lower_bounds [ d ] > Real ( 1 ) )  {
-        out_of_bounds = true;
-        break;
-      }
-      //std::cout << "dim " << d << ": [" << region . lower_bounds [ d ] << ", " << region . upper_bounds [ d ] << "]\n";
-      if ( region . lower_bounds [ d ] < Real ( 0 ) ) 
-        region . lower_bounds [ d ] = Real ( 0 );
-      if ( region . lower_bounds [ d ] > Real ( 1 ) )
-        region . lower_bounds [ d ] = Real ( 1 );
-      if ( region . upper_bounds [ d ] < Real ( 0 ) )
-        region . upper_bounds [ d ] = Real ( 0 );
-      if ( region . upper_bounds [ d ] > Real ( 1 ) )
-        region . upper_bounds [ d ] = Real ( 1 );
-
-      // Convert to integer coordinates
-      LB [ d ] = (int64_t) ( bignum * region . lower_bounds [ d ] ) - TRUNCATIONERROR;
-      UB [ d ] = (int64_t) ( bignum * region . upper_bounds [ d ] ) + TRUNCATIONERROR;
-      if ( LB [ d ] < 0 ) LB [ d ] = 0;
-      if ( UB [ d ] > INTPHASEWIDTH ) UB [ d ] = INTPHASEWIDTH;
-    }
-    if ( out_of_bounds ) continue;
-    // Step 2. Perform DFS on the Grid tree, recursing whenever we have intersection,
-    //         (or adding leaf to output when we have leaf intersection)
+  Real bignum ( INTPHASEWIDTH );
+  for ( int d = 0; d < dimension; ++ d ) {
+    // Convert lower bounds to standard coordinates (i.e. [0,1] range)
+    Real lower = (GR . lower_bounds [ d ] - bounds_ . lower_bounds [ d ]) /
+      (bounds_ . upper_bounds [ d ] - bounds_ . lower_bounds [ d ]);
+    // Convert upper bounds to standard coordinates (i.e. [0,1] range)
+    Real upper = (GR . upper_bounds [ d ] - bounds_ . lower_bounds [ d ]) /
+      (bounds_ . upper_bounds [ d ] - bounds_ . lower_bounds [ d ]);
+    // Check if completely out of bounds
+    if ( upper < Real ( 0 ) || lower > Real ( 1 ) ) return;
+    if ( lower < Real ( 0 ) ) lower = Real ( 0 );
+    if ( lower > Real ( 1 ) ) lower = Real ( 1 );
+    if ( upper < Real ( 0 ) ) upper = Real ( 0 );
+    if ( upper > Real ( 1 ) ) upper = Real ( 1 );
+
+    // Convert to integer coordinates
+    LB [ d ] = (int64_t) ( bignum * lower ) - TRUNCATIONERROR;
+    UB [ d ] = (int64_t) ( bignum * upper ) + TRUNCATIONERROR;
+    if ( LB [ d ] < 0 ) LB [ d ] = 0;
+    if ( UB [ d ] > INTPHASEWIDTH ) UB [ d ] = INTPHASEWIDTH;
+  }
+  // Step 2. Perform DFS on the Grid tree, recursing whenever we have intersection,
+  //         (or adding leaf to output when we have leaf intersection)
 
-    for ( int d = 0; d < dimension_; ++ d ) {
-      NLB [ d ] = 0;
-      NUB [ d ] = INTPHASEWIDTH;
-    }
-    //std::cout << "C\n";
-    
-    /* Strategy.
-     We will take the Euler Tour using a 4-state machine.
-     There are Four states.
-     0 = Just Descended. Check for an intersection.
-     1 = Descend to the left
-     2 = Descend to right
-     3 = Rise.
-     */
-    
-    Tree::iterator root = tree () . begin ();
-    Tree::iterator N = root;
-    Tree::iterator tree_end = treeEnd ();
-    
-    char state = 0;
-    int depth = -1;
+  for ( int d = 0; d < dimension; ++ d ) {
+    NLB [ d ] = 0;
+    NUB [ d ] = INTPHASEWIDTH;
+  }
 
+  /* Strategy.
+   We will take the Euler Tour using a 4-state machine.
+   There are Four states.
+   0 = Just Descended. Check for an intersection.
+   1 = Descend to the left
+   2 = Descend to right
+   3 = Rise.
+   */
 
-    if ( not parent . empty () ) {
-      abort ();
-    }
-    if ( not children . empty () ) {
-      abort ();
-    }
-    parent . push ( tree_end );
+  const Tree & grid_tree = tree ();
+  Tree::iterator root = grid_tree . begin ();
+  Tree::iterator N = root;
+  Tree::iterator tree_end = grid_tree . end ();
+  Grid::iterator grid_end = end ();
+  // As left and right, with the tree looked up once
+  auto child = [&] ( Tree::iterator it ) {
+    if ( it != tree_end && grid_tree . isLeaf ( it ) && 
+         TreeToGrid ( it ) == grid_end ) return tree_end;
+    return it;
+  };
 
-    while ( 1 ) {
-      //std::cout << "Entering Loop, state = " << (int) state << "\n";
-      //std::cout << " N = " << *N << "\n";
-      if ( state == 0 ) {
-        ++ depth;
-
-        //std::cout << "State " << (int)state << "\n";
-        //std::cout << "Depth = " << depth << " \n";
-        //std::cout << " N = " << *N << "\n";
-        // If we have descended here, then we should check for intersection.
-        bool intersect_flag = true;
-        for ( int d = 0; d < dimension_; ++ d ) {
-          if ( LB[d] > NUB[d] || UB[d] < NLB [d] ) {  // INTERSECTION CHECK
-            intersect_flag = false;
-            break;
-          }
+  char state = 0;
+  // Dimension divided at the current node, i.e. depth % dimension,
+  // kept up to date as we descend and rise
+  int div_dim = -1;
+
+  if ( not parent . empty () ) {
+    abort ();
+  }
+  if ( not children . empty () ) {
+    abort ();
+  }
+  parent . push ( tree_end );
+
+  while ( 1 ) {
+    if ( state == 0 ) {
+      if ( ++ div_dim == dimension ) div_dim = 0;
+      // If we have descended here, then we should check for intersection.
+      bool intersect_flag = true;
+      for ( int d = 0; d < dimension; ++ d ) {
+        if ( LB[d] > NUB[d] || UB[d] < NLB [d] ) {  // INTERSECTION CHECK
+          intersect_flag = false;
+          break;
         }
-        
-        if ( intersect_flag ) {
-          //std::cout << "Detected intersection.\n";
-          // Determine children
-          
-          children . push ( std::make_pair ( left ( N ), 
-                                             right ( N ) ) );
-          
-          // Check if its a leaf.
-          if ( children . top () . first == tree_end ) { 
-            if ( children . top () . second == tree_end ) {
-              // Here's what we are looking for.
-              iterator grid_it = TreeToGrid ( N );
-              if ( grid_it != end () ) results . push_back ( * grid_it ); 
-              // Issue the order to rise.
-              //std::cout << "Issue rise.\n";
-              state = 3;
-            } else {
-              // Issue the order to descend to the right.
-              //std::cout << "Issue descend right.\n";
-              state = 2;
-            }
+      }
+
+      if ( intersect_flag ) {
+        // Determine children
+        children . push ( std::make_pair ( child ( grid_tree . left ( N ) ),
+                                           child ( grid_tree . right ( N ) ) ) );
+
+        // Check if its a leaf.
+        if ( children . top () . first == tree_end ) {
+          if ( children . top () . second == tree_end ) {
+            // Here's what we are looking for.
+            iterator grid_it = TreeToGrid ( N );
+            if ( grid_it != grid_end ) results . push_back ( * grid_it );
+            // Issue the order to rise.
+            state = 3;
           } else {
-            // Issue the order to descend to the left.
-            //std::cout << "Issue descend left.\n";
-            state = 1;
+            // Issue the order to descend to the right.
+            state = 2;
           }
         } else {
-          // No intersection, issue order to rise.
-          children . push ( std::make_pair ( 0, 0 ) ); // dummy to be popped (PROFILED)
-          //std::cout << "No intersection. \n";
-          //std::cout << "Issue Rise.\n";
-          state = 3;
-        } // intersection check complete
-      } // state 0
-      
-      if ( state == 1 ) {
-        // We have been ordered to descend to the left.
-        //std::cout << "State " << (int)state << "\n";
-        //std::cout << "Depth = " << depth << " \n";
-        //std::cout << " N = " << *N << "\n";
-        //std::cout << "Descend left.\n";
-        int div_dim = depth % dimension ();
-        NUB[div_dim] -= ( (NUB[div_dim]-NLB[div_dim]) >> 1 );
-        parent . push ( N );
-        N = children . top () . first; //tree () . left ( N ) ;
-        state = 0;
-        continue;
-      } // state 1
-      
-      if ( state == 2 ) {
-        // We have been ordered to descend to the right.
-        //std::cout << "State " << (int)state << "\n";
-        //std::cout << "Depth = " << depth << " \n";
-        //std::cout << " N = " << *N << "\n";
-        //std::cout << "Descend right.\n";
-        int div_dim = depth % dimension ();
-        NLB[div_dim] += ( (NUB[div_dim]-NLB[div_dim]) >> 1 );
-        parent . push ( N );
-        N = children . top () . second; //tree () . right ( N ) ;
-        state = 0;
-        continue;
-      } // state 2
-      
-      if ( state == 3 ) {
-        // We have been ordered to rise.
-        //std::cout << "State " << (int)state << "\n";
-        //std::cout << "Depth = " << depth << " \n";
-        //std::cout << " N = " << *N << "\n";
-        //std::cout << "Rise.\n";
-        Tree::iterator P = parent . top (); //tree () . parent ( N );
-        parent . pop ();
-        children . pop ();
-        // Can't rise if root.
-        if ( P == tree_end ) break; // algorithm complete
-
-        -- depth;
-        int div_dim = depth % dimension ();
-        if ( children . top () . first == N ) { //tree () . left ( P )  == N ) {
-          // This is a left child.
-          //std::cout << "We are rising from left.\n";
-          NUB[div_dim] += NUB[div_dim]-NLB[div_dim];
-          // If we rise from the left child, we order parent to go right.
-          // Unless there is no right child.
-          if ( children . top () . second == tree_end ) state = 3; //tree () . right ( P ) == end ) state = 3;
-          else state = 2;
-        } else {
-          // This is the right child.
-          //std::cout << "We are rising from right.\n";
-          NLB[div_dim] -= NUB[div_dim]-NLB[div_dim];
-          // If we rise from the right child, we order parent to rise.
-          state = 3;
+          // Issue the order to descend to the left.
+          state = 1;
         }
-        N = P;
-      } // state 3
-      
-    } // while loop
+      } else {
+        // No intersection, issue order to rise.
+        children . push ( std::make_pair ( 0, 0 ) ); // dummy to be popped (PROFILED)
+        state = 3;
+      } // intersection check complete
+    } // state 0
+
+    if ( state == 1 ) {
+      // We have been ordered to descend to the left.
+      NUB[div_dim] -= ( (NUB[div_dim]-NLB[div_dim]) >> 1 );
+      parent . push ( N );
+      N = children . top () . first; //tree () . left ( N ) ;
+      state = 0;
+      continue;
+    } // state 1
+
+    if ( state == 2 ) {
+      // We have been ordered to descend to the right.
+      NLB[div_dim] += ( (NUB[div_dim]-NLB[div_dim]) >> 1 );
+      parent . push ( N );
+      N = children . top () . second; //tree () . right ( N ) ;
+      state = 0;
+      continue;
+    } // state 2
+
+    if ( state == 3 ) {
+      // We have been ordered to rise.
+      Tree::iterator P = parent . top (); //tree () . parent ( N );
+      parent . pop ();
+      children . pop ();
+      // Can't rise if root.
+      if ( P == tree_end ) break; // algorithm complete
+
+      if ( -- div_dim < 0 ) div_dim = dimension - 1;
+      if ( children . top () . first == N ) { //tree () . left ( P )  == N ) {
+        // This is a left child.
+        NUB[div_dim] += NUB[div_dim]-NLB[div_dim];
+        // If we rise from the left child, we order parent to go right.
+        // Unless there is no right child.
+        if ( children . top () . second == tree_end ) state = 3; //tree () . right ( P ) == end ) state = 3;
+        else state = 2;
+      } else {
+        // This is the right child.
+        NLB[div_dim] -= NUB[div_dim]-NLB[div_dim];
+        // If we rise from the right child, we order parent to rise.
+        state = 3;
+      }
+      N = P;
+    } // state 3
+
+  } // while loop
+} // coverBox
+
+inline void
+TreeGrid::batchGeometry ( const GridElement * elements, uint64_t count,
+                          BoxBatch * boxes ) const {
+  boxes -> resize ( dimension (), count );
+  if ( dimension () == 0 || count == 0 ) return;
+  // A range of consecutive elements (as requested by MapGraph) is swept
+  uint64_t i = 1;
+  while ( i < count && elements [ i ] == elements [ 0 ] + i ) ++ i;
+  if ( i == count && count > 1 ) {
+    LeafGeometryIterator it ( *this, elements [ 0 ] );
+    for ( i = 0; i < count; ++ i, it . next () ) boxes -> set ( i, it . box () );
+    return;
   }
-  //std::cout << "Returning from cover.\n";
+  CMDB_TREEGRID_DIMENSION_DISPATCH ( batchGeometryOf, ( elements, count, boxes ) );
+}
 
-  if ( periodic_flag ) {
-    // Remove duplicates if necessary. (This is needed only
-    // with periodicity)
-    std::vector<Grid::GridElement> sorted_results;
-    std::swap ( sorted_results, results );
-    std::sort ( sorted_results . begin (), 
-                sorted_results . end () );
-    std::unique_copy ( sorted_results . begin (), 
-                       sorted_results . end (),
-                       std::back_inserter(results) );
+template < int D >
+inline void
+TreeGrid::batchGeometryOf ( const GridElement * elements, uint64_t count,
+                            BoxBatch * boxes ) const {
+  const int dimension = D ? D : dimension_;
+  Real fixed [ 2 ] [ D ? D : 1 ];
+  std::vector < Real > dynamic ( D ? 0 : 2 * dimension_ );
+  Real * lower = D ? fixed [ 0 ] : dynamic . data ();
+  Real * upper = D ? fixed [ 1 ] : dynamic . data () + dimension_;
+  for ( uint64_t i = 0; i < count; ++ i ) {
+    // As in geometry ( ge ), then written into the batch
+    nodeGeometry<D> ( GridToTree ( iterator ( elements [ i ] ) ), lower, upper );
+    for ( int d = 0; d < dimension; ++ d ) {
+      boxes -> lower ( d ) [ i ] = lower [ d ];
+      boxes -> upper ( d ) [ i ] = upper [ d ];
+    }
   }
-  return results;
-} // cover
+}
+
+inline
+LeafGeometryIterator::LeafGeometryIterator ( const TreeGrid & grid, 
+                                             GridElement start ) :
+grid_ ( grid ),
+tree_ ( grid . tree () ),
+lower_ ( grid . dimension (), Real ( 0 ) ),
+upper_ ( grid . dimension (), Real ( 0 ) ),
+width_ ( grid . dimension (), Real ( 1 ) ),
+box_ ( grid . dimension () ),
+done_ ( start >= grid . size () ) {
+  if ( done_ ) return;
+  // Replay the path from the root to the leaf of "start"
+  std::vector<Tree::iterator> nodes;
+  for ( Tree::iterator it = grid . GridToTree ( TreeGrid::iterator ( start ) );
+        it != tree_ . begin (); it = tree_ . parent ( it ) ) {
+    nodes . push_back ( it );
+  }
+  node_ = tree_ . begin ();
+  path_ . reserve ( nodes . size () );
+  while ( not nodes . empty () ) {
+    descend ( tree_ . left ( node_ ) != nodes . back () );
+    nodes . pop_back ();
+  }
+  setBox ();
+}
+
+inline bool
+LeafGeometryIterator::done ( void ) const {
+  return done_;
+}
+
+inline LeafGeometryIterator::GridElement
+LeafGeometryIterator::element ( void ) const {
+  return * grid_ . TreeToGrid ( node_ );
+}
+
+inline const RectGeo &
+LeafGeometryIterator::box ( void ) const {
+  return box_;
+}
+
+inline void
+LeafGeometryIterator::next ( void ) {
+  advance ();
+  if ( not done_ ) setBox ();
+}
+
+inline void
+LeafGeometryIterator::descend ( bool right ) {
+  int d = path_ . size () % grid_ . dimension ();
+  Step step = { node_, right };
+  path_ . push_back ( step );
+  // Bounds are sums of distinct powers of 2, so these operations (and
+  // their inverses in rise) are exact and give the values of geometry
+  width_ [ d ] /= Real ( 2 );
+  if ( right ) {
+    lower_ [ d ] += width_ [ d ];
+    node_ = grid_ . right ( node_ );
+  } else {
+    upper_ [ d ] += width_ [ d ];
+    node_ = grid_ . left ( node_ );
+  }
+}
+
+inline void
+LeafGeometryIterator::rise ( void ) {
+  const Step & step = path_ . back ();
+  int d = ( path_ . size () - 1 ) % grid_ . dimension ();
+  if ( step . right ) {
+    lower_ [ d ] -= width_ [ d ];
+  } else {
+    upper_ [ d ] -= width_ [ d ];
+  }
+  width_ [ d ] *= Real ( 2 );
+  node_ = step . parent;
+  path_ . pop_back ();
+}
+
+inline void
+LeafGeometryIterator::descendToLeaf ( void ) {
+  Tree::iterator end = tree_ . end ();
+  while ( 1 ) {
+    if ( grid_ . left ( node_ ) != end ) descend ( false );
+    else if ( grid_ . right ( node_ ) != end ) descend ( true );
+    else return;
+  }
+}
+
+inline void
+LeafGeometryIterator::advance ( void ) {
+  Tree::iterator end = tree_ . end ();
+  while ( 1 ) {
+    // Rise to the first ancestor with an unvisited right child
+    while ( 1 ) {
+      if ( path_ . empty () ) {
+        done_ = true;
+        return;
+      }
+      bool from_left = not path_ . back () . right;
+      rise ();
+      if ( from_left && grid_ . right ( node_ ) != end ) break;
+    }
+    descend ( true );
+    descendToLeaf ();
+    // A node whose children are all invalid leaves is not a grid element
+    if ( grid_ . TreeToGrid ( node_ ) != grid_ . end () ) return;
+  }
+}
+
+inline void
+LeafGeometryIterator::setBox ( void ) {
+  const RectGeo & bounds = grid_ . bounds ();
+  for ( int d = 0; d < grid_ . dimension (); ++ d ) {
+    /* Produce convex combinations */
+    box_ . lower_bounds [ d ] = lower_ [ d ] * bounds . upper_bounds [ d ] +
+    ( Real ( 1 ) - lower_ [ d ] ) * bounds . lower_bounds [ d ];
+    box_ . upper_bounds [ d ] = upper_ [ d ] * bounds . lower_bounds [ d ] +
+    ( Real ( 1 ) - upper_ [ d ] ) * bounds . upper_bounds [ d ];
+  }
+}
+
+inline void
+TreeGrid::batchCover ( const BoxBatch & boxes,
+                       std::vector<uint64_t> * offsets,
+                       std::vector<GridElement> * targets ) const {
+  RectGeo box ( boxes . dimension () );
+  for ( uint64_t i = 0; i < boxes . size (); ++ i ) {
+    if ( dimension () == 0 ) {
+      targets -> push_back ( 0 ); // (sole) grid element 0
+    } else {
+      boxes . get ( i, &box );
+      coverAccept ( box, targets );
+    }
+    offsets -> push_back ( targets -> size () );
+  }
+}
 
 inline std::vector<Grid::GridElement>
 TreeGrid::coverAccept ( const PrismGeo & visitor ) const {
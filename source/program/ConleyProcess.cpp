@@ -15,6 +15,7 @@
 #include <boost/chrono/chrono_io.hpp>
 
 #include "database/structures/Database.h"
+#include "database/structures/MappedDatabase.h"
 #include "database/program/Configuration.h"
 #include "database/program/ConleyProcess.h"
 #include "database/program/jobs/Conley_Index_Job.h"
@@ -25,6 +26,7 @@
 #include <boost/serialization/export.hpp>
 BOOST_CLASS_EXPORT_IMPLEMENT(SuccinctGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(PointerGrid);
+BOOST_CLASS_EXPORT_IMPLEMENT(CompactGrid);
 */
 
 void ConleyProcess::command_line ( int argcin, char * argvin [] ) {
@@ -38,8 +40,6 @@ void ConleyProcess::command_line ( int argcin, char * argvin [] ) {
 /* * * * * * * * * * * * */
 void ConleyProcess::initialize ( void ) {
   using namespace chomp;
-  time_of_last_checkpoint_ =
-    boost::posix_time::second_clock::local_time ();
   time_of_last_progress_report_ =
     boost::posix_time::second_clock::local_time ();
 
@@ -51,19 +51,22 @@ void ConleyProcess::initialize ( void ) {
   config . loadFromFile ( argv[1] );
   std::cout << "Loaded configuration.\n";
   
+  // The database is only read here, so it is mapped rather than loaded
   std::string filestring ( argv[1] );
   std::string appendstring ( "/database.mdb" );
-  database . load ( (filestring + appendstring) . c_str () );
+  database_file_ = columnarDatabaseFile ( filestring + appendstring );
+  database . open ( database_file_ . c_str () );
 
-  num_incc_ = database . INCC_Records () . size ();
+  num_incc_ = database . numINCCs ();
   finished_ . resize ( num_incc_, false );
   attempts_ . resize ( num_incc_, 0 );
   num_finished_ = 0;
   current_incc_ = -1;
 
-  checkpoint_timer_running_ = false;
-
   parameter_space_ = model . parameterSpace ();
+
+  // The database is written by accept, so the timer only raises a flag
+  timer_ . start ( CMDB_CHECKPOINT_INTERVAL );
 }
 
 /* * * * * * * * * * */
@@ -81,13 +84,7 @@ int ConleyProcess::prepare ( Message & job ) {
     return 1; // Code 1: No more jobs.
   }
 
-  if ( not checkpoint_timer_running_ ) {
-    job << (uint64_t) 0; // Checkpoint timer job
-    checkpoint_timer_running_ = true;
-    return 0;
-  } else {
-    job << (uint64_t) 1; // Conley Job
-  }
+  job << (uint64_t) 1; // Conley Job
 
    do {
     if ( ++ current_incc_ == num_incc_ ) { 
@@ -102,7 +99,7 @@ int ConleyProcess::prepare ( Message & job ) {
 
   std::cout << "ConleyProcess. Isolating Neighborhood Continuation Class = " << incc << ".\n";
 
-  const INCC_Record & incc_record = database . INCC_Records () [ incc ];
+  const INCC_Record incc_record = database . INCC ( incc );
   std::cout << "(debug) incc_record . smallest_reps . size ()  = " 
             << incc_record . smallest_reps . size ()  << "\n";
 
@@ -118,24 +115,23 @@ int ConleyProcess::prepare ( Message & job ) {
   } else {
     // Find a random representative
     std::cout << "ConleyProcess. Finding a random representative.\n";
-    uint64_t incc_size = database . incc_sizes () [ incc ];
+    uint64_t incc_size = database . column ( DB_INCC_SIZES ) [ incc ];
     std::cout << "(debug) incc_size = " << incc_size << "\n";
     bool chose_representative = false;
     while ( not chose_representative ) {
       std::cout << "There are " << incc_record . inccp_indices . size () << " candidates\n";
       BOOST_FOREACH ( uint64_t inccp, incc_record . inccp_indices ) {
         std::cout << "Considering candidate number " << inccp << "\n";
-        const INCCP_Record & inccp_record = 
-         database . INCCP_Records () [ inccp ];
+        const INCCP_Record inccp_record = database . INCCP ( inccp );
         uint64_t cs = inccp_record . cs_index;
-        if ( database . csData () [ cs ] . vertices . size () != 1 ) { 
+        const CS_Data cs_data = database . cs ( cs );
+        if ( cs_data . vertices . size () != 1 ) { 
           std::cout << "ConleyProcess. Rejecting candidate " << inccp <<
                        " since isolating neighborhood is not a single Morse set " <<
                        " in this region.\n";
           continue;
         }
-        const MGCCP_Record & mgccp_record = 
-         database . MGCCP_Records () [ inccp_record . mgccp_index ];
+        const MGCCP_Record mgccp_record = database . MGCCP ( inccp_record . mgccp_index );
         uint64_t mgccp_size = mgccp_record . parameter_indices . size ();
         std::cout << "(debug) mgccp_size = " << mgccp_size << "\n";
         if ( rand () % incc_size >= mgccp_size ) { 
@@ -145,7 +141,7 @@ int ConleyProcess::prepare ( Message & job ) {
           continue;
         } 
         pi = mgccp_record . parameter_indices [ rand () % mgccp_size ];
-        ms =  database . csData () [ cs ] . vertices [ 0 ];
+        ms = cs_data . vertices [ 0 ];
         chose_representative = true;
         break;
       }
@@ -182,12 +178,6 @@ void ConleyProcess::work ( Message & result,
   uint64_t job_type;
   job >> job_type;
   switch ( job_type ) {
-    case 0:
-      // Checkpoint timer job
-      std::cout << "ConleyProcess::work. Checkpoint timer job detected.\n";
-      boost::this_thread::sleep( boost::posix_time::seconds(15) );
-      result << (uint64_t) 0;
-      break;
     case 1:
       std::cout << "ConleyProcess::work. Normal job detected.\n";
 
@@ -204,22 +194,10 @@ void ConleyProcess::work ( Message & result,
 void ConleyProcess::accept (const Message &result) {
   boost::posix_time::ptime current_time =
     boost::posix_time::second_clock::local_time (); 
-  std::cout << "ConleyProcess::accept. Time elapsed since last checkpoint = " <<
-    (current_time - time_of_last_checkpoint_) << "\n";
   // Read the results from the result message
   uint64_t result_type;
   result >> result_type;
-  if ( result_type == 0 ) {
-    // Checkpoint Timer finished.
-    checkpoint_timer_running_ = false;
-    
-    boost::posix_time::time_duration 
-      elapsed = current_time - time_of_last_checkpoint_;
-    if ( elapsed > boost::posix_time::seconds( 3600 ) ) {
-      checkpoint ();
-      progressReport ();
-    }
-  } else {
+  if ( result_type == 1 ) {
   // Accepting result of normal job.
     size_t job_number;
     int error_code;
@@ -234,12 +212,12 @@ void ConleyProcess::accept (const Message &result) {
       throw std::logic_error ( "Cannot compute Conley Index due to Phase Space type\n");
     }
     if ( error_code == 0 && not finished_[incc] ) { 
-      database . insert ( incc, job_result );
+      results_ . push_back ( std::make_pair ( incc, job_result ) );
       finished_ [ incc ] = true;
       ++ num_finished_;
     } else if ( error_code == 1 && not finished_[incc] ) {
       // partial answer, do not mark as finished but include result
-      database . insert ( incc, job_result );
+      results_ . push_back ( std::make_pair ( incc, job_result ) );
     }
     std::cout << "ConleyProcess::accept: Received result " 
             << job_number <<  " about INCC " << incc << 
@@ -249,6 +227,10 @@ void ConleyProcess::accept (const Message &result) {
   if ((current_time - time_of_last_progress_report_ ) > boost::posix_time::seconds( 1 ) ) {
     progressReport ();
   }
+
+  if ( timer_ . due () ) {
+    checkpoint ();
+  }
 }
 
 /* * * * * * * * * * * */
@@ -256,15 +238,22 @@ void ConleyProcess::accept (const Message &result) {
 /* * * * * * * * * * * */
 void ConleyProcess::finalize ( void ) {
   std::cout << "ConleyProcess::finalize ()\n";
+  timer_ . stop ();
   checkpoint ();
 }
 
 void ConleyProcess::checkpoint ( void ) {
+  // Only the checkpoint needs a modifiable database: load it, replay the
+  // results received so far in order, save it, and release it again.
+  Database output;
+  output . load ( database_file_ . c_str () );
+  typedef std::pair < uint64_t, CI_Data > Result;
+  BOOST_FOREACH ( const Result & result, results_ ) {
+    output . insert ( result . first, result . second );
+  }
   std::string filestring ( argv[1] );
   std::string appendstring ( "/database.cmdb" );
-  database . save ( (filestring + appendstring) . c_str () );
-  time_of_last_checkpoint_ =
-    boost::posix_time::second_clock::local_time ();
+  output . save ( (filestring + appendstring) . c_str () );
 }
 
 void ConleyProcess::progressReport ( void ) {
@@ -28,14 +28,18 @@
 
 #include "database/structures/SuccinctGrid.h"
 #include "database/structures/PointerGrid.h"
+#include "database/structures/CompactGrid.h"
 #include "database/structures/UniformGrid.h"
 #include "database/structures/EdgeGrid.h"
+#include "database/structures/StateGrid.h"
  
 #include <boost/serialization/export.hpp>
 BOOST_CLASS_EXPORT_IMPLEMENT(SuccinctGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(PointerGrid);
+BOOST_CLASS_EXPORT_IMPLEMENT(CompactGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(UniformGrid);
 BOOST_CLASS_EXPORT_IMPLEMENT(EdgeGrid);
+BOOST_CLASS_EXPORT_IMPLEMENT(StateGrid);
 
 
 #include "database/structures/EuclideanParameterSpace.h"
@@ -8,15 +8,20 @@
 #include <cmath>
 #include <exception>
 #include <vector>
+#include <cstdio>
 
 #include "boost/shared_ptr.hpp"
 #include "boost/thread.hpp"
 #include "boost/chrono/chrono_io.hpp"
+#include "boost/foreach.hpp"
+#include "boost/bind.hpp"
+#include "boost/unordered_set.hpp"
 
 #include "database/program/Configuration.h"
 #include "database/program/MorseProcess.h"
 #include "database/program/jobs/Clutching_Graph_Job.h"
 #include "database/structures/Database.h"
+#include "database/structures/EuclideanParameterSpace.h"
 
 #include "Model.h"
 
@@ -26,6 +31,37 @@ void MorseProcess::command_line ( int argcin, char * argvin [] ) {
   model . initialize ( argc, argv );
 }
 
+/// probeCost
+///   Estimated cost of computing the Morse graph of parameter: the size of
+///   phase space at PHASE_SUBDIV_MIN, plus the boxes of the Morse sets
+///   there times the number of boxes each may be subdivided into
+static double
+probeCost ( const Model & model, 
+            const Configuration & config,
+            boost::shared_ptr<Parameter> parameter ) {
+  boost::shared_ptr<const Map> map = model . map ( parameter );
+  if ( not map ) return 0.0;
+  boost::shared_ptr<Grid> phase_space = model . phaseSpace ();
+  if ( not phase_space ) {
+    throw std::logic_error ( "probeCost. model.phaseSpace() failed" 
+                             " to return a valid pointer.\n");
+  }
+  MorseGraph morse_graph;
+  Compute_Morse_Graph ( & morse_graph,
+                        phase_space,
+                        map,
+                        config.PHASE_SUBDIV_INIT,
+                        config.PHASE_SUBDIV_MIN,
+                        config.PHASE_SUBDIV_MIN,
+                        config.PHASE_SUBDIV_LIMIT );
+  double morse_boxes = 0.0;
+  for ( unsigned int v = 0; v < morse_graph . NumVertices (); ++ v ) {
+    if ( morse_graph . grid ( v ) ) morse_boxes += morse_graph . grid ( v ) -> size ();
+  }
+  return (double) phase_space -> size () + morse_boxes * 
+    std::pow ( 2.0, config.PHASE_SUBDIV_MAX - config.PHASE_SUBDIV_MIN );
+}
+
 /* * * * * * * * * * * * */
 /* initialize definition */
 /* * * * * * * * * * * * */
@@ -36,12 +72,11 @@ void MorseProcess::initialize ( void ) {
   std::cout << "MorseProcess::initialize. Loaded configuration.\n";
   
   // Checkpoint/Progress variable initialization
-  time_of_last_checkpoint_ = clock();
-  time_of_last_progress_report_ = clock ();
+  time_of_last_progress_report_ = 
+    boost::posix_time::second_clock::local_time ();
   progress_bar_ = 0;
   num_jobs_ = 0;
   num_jobs_sent_ = 0;
-  checkpoint_timer_running_ = false;
 
   // Construct Parameter Space
   std::cout << "MorseProcess::initialize. Obtaining parameter space.\n";
@@ -49,9 +84,56 @@ void MorseProcess::initialize ( void ) {
   if ( not parameter_space_ ) {
     throw std::logic_error ( "Unable to obtain parameter space from model.\n");
   }
+
+  // Resume from checkpoint
+  std::string filestring ( argv[1] );
+  bool resuming = resume ();
+
   std::cout << "MorseProcess::initialize. Serializing parameter space.\n";
   database . insert ( parameter_space_ );
 
+  // Parameters and clutchings already present (when resuming)
+  boost::unordered_set < uint64_t > computed_parameters;
+  boost::unordered_set < std::pair < uint64_t, uint64_t > > computed_clutchings;
+  if ( resuming ) {
+    BOOST_FOREACH ( const ParameterRecord & record, database . parameter_records () ) {
+      computed_parameters . insert ( record . parameter_index );
+    }
+    BOOST_FOREACH ( const ClutchingRecord & record, database . clutch_records () ) {
+      computed_clutchings . insert ( std::make_pair ( record . parameter_index_1, 
+                                                      record . parameter_index_2 ) );
+    }
+  }
+
+  // Start merging job results in the background
+#ifdef CMDB_DATABASE_LOG
+  // Fold any replayed log into database.raw and start a new log
+  database . save ( (filestring + "/database.raw") . c_str () );
+  std::remove ( (filestring + "/database.log") . c_str () );
+  merger_ . start ( &database, filestring + "/database.log" );
+#else
+  merger_ . start ( &database );
+#endif
+
+  // Periodic checkpoints are written on the merge thread
+  timer_ . start ( CMDB_CHECKPOINT_INTERVAL, 
+    boost::bind ( &DatabaseMerger::post, &merger_, 
+      DatabaseMerger::Task ( boost::bind ( &MorseProcess::checkpoint, this ) ) ) );
+
+#ifdef CMDB_ADAPTIVE_PATCHES
+  // Balance the patches by the estimated cost of their parameters
+  boost::shared_ptr<EuclideanParameterSpace> euclidean_space = 
+    boost::dynamic_pointer_cast<EuclideanParameterSpace> ( parameter_space_ );
+  if ( euclidean_space ) {
+    std::cout << "MorseProcess::initialize. Probing parameter costs.\n";
+    int probe_threads = CMDB_PATCH_THREADS;
+    if ( probe_threads == 0 ) probe_threads = boost::thread::hardware_concurrency ();
+    euclidean_space -> adaptPatches ( [&] ( uint64_t v ) {
+      return probeCost ( model, config, euclidean_space -> parameter ( v ) ); },
+      CMDB_ADAPTIVE_PATCHES, probe_threads );
+  }
+#endif
+
   // Count number of patches
   std::cout << "MorseProcess::initialize. Iterating through patches.\n";
   size_t num_calc = 0;
@@ -62,13 +144,33 @@ void MorseProcess::initialize ( void ) {
     }
     if ( p -> empty () ) break;
     ++ num_jobs_;
-    num_calc += p -> vertices . size ();
+    // A patch is complete if the checkpoint has all of its records
+    bool complete = resuming;
+    BOOST_FOREACH ( uint64_t v, p -> vertices ) {
+      if ( not complete ) break;
+      if ( computed_parameters . count ( v ) == 0 ) complete = false;
+    }
+    typedef std::pair < uint64_t, uint64_t > Adjacency;
+    BOOST_FOREACH ( const Adjacency & e, p -> edges ) {
+      if ( not complete ) break;
+      if ( computed_clutchings . count ( e ) == 0 ) complete = false;
+    }
+    patch_complete_ . push_back ( complete );
+    if ( complete ) {
+      ++ progress_bar_;
+    } else {
+      num_calc += p -> vertices . size ();
+    }
   }
   
   // Output to the user about the upcoming database calculation
   std::cout << "MorseProcess initialized. \n";
   std::cout << "  There are " << parameter_space_ -> size () << " parameters.\n";
   std::cout << "  There are " << num_jobs_ << " jobs.\n";
+  if ( resuming ) {
+    std::cout << "  Resuming from checkpoint: " << progress_bar_ 
+      << " jobs are already complete.\n";
+  }
   std::cout << "  Within those jobs, there are " << num_calc << " parameter box calculations to be done.\n";
   std::cout << "  On average, a single parameter box calculation will be done " << 
     (double) num_calc  / (double) parameter_space_ -> size ()  << " times.\n";
@@ -82,14 +184,17 @@ int MorseProcess::prepare ( Message & job ) {
   
   if ( progress_bar_ == num_jobs_ ) return 1; // nothing to compute
 
-  if ( not checkpoint_timer_running_  || num_jobs_sent_ == num_jobs_ ) {
-    job << (uint64_t) 0; // Checkpoint timer job
-    checkpoint_timer_running_ = true;
-    return 0;
-  } else {
-    job << (uint64_t) 1; // Conley Job
+  // Skip patches completed before a restart
+  while ( num_jobs_sent_ < num_jobs_ && patch_complete_ [ num_jobs_sent_ ] ) {
+    parameter_space_ -> patch ();
+    ++ num_jobs_sent_;
   }
 
+  // Every job has been sent; remaining results are still collected
+  if ( num_jobs_sent_ == num_jobs_ ) return 1;
+
+  job << (uint64_t) 1; // Clutching Graph Job
+
   // Job number (job id) of job to be sent
   size_t job_number = num_jobs_sent_;
   std::cout << "MorseProcess::prepare: Preparing job " << job_number << "\n";
@@ -143,12 +248,6 @@ void MorseProcess::work ( Message & result, const Message & job ) const {
   uint64_t job_type;
   job >> job_type;
   switch ( job_type ) {
-  case 0:
-    // Checkpoint timer job
-    std::cout << "MorseProcess::work. Checkpoint timer job detected.\n";
-    boost::this_thread::sleep( boost::posix_time::seconds(15) );
-    result << (uint64_t) 0;
-    break;
   case 1:
     std::cout << "MorseProcess::work. Normal Job detected.\n";
     result << (uint64_t) 1;
@@ -165,7 +264,7 @@ void MorseProcess::work ( Message & result, const Message & job ) const {
       t.join();
     }
     if ( not computed ) {
-      result << Database ();
+      result << DatabaseMerger::serialize ( Database () );
     }
     break;
   }
@@ -176,34 +275,26 @@ void MorseProcess::work ( Message & result, const Message & job ) const {
 /* accept definition */
 /* * * * * * * * * * */
 void MorseProcess::accept(const Message &result) {
-  clock_t current_time = clock ();
+  boost::posix_time::ptime current_time =
+    boost::posix_time::second_clock::local_time (); 
   /// Read the results from the result message
   uint64_t result_type;
   result >> result_type;
-  if ( result_type == 0 ) {
-    // Checkpoint Timer finished.
-    checkpoint_timer_running_ = false;
-    // Save a checkpoint
-    if ( (float)(current_time - time_of_last_checkpoint_ ) 
-      / (float)CLOCKS_PER_SEC > 3600.0f ) {
-      checkpoint ();
-      progressReport ();
-    }
-  } else {
+  if ( result_type == 1 ) {
     // Accepting result of normal job.
     // Read the results from the result message
     size_t job_number;
-    Database job_database;
+    boost::shared_ptr<std::string> job_bytes ( new std::string );
     result >> job_number;
-    result >> job_database;
-    // Merge the results
-    database . merge ( job_database );
+    result >> *job_bytes;
+    // Log and merge the results as received (on the merge thread)
+    merger_ . push ( job_bytes );
     ++ progress_bar_;
     std::cout << "MorseProcess::read: Received result " 
       << job_number << "\n";
   }
 
-  if ( (float)(current_time - time_of_last_progress_report_ ) / (float)CLOCKS_PER_SEC > 1.0f ) {
+  if ( (current_time - time_of_last_progress_report_ ) > boost::posix_time::seconds( 1 ) ) {
     progressReport ();
   }
 }
@@ -213,15 +304,62 @@ void MorseProcess::accept(const Message &result) {
 /* * * * * * * * * * * */
 void MorseProcess::finalize ( void ) {
   std::cout << "MorseProcess::finalize \n";
-  checkpoint ();
+  timer_ . stop ();
+  merger_ . stop ();
+  std::string filestring ( argv[1] );
+  database . save ( (filestring + "/database.raw") . c_str () );
+#ifdef CMDB_DATABASE_LOG
+  // database.raw is now complete
+  std::remove ( (filestring + "/database.log") . c_str () );
+#endif
+}
+
+bool MorseProcess::resume ( void ) {
+#ifdef CMDB_NO_RESUME
+  return false;
+#else
+  std::string filestring ( argv[1] );
+  std::string checkpoint_file = filestring + "/database.raw";
+  std::string log_file = filestring + "/database.log";
+  if ( not std::ifstream ( checkpoint_file . c_str () ) . good () ) return false;
+  std::cout << "MorseProcess::resume. Loading checkpoint " << checkpoint_file << "\n";
+  // A checkpoint that cannot be read (e.g. left by a version without
+  // atomic saves) is discarded rather than preventing a restart
+  uint64_t num_logged;
+  try {
+    database . load ( checkpoint_file . c_str () );
+    // A checkpoint from a different parameter space cannot be resumed
+    if ( not database . parameterSpace () || 
+         database . parameterSpace () -> size () != parameter_space_ -> size () ) {
+      std::cout << "MorseProcess::resume. Checkpoint does not match the parameter space;"
+                   " starting from the beginning.\n";
+      database = Database ();
+      return false;
+    }
+    num_logged = DatabaseMerger::replay ( log_file, &database );
+  } catch ( const std::exception & e ) {
+    std::cout << "MorseProcess::resume. Warning: could not read checkpoint " 
+      << checkpoint_file << " (" << e . what () << "); starting from the beginning.\n";
+    database = Database ();
+    return false;
+  }
+  if ( num_logged > 0 ) {
+    std::cout << "MorseProcess::resume. Replayed " << num_logged << " results from " 
+      << log_file << "\n";
+  }
+  return true;
+#endif
 }
 
 void MorseProcess::checkpoint ( void ) {
+  // Runs on the merge thread (see initialize), between merges.
+  // With CMDB_DATABASE_LOG the merger has already flushed the log.
   std::cout << "MorseProcess::checkpoint\n";
+#ifndef CMDB_DATABASE_LOG
   std::string filestring ( argv[1] );
   std::string appendstring ( "/database.raw" );
   database . save ( (filestring + appendstring) . c_str () );
-  time_of_last_checkpoint_ = clock();
+#endif
 }
 
 void MorseProcess::progressReport ( void ) {
@@ -229,5 +367,6 @@ void MorseProcess::progressReport ( void ) {
   std::ofstream progress_file ( "progress.txt" );
   progress_file << "Morse Process Progress: " << progress_bar_ << " / " << num_jobs_ << "\n";
   progress_file . close ();
-  time_of_last_progress_report_ = clock();
+  time_of_last_progress_report_ = 
+    boost::posix_time::second_clock::local_time ();
 }